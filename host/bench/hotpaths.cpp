@@ -0,0 +1,184 @@
+// Hot path benchmark and regression check
+//
+// Times the firmware's per-frame, per-report and per-subcommand paths
+// (main/bench.c) and prints ns per item. With --baseline the run fails when
+// any path is slower than the saved result by more than --threshold percent.
+//
+//   nxpad-bench [--rounds N] [--repeat N] [--stream FILE]
+//               [--save FILE] [--baseline FILE] [--threshold PCT]
+//
+// --stream replays a raw UART capture (for example from nxpad-standin
+// --record) through the frame path instead of the synthetic stream.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "bench.h"
+}
+
+namespace
+{
+
+uint32_t clock_ns()
+{
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+std::map<std::string, double> load_results(const std::string& path)
+{
+  std::map<std::string, double> results;
+  std::ifstream in(path);
+  std::string name;
+  double ns;
+  while (in >> name >> ns)
+  {
+    results[name] = ns;
+  }
+  return results;
+}
+
+int usage(const char* name)
+{
+  std::fprintf(stderr,
+               "usage: %s [--rounds N] [--repeat N] [--stream FILE] [--save FILE] [--baseline FILE] "
+               "[--threshold PCT]\n",
+               name);
+  return 2;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t rounds = 200;
+  int repeat = 5;
+  double threshold = 10.0;
+  std::string stream_path, save_path, baseline_path;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      return usage(argv[0]);
+    }
+    if (arg == "--rounds")
+    {
+      rounds = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    }
+    else if (arg == "--repeat")
+    {
+      repeat = std::atoi(argv[++i]);
+    }
+    else if (arg == "--stream")
+    {
+      stream_path = argv[++i];
+    }
+    else if (arg == "--save")
+    {
+      save_path = argv[++i];
+    }
+    else if (arg == "--baseline")
+    {
+      baseline_path = argv[++i];
+    }
+    else if (arg == "--threshold")
+    {
+      threshold = std::atof(argv[++i]);
+    }
+    else
+    {
+      return usage(argv[0]);
+    }
+  }
+  if (rounds == 0 || repeat <= 0)
+  {
+    return usage(argv[0]);
+  }
+
+  std::vector<uint8_t> stream;
+  if (stream_path.empty())
+  {
+    stream.resize(4096);
+    stream.resize(bench_synth_stream(stream.data(), stream.size(), 1));
+  }
+  else
+  {
+    std::ifstream in(stream_path, std::ios::binary);
+    if (!in)
+    {
+      std::fprintf(stderr, "cannot open %s\n", stream_path.c_str());
+      return 1;
+    }
+    stream.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  // Best of `repeat` runs, which is the most stable figure on a shared machine
+  double best[BENCH_COUNT];
+  for (int i = 0; i < BENCH_COUNT; i++)
+  {
+    best[i] = 0.0;
+  }
+
+  for (int run = 0; run < repeat; run++)
+  {
+    bench_result_t results[BENCH_COUNT];
+    bench_run(clock_ns, stream.data(), stream.size(), rounds, results);
+    for (int i = 0; i < BENCH_COUNT; i++)
+    {
+      double ns = results[i].items ? static_cast<double>(results[i].ticks) / results[i].items : 0.0;
+      if (run == 0 || ns < best[i])
+      {
+        best[i] = ns;
+      }
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_path.empty())
+  {
+    baseline = load_results(baseline_path);
+    if (baseline.empty())
+    {
+      std::fprintf(stderr, "no results in %s\n", baseline_path.c_str());
+      return 1;
+    }
+  }
+
+  bool regressed = false;
+  for (int i = 0; i < BENCH_COUNT; i++)
+  {
+    const char* name = bench_path_names[i];
+    std::printf("%-10s %10.1f ns/%s", name, best[i], name);
+
+    auto it = baseline.find(name);
+    if (it != baseline.end() && it->second > 0.0)
+    {
+      double change = (best[i] - it->second) * 100.0 / it->second;
+      bool bad = change > threshold;
+      std::printf("  (baseline %.1f, %+.1f%%%s)", it->second, change, bad ? ", REGRESSED" : "");
+      regressed |= bad;
+    }
+    std::printf("\n");
+  }
+
+  if (!save_path.empty())
+  {
+    std::ofstream out(save_path);
+    for (int i = 0; i < BENCH_COUNT; i++)
+    {
+      out << bench_path_names[i] << ' ' << best[i] << '\n';
+    }
+  }
+
+  return regressed ? 1 : 0;
+}
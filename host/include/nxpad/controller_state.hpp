@@ -0,0 +1,108 @@
+// Typed controller state
+
+#pragma once
+
+#include <cstdint>
+
+#include "nxpad/firmware.hpp"
+
+namespace nxpad
+{
+
+// Bit positions follow controller_input_t: but1 in bits 0-7, but2 in 8-15, but3 in 16-23
+enum class Button : uint32_t
+{
+  Y = 1u << 0,
+  X = 1u << 1,
+  B = 1u << 2,
+  A = 1u << 3,
+  R = 1u << 6,
+  ZR = 1u << 7,
+
+  Minus = 1u << 8,
+  Plus = 1u << 9,
+  RStick = 1u << 10,
+  LStick = 1u << 11,
+  Home = 1u << 12,
+  Capture = 1u << 13,
+
+  Down = 1u << 16,
+  Up = 1u << 17,
+  Right = 1u << 18,
+  Left = 1u << 19,
+  L = 1u << 22,
+  ZL = 1u << 23,
+};
+
+struct Stick
+{
+  uint8_t x = 128;
+  uint8_t y = 128;
+
+  bool operator==(const Stick& other) const { return x == other.x && y == other.y; }
+  bool operator!=(const Stick& other) const { return !(*this == other); }
+};
+
+class ControllerState
+{
+public:
+  ControllerState& press(Button button)
+  {
+    buttons_ |= static_cast<uint32_t>(button);
+    return *this;
+  }
+
+  ControllerState& release(Button button)
+  {
+    buttons_ &= ~static_cast<uint32_t>(button);
+    return *this;
+  }
+
+  ControllerState& set(Button button, bool pressed) { return pressed ? press(button) : release(button); }
+
+  ControllerState& release_all()
+  {
+    buttons_ = 0;
+    return *this;
+  }
+
+  bool pressed(Button button) const { return (buttons_ & static_cast<uint32_t>(button)) != 0; }
+
+  uint32_t buttons() const { return buttons_; }
+
+  Stick left;
+  Stick right;
+
+  controller_input_t to_input() const
+  {
+    controller_input_t input;
+    input.but1 = buttons_ & 0xFF;
+    input.but2 = (buttons_ >> 8) & 0xFF;
+    input.but3 = (buttons_ >> 16) & 0xFF;
+    input.lx = left.x;
+    input.ly = left.y;
+    input.rx = right.x;
+    input.ry = right.y;
+    return input;
+  }
+
+  static ControllerState from_input(const controller_input_t& input)
+  {
+    ControllerState state;
+    state.buttons_ = input.but1 | (input.but2 << 8) | (input.but3 << 16);
+    state.left = {input.lx, input.ly};
+    state.right = {input.rx, input.ry};
+    return state;
+  }
+
+  bool operator==(const ControllerState& other) const
+  {
+    return buttons_ == other.buttons_ && left == other.left && right == other.right;
+  }
+  bool operator!=(const ControllerState& other) const { return !(*this == other); }
+
+private:
+  uint32_t buttons_ = 0;
+};
+
+}
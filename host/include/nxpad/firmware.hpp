@@ -0,0 +1,19 @@
+// Firmware modules shared with the host build (decoder, encoder, engines)
+
+#pragma once
+
+extern "C" {
+#include "device.h"
+#include "imu.h"
+#include "input.h"
+#include "latency.h"
+#include "link_profile.h"
+#include "little_endian.h"
+#include "macro.h"
+#include "profile.h"
+#include "recorder.h"
+#include "rumble.h"
+#include "schedule.h"
+#include "settings.h"
+#include "uart_proto.h"
+}
@@ -0,0 +1,105 @@
+// Asynchronous, batching connection to the firmware
+//
+// update() and the other senders never block: they only record what has to
+// go out. A writer thread wakes up, takes everything pending and writes it
+// with a single write() call. Controller states are coalesced, so only the
+// newest state is sent no matter how many updates arrived in between.
+// A reader thread decodes device packets and tracks the device report clock.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nxpad/controller_state.hpp"
+#include "nxpad/protocol.hpp"
+
+namespace nxpad
+{
+
+// Last UART_PKT_CLOCK answer and when it arrived
+struct ReportClock
+{
+  bool valid = false;
+  uint32_t next_report = 0;
+  uint32_t period_us = 0;
+  uint16_t schedule_free = 0;
+  uint8_t controller = 0; // CONTROLLER_TYPE, 0 from firmware that does not send it
+  std::chrono::steady_clock::time_point received;
+};
+
+struct LinkStats
+{
+  uint64_t updates = 0;   // update() calls
+  uint64_t states = 0;    // states actually written
+  uint64_t writes = 0;    // write() batches
+  uint64_t bytes = 0;
+  uint64_t packets_in = 0;
+  uint64_t errors_in = 0;
+};
+
+class Link
+{
+public:
+  using PacketHandler = std::function<void(uint8_t type, const uint8_t* payload, size_t length)>;
+
+  // fd stays owned by the caller and must outlive the Link.
+  // flush_interval spaces out consecutive writes so more updates coalesce.
+  Link(int fd, Protocol protocol, std::chrono::microseconds flush_interval = std::chrono::microseconds(0));
+  ~Link();
+
+  Link(const Link&) = delete;
+  Link& operator=(const Link&) = delete;
+
+  void update(const ControllerState& state);
+  void command(uint8_t byte);
+  void packet(uint8_t type, const uint8_t* payload, size_t length);
+
+  // Queues states for exact device reports (Protocol::Packet only)
+  void schedule(const ScheduledState* entries, size_t count);
+
+  void request_clock() { command(UART_CMD_CLOCK); }
+  ReportClock clock() const;
+  // Estimated device report number at time t, from the last clock answer
+  uint32_t report_at(std::chrono::steady_clock::time_point t) const;
+
+  // Called on the reader thread for every device packet
+  void on_packet(PacketHandler handler);
+
+  // Blocks until everything queued so far has been written
+  void flush();
+
+  LinkStats stats() const;
+
+private:
+  void writer_loop();
+  void reader_loop();
+
+  int fd_;
+  Protocol protocol_;
+  std::chrono::microseconds flush_interval_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable drained_;
+  bool stop_ = false;
+
+  ControllerState state_;
+  bool state_dirty_ = false;
+  std::vector<uint8_t> pending_; // commands and packets, in call order
+  bool writing_ = false;
+
+  ReportClock clock_;
+  PacketHandler handler_;
+  LinkStats stats_;
+
+  std::thread writer_;
+  std::thread reader_;
+};
+
+}
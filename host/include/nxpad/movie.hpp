@@ -0,0 +1,167 @@
+// Input movies: precomputed per-report controller states
+//
+// File layout (little endian):
+//
+//   header   "NXMV", version (u8), controller type (u8, CONTROLLER_TYPE),
+//            header size (u16), report period us (u32), reports (u32)
+//   records  change mask (u8, bit i = state byte i: but1, but2, but3,
+//            lx, ly, rx, ry), the changed bytes, hold (LEB128 varint,
+//            reports the state lasts, at least 1)
+//
+// The state before the first record is input_reset(). A movie covers
+// `reports` consecutive device reports, the sum of all holds.
+//
+// MoviePlayer streams a movie into the device input schedule: every record
+// becomes one UART_PKT_SCHEDULE entry tagged with its device report number,
+// so the device applies it on the exact report no matter how early it
+// arrived. Progress is paced by UART_CMD_CLOCK answers, never by the host
+// clock, so long movies do not drift. The file is mmapped and read once
+// front to back; memory stays constant whatever the movie length.
+// The input returns to input_reset() when the movie ends, and at the first
+// report not queued yet when playback is stopped early.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "nxpad/controller_state.hpp"
+#include "nxpad/link.hpp"
+
+namespace nxpad
+{
+
+constexpr uint8_t kMovieVersion = 1;
+constexpr size_t kMovieHeaderSize = 16;
+
+struct MovieHeader
+{
+  uint8_t version = kMovieVersion;
+  uint8_t controller = PRO_CON;
+  uint32_t period_us = 0;
+  uint32_t reports = 0;
+};
+
+struct MovieRecord
+{
+  uint32_t offset; // report number relative to the start of the movie
+  uint32_t hold;
+  ControllerState state;
+};
+
+// Writes records as they come; the header is completed by finish()
+class MovieWriter
+{
+public:
+  // Throws std::system_error when the file cannot be created
+  MovieWriter(const std::string& path, uint8_t controller, uint32_t period_us);
+  ~MovieWriter();
+
+  MovieWriter(const MovieWriter&) = delete;
+  MovieWriter& operator=(const MovieWriter&) = delete;
+
+  // state lasts hold reports; equal consecutive states are merged
+  void append(const ControllerState& state, uint32_t hold);
+
+  // Flushes the pending record and the final header. Returns false on I/O errors.
+  bool finish();
+
+private:
+  void write_record();
+
+  std::FILE* file_;
+  MovieHeader header_;
+  ControllerState written_;  // state after the last written record
+  ControllerState pending_;
+  uint32_t pending_hold_ = 0;
+  bool ok_ = true;
+};
+
+// Read-only mapping of a movie file
+class MovieReader
+{
+public:
+  // Throws std::system_error when the file cannot be mapped and
+  // std::runtime_error when the header is not a movie header
+  explicit MovieReader(const std::string& path);
+  ~MovieReader();
+
+  MovieReader(const MovieReader&) = delete;
+  MovieReader& operator=(const MovieReader&) = delete;
+
+  const MovieHeader& header() const { return header_; }
+
+  class Cursor
+  {
+  public:
+    // False at the end of the movie or on a truncated record (see error())
+    bool next(MovieRecord& record);
+    bool error() const { return error_; }
+
+  private:
+    friend class MovieReader;
+    Cursor(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint32_t offset_ = 0;
+    controller_input_t input_ = {0, 0, 0, 128, 128, 128, 128};
+    bool error_ = false;
+  };
+
+  Cursor records() const { return Cursor(data_ + header_size_, size_ - header_size_); }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  size_t header_size_ = kMovieHeaderSize; // later versions may append header fields
+  MovieHeader header_;
+};
+
+struct MoviePlayerStats
+{
+  uint32_t start_report = 0; // device report of movie offset 0
+  uint32_t entries = 0;      // schedule entries sent
+  uint32_t late = 0;         // entries sent after their report had passed
+  uint32_t clock_requests = 0;
+};
+
+class MoviePlayer
+{
+public:
+  // Installs its own packet handler on the link (Protocol::Packet)
+  MoviePlayer(Link& link, const MovieReader& movie);
+
+  // Reports between the first clock answer and movie offset 0; covers
+  // the UART latency of the first entries
+  void set_lead(uint32_t reports) { lead_ = reports; }
+
+  // Blocks until the device has played the whole movie, the device stops
+  // answering (false) or running becomes false (false)
+  bool play(const std::atomic<bool>& running);
+
+  MoviePlayerStats stats() const { return stats_; }
+
+  // Asks the device for its clock; false when it does not answer within 2 s
+  bool fresh_clock(ReportClock& clock);
+
+private:
+  // Queues input_reset() for report once the device has room for it
+  void schedule_reset(ReportClock& clock, uint32_t report);
+
+  Link& link_;
+  const MovieReader& movie_;
+  uint32_t lead_ = 8;
+  MoviePlayerStats stats_;
+
+  std::mutex mutex_;
+  std::condition_variable clock_answered_;
+  uint64_t clock_answers_ = 0;
+};
+
+}
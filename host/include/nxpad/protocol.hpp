@@ -0,0 +1,36 @@
+// Host side encoders for the UART stream (see main/uart_proto.h)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "nxpad/controller_state.hpp"
+
+namespace nxpad
+{
+
+enum class Protocol
+{
+  Legacy, // 11-byte 0xAA frames, digital sticks only
+  Packet, // UART_PKT_INPUT_STATE packets, full analog sticks, enables scheduling
+};
+
+struct ScheduledState
+{
+  uint32_t report;
+  ControllerState state;
+};
+
+// Appends a legacy frame. Sticks are quantized to the frame's 3 positions per axis.
+void append_legacy_frame(std::vector<uint8_t>& out, const ControllerState& state);
+
+void append_packet(std::vector<uint8_t>& out, uint8_t type, const uint8_t* payload, size_t length);
+
+void append_state_packet(std::vector<uint8_t>& out, const ControllerState& state);
+
+// Appends as many UART_PKT_SCHEDULE packets as needed for the entries
+void append_schedule_packets(std::vector<uint8_t>& out, const ScheduledState* entries, size_t count);
+
+}
@@ -0,0 +1,49 @@
+// Reassembles a recorder dump (UART_PKT_RECORD_INFO, _DATA..., _END)
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "nxpad/firmware.hpp"
+
+namespace nxpad
+{
+
+struct RecordedReport
+{
+  uint32_t report;
+  std::array<uint8_t, RECORDER_REPORT_SIZE> data;
+};
+
+class RecordingReceiver
+{
+public:
+  // Feed every device packet; returns true once the dump is complete
+  bool feed(uint8_t type, const uint8_t* payload, size_t length);
+
+  bool complete() const { return complete_; }
+  // Chunks lost or malformed; the reports after a loss are not trustworthy
+  bool intact() const { return complete_ && errors_ == 0; }
+
+  uint32_t period_us() const { return period_us_; }
+  uint32_t overwritten() const { return overwritten_; }
+  size_t stream_bytes() const { return bytes_; }
+  const std::vector<RecordedReport>& reports() const { return reports_; }
+
+private:
+  bool started_ = false;
+  bool complete_ = false;
+  uint16_t next_seq_ = 0;
+  uint32_t expected_ = 0;
+  uint32_t overwritten_ = 0;
+  uint32_t period_us_ = 0;
+  size_t bytes_ = 0;
+  unsigned errors_ = 0;
+  recorder_cursor_t cursor_ = {};
+  std::vector<RecordedReport> reports_;
+};
+
+}
@@ -0,0 +1,32 @@
+// POSIX serial port (also works on the stand-in's pty)
+
+#pragma once
+
+#include <string>
+
+namespace nxpad
+{
+
+class SerialPort
+{
+public:
+  SerialPort() = default;
+  // Opens path in raw 8N1 mode. Any positive baud works on Linux, elsewhere
+  // only the termios table rates. Throws std::system_error on failure.
+  SerialPort(const std::string& path, int baud);
+  ~SerialPort();
+
+  SerialPort(const SerialPort&) = delete;
+  SerialPort& operator=(const SerialPort&) = delete;
+  SerialPort(SerialPort&& other) noexcept;
+  SerialPort& operator=(SerialPort&& other) noexcept;
+
+  int fd() const { return fd_; }
+  bool is_open() const { return fd_ >= 0; }
+  void close();
+
+private:
+  int fd_ = -1;
+};
+
+}
@@ -0,0 +1,257 @@
+// Asynchronous, batching connection to the firmware
+
+#include "nxpad/link.hpp"
+
+#include <cerrno>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace nxpad
+{
+
+namespace
+{
+
+bool write_all(int fd, const uint8_t* data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+      {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+}
+
+Link::Link(int fd, Protocol protocol, std::chrono::microseconds flush_interval)
+  : fd_(fd), protocol_(protocol), flush_interval_(flush_interval)
+{
+  writer_ = std::thread(&Link::writer_loop, this);
+  reader_ = std::thread(&Link::reader_loop, this);
+}
+
+Link::~Link()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  writer_.join();
+  reader_.join();
+}
+
+void Link::update(const ControllerState& state)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.updates++;
+    if (state == state_ && !state_dirty_)
+    {
+      return;
+    }
+    state_ = state;
+    state_dirty_ = true;
+  }
+  wake_.notify_one();
+}
+
+void Link::command(uint8_t byte)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(byte);
+  }
+  wake_.notify_one();
+}
+
+void Link::packet(uint8_t type, const uint8_t* payload, size_t length)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    append_packet(pending_, type, payload, length);
+  }
+  wake_.notify_one();
+}
+
+void Link::schedule(const ScheduledState* entries, size_t count)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    append_schedule_packets(pending_, entries, count);
+  }
+  wake_.notify_one();
+}
+
+ReportClock Link::clock() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return clock_;
+}
+
+uint32_t Link::report_at(std::chrono::steady_clock::time_point t) const
+{
+  ReportClock clock = this->clock();
+  if (!clock.valid || clock.period_us == 0)
+  {
+    return 0;
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t - clock.received).count();
+  return clock.next_report + static_cast<int32_t>(elapsed / static_cast<int64_t>(clock.period_us));
+}
+
+void Link::on_packet(PacketHandler handler)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  handler_ = std::move(handler);
+}
+
+void Link::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  drained_.wait(lock, [this] { return stop_ || (pending_.empty() && !state_dirty_ && !writing_); });
+}
+
+LinkStats Link::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void Link::writer_loop()
+{
+  std::vector<uint8_t> batch;
+  auto last_write = std::chrono::steady_clock::time_point();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    wake_.wait(lock, [this] { return stop_ || state_dirty_ || !pending_.empty(); });
+    if (stop_)
+    {
+      break;
+    }
+
+    // Let more updates pile up until the flush interval has passed
+    auto due = last_write + flush_interval_;
+    if (std::chrono::steady_clock::now() < due)
+    {
+      wake_.wait_until(lock, due, [this] { return stop_; });
+      if (stop_)
+      {
+        break;
+      }
+    }
+
+    batch.clear();
+    batch.swap(pending_);
+    if (state_dirty_)
+    {
+      if (protocol_ == Protocol::Legacy)
+      {
+        append_legacy_frame(batch, state_);
+      }
+      else
+      {
+        append_state_packet(batch, state_);
+      }
+      state_dirty_ = false;
+      stats_.states++;
+    }
+    writing_ = true;
+
+    lock.unlock();
+    bool ok = write_all(fd_, batch.data(), batch.size());
+    last_write = std::chrono::steady_clock::now();
+    lock.lock();
+
+    writing_ = false;
+    if (ok)
+    {
+      stats_.writes++;
+      stats_.bytes += batch.size();
+    }
+    drained_.notify_all();
+  }
+  drained_.notify_all();
+}
+
+void Link::reader_loop()
+{
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  uint8_t buffer[256];
+
+  while (true)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_)
+      {
+        return;
+      }
+    }
+
+    pollfd pfd = {fd_, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, 50);
+    if (ready <= 0 || !(pfd.revents & POLLIN))
+    {
+      uart_proto_idle(&proto);
+      if (ready > 0 && (pfd.revents & (POLLHUP | POLLERR)))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+      continue;
+    }
+
+    ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < n; i++)
+    {
+      uart_proto_event_t event = uart_proto_feed(&proto, buffer[i]);
+      if (event == UART_PROTO_ERROR)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.errors_in++;
+        continue;
+      }
+      if (event != UART_PROTO_PACKET)
+      {
+        continue;
+      }
+
+      PacketHandler handler;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.packets_in++;
+        if (proto.type == UART_PKT_CLOCK && proto.length >= 10)
+        {
+          clock_.valid = true;
+          clock_.next_report = le_get_u32(&proto.payload[0]);
+          clock_.period_us = le_get_u32(&proto.payload[4]);
+          clock_.schedule_free = le_get_u16(&proto.payload[8]);
+          clock_.controller = proto.length >= 11 ? proto.payload[10] : 0;
+          clock_.received = std::chrono::steady_clock::now();
+        }
+        handler = handler_;
+      }
+      if (handler)
+      {
+        handler(proto.type, proto.payload, proto.length);
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,396 @@
+// Input movie files and the schedule streaming player
+
+#include "nxpad/movie.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nxpad
+{
+
+namespace
+{
+
+const char kMagic[4] = {'N', 'X', 'M', 'V'};
+constexpr int kStateBytes = 7;
+
+// Upper bound of a LEB128 u32
+constexpr int kMaxVarint = 5;
+
+void state_bytes(const ControllerState& state, uint8_t* out)
+{
+  controller_input_t input = state.to_input();
+  const uint8_t bytes[kStateBytes] = {input.but1, input.but2, input.but3, input.lx, input.ly, input.rx, input.ry};
+  std::memcpy(out, bytes, kStateBytes);
+}
+
+}
+
+MovieWriter::MovieWriter(const std::string& path, uint8_t controller, uint32_t period_us)
+{
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr)
+  {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+  header_.controller = controller;
+  header_.period_us = period_us;
+
+  // Placeholder, rewritten by finish() once the length is known
+  uint8_t header[kMovieHeaderSize] = {};
+  ok_ = std::fwrite(header, sizeof(header), 1, file_) == 1;
+}
+
+MovieWriter::~MovieWriter()
+{
+  if (file_ != nullptr)
+  {
+    finish();
+  }
+}
+
+void MovieWriter::append(const ControllerState& state, uint32_t hold)
+{
+  if (hold == 0)
+  {
+    return;
+  }
+  if (pending_hold_ != 0 && state == pending_ && pending_hold_ + hold > pending_hold_)
+  {
+    pending_hold_ += hold;
+    return;
+  }
+  if (pending_hold_ != 0)
+  {
+    write_record();
+  }
+  pending_ = state;
+  pending_hold_ = hold;
+}
+
+void MovieWriter::write_record()
+{
+  uint8_t before[kStateBytes];
+  uint8_t after[kStateBytes];
+  state_bytes(written_, before);
+  state_bytes(pending_, after);
+
+  uint8_t record[1 + kStateBytes + kMaxVarint];
+  size_t length = 1;
+  uint8_t mask = 0;
+  for (int i = 0; i < kStateBytes; i++)
+  {
+    if (after[i] != before[i])
+    {
+      mask |= 1 << i;
+      record[length++] = after[i];
+    }
+  }
+  record[0] = mask;
+
+  uint32_t hold = pending_hold_;
+  do
+  {
+    uint8_t byte = hold & 0x7F;
+    hold >>= 7;
+    record[length++] = hold != 0 ? (byte | 0x80) : byte;
+  } while (hold != 0);
+
+  if (std::fwrite(record, length, 1, file_) != 1)
+  {
+    ok_ = false;
+  }
+  header_.reports += pending_hold_;
+  written_ = pending_;
+  pending_hold_ = 0;
+}
+
+bool MovieWriter::finish()
+{
+  if (file_ == nullptr)
+  {
+    return false;
+  }
+  if (pending_hold_ != 0)
+  {
+    write_record();
+  }
+
+  uint8_t header[kMovieHeaderSize];
+  std::memcpy(header, kMagic, sizeof(kMagic));
+  header[4] = header_.version;
+  header[5] = header_.controller;
+  le_put_u16(&header[6], kMovieHeaderSize);
+  le_put_u32(&header[8], header_.period_us);
+  le_put_u32(&header[12], header_.reports);
+  if (std::fseek(file_, 0, SEEK_SET) != 0 || std::fwrite(header, sizeof(header), 1, file_) != 1)
+  {
+    ok_ = false;
+  }
+  if (std::fclose(file_) != 0)
+  {
+    ok_ = false;
+  }
+  file_ = nullptr;
+  return ok_;
+}
+
+MovieReader::MovieReader(const std::string& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "fstat " + path);
+  }
+  if (st.st_size < static_cast<off_t>(kMovieHeaderSize))
+  {
+    ::close(fd);
+    throw std::runtime_error(path + ": not a movie file");
+  }
+
+  size_ = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    throw std::system_error(err, std::generic_category(), "mmap " + path);
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  // Records are decoded once, front to back
+  madvise(data, size_, MADV_SEQUENTIAL);
+
+  header_size_ = le_get_u16(&data_[6]);
+  if (std::memcmp(data_, kMagic, sizeof(kMagic)) != 0 || data_[4] != kMovieVersion ||
+      header_size_ < kMovieHeaderSize || header_size_ > size_)
+  {
+    munmap(data, size_);
+    throw std::runtime_error(path + ": not a movie file");
+  }
+  header_.version = data_[4];
+  header_.controller = data_[5];
+  header_.period_us = le_get_u32(&data_[8]);
+  header_.reports = le_get_u32(&data_[12]);
+}
+
+MovieReader::~MovieReader()
+{
+  munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+bool MovieReader::Cursor::next(MovieRecord& record)
+{
+  if (error_ || p_ == end_)
+  {
+    return false;
+  }
+
+  uint8_t mask = *p_++;
+  if (mask & 0x80)
+  {
+    error_ = true;
+    return false;
+  }
+  uint8_t* bytes[kStateBytes] = {&input_.but1, &input_.but2, &input_.but3, &input_.lx,
+                                 &input_.ly, &input_.rx, &input_.ry};
+  for (int i = 0; i < kStateBytes; i++)
+  {
+    if (!(mask & (1 << i)))
+    {
+      continue;
+    }
+    if (p_ == end_)
+    {
+      error_ = true;
+      return false;
+    }
+    *bytes[i] = *p_++;
+  }
+
+  uint32_t hold = 0;
+  for (int shift = 0;; shift += 7)
+  {
+    if (p_ == end_ || shift >= 7 * kMaxVarint)
+    {
+      error_ = true;
+      return false;
+    }
+    uint8_t byte = *p_++;
+    hold |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+    {
+      break;
+    }
+  }
+  if (hold == 0)
+  {
+    error_ = true;
+    return false;
+  }
+
+  record.offset = offset_;
+  record.hold = hold;
+  record.state = ControllerState::from_input(input_);
+  offset_ += hold;
+  return true;
+}
+
+namespace
+{
+
+// A few reports drain some of the queue; bounded so slow periods still see
+// the end promptly and fast ones do not flood the UART with requests
+std::chrono::microseconds clock_wait(const ReportClock& clock)
+{
+  auto wait = std::chrono::microseconds(clock.period_us) * 4;
+  wait = std::max<std::chrono::microseconds>(wait, std::chrono::milliseconds(20));
+  return std::min<std::chrono::microseconds>(wait, std::chrono::milliseconds(500));
+}
+
+}
+
+MoviePlayer::MoviePlayer(Link& link, const MovieReader& movie) : link_(link), movie_(movie)
+{
+  link_.on_packet([this](uint8_t type, const uint8_t*, size_t) {
+    if (type != UART_PKT_CLOCK)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    clock_answers_++;
+    clock_answered_.notify_all();
+  });
+}
+
+bool MoviePlayer::fresh_clock(ReportClock& clock)
+{
+  uint64_t before;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    before = clock_answers_;
+  }
+
+  link_.request_clock();
+  stats_.clock_requests++;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!clock_answered_.wait_for(lock, std::chrono::seconds(2), [&] { return clock_answers_ > before; }))
+  {
+    return false;
+  }
+  clock = link_.clock();
+  return clock.valid;
+}
+
+bool MoviePlayer::play(const std::atomic<bool>& running)
+{
+  stats_ = MoviePlayerStats();
+
+  ReportClock clock;
+  if (!fresh_clock(clock))
+  {
+    return false;
+  }
+  stats_.start_report = clock.next_report + lead_;
+  const uint32_t end_report = stats_.start_report + movie_.header().reports;
+
+  MovieReader::Cursor cursor = movie_.records();
+  MovieRecord record;
+  bool have = cursor.next(record);
+  uint32_t queued = 0; // movie offset after the last queued record
+  bool reset = false;  // the input_reset() entry at end_report went out
+  std::vector<ScheduledState> batch;
+
+  while (running)
+  {
+    // Everything the device has room for; the clock request that follows is
+    // answered after these entries, so schedule_free is already up to date
+    batch.clear();
+    while (have && batch.size() < clock.schedule_free)
+    {
+      uint32_t report = stats_.start_report + record.offset;
+      if (static_cast<int32_t>(report - clock.next_report) < 0)
+      {
+        stats_.late++;
+      }
+      batch.push_back({report, record.state});
+      queued = record.offset + record.hold;
+      have = cursor.next(record);
+    }
+    if (!have && !reset && !cursor.error() && batch.size() < clock.schedule_free)
+    {
+      batch.push_back({end_report, ControllerState()}); // input_reset()
+      reset = true;
+    }
+    if (!batch.empty())
+    {
+      link_.schedule(batch.data(), batch.size());
+      stats_.entries += batch.size();
+    }
+    if (cursor.error())
+    {
+      // What is queued still plays; release the input after it
+      schedule_reset(clock, stats_.start_report + queued);
+      return false;
+    }
+    if (reset && static_cast<int32_t>(clock.next_report - end_report) > 0)
+    {
+      return true;
+    }
+
+    std::this_thread::sleep_for(clock_wait(clock));
+
+    if (!fresh_clock(clock))
+    {
+      return false;
+    }
+  }
+
+  // Stopped early: the queued entries still play, the input is released
+  // at the first report that was not queued
+  if (!reset)
+  {
+    schedule_reset(clock, stats_.start_report + queued);
+  }
+  return false;
+}
+
+void MoviePlayer::schedule_reset(ReportClock& clock, uint32_t report)
+{
+  // clock.schedule_free is stale once a batch went out since the last answer
+  for (int tries = 0; tries < 16; tries++)
+  {
+    if (!fresh_clock(clock))
+    {
+      return;
+    }
+    if (clock.schedule_free > 0)
+    {
+      const ScheduledState entry = {report, ControllerState()};
+      link_.schedule(&entry, 1);
+      stats_.entries++;
+      return;
+    }
+    std::this_thread::sleep_for(clock_wait(clock));
+  }
+}
+
+}
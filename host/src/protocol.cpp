@@ -0,0 +1,121 @@
+// Host side encoders for the UART stream
+
+#include "nxpad/protocol.hpp"
+
+namespace nxpad
+{
+
+namespace
+{
+
+// Stick byte of a legacy frame: Left 0x01, Right 0x02, Up 0x04, Down 0x08
+uint8_t legacy_stick(const Stick& stick)
+{
+  uint8_t value = 0;
+
+  if (stick.x < 64)
+  {
+    value |= 0x01;
+  }
+  else if (stick.x > 192)
+  {
+    value |= 0x02;
+  }
+
+  if (stick.y > 192)
+  {
+    value |= 0x04;
+  }
+  else if (stick.y < 64)
+  {
+    value |= 0x08;
+  }
+
+  return value;
+}
+
+uint8_t legacy_dpad(const ControllerState& state)
+{
+  bool up = state.pressed(Button::Up);
+  bool down = state.pressed(Button::Down);
+  bool left = state.pressed(Button::Left);
+  bool right = state.pressed(Button::Right);
+
+  if (up && right) return A_DPAD_U_R;
+  if (up && left) return A_DPAD_U_L;
+  if (down && right) return A_DPAD_D_R;
+  if (down && left) return A_DPAD_D_L;
+  if (up) return A_DPAD_U;
+  if (down) return A_DPAD_D;
+  if (left) return A_DPAD_L;
+  if (right) return A_DPAD_R;
+  return A_DPAD_CENTER;
+}
+
+void put_input(uint8_t* p, const ControllerState& state)
+{
+  controller_input_t input = state.to_input();
+  p[0] = input.but1;
+  p[1] = input.but2;
+  p[2] = input.but3;
+  p[3] = input.lx;
+  p[4] = input.ly;
+  p[5] = input.rx;
+  p[6] = input.ry;
+}
+
+}
+
+void append_legacy_frame(std::vector<uint8_t>& out, const ControllerState& state)
+{
+  // Byte 5: Y, B, A, X, L, R, ZL, ZR
+  uint8_t button0 = (state.pressed(Button::Y) << 0) | (state.pressed(Button::B) << 1) |
+                    (state.pressed(Button::A) << 2) | (state.pressed(Button::X) << 3) |
+                    (state.pressed(Button::L) << 4) | (state.pressed(Button::R) << 5) |
+                    (state.pressed(Button::ZL) << 6) | (state.pressed(Button::ZR) << 7);
+  // Byte 6: Minus, Plus, L Clk, R Clk, Home, Capture
+  uint8_t button1 = (state.pressed(Button::Minus) << 0) | (state.pressed(Button::Plus) << 1) |
+                    (state.pressed(Button::LStick) << 2) | (state.pressed(Button::RStick) << 3) |
+                    (state.pressed(Button::Home) << 4) | (state.pressed(Button::Capture) << 5);
+
+  const uint8_t frame[INPUT_FRAME_SIZE] = {
+    UART_PROTO_FRAME_SYNC, UART_PROTO_FRAME_SYNC, UART_PROTO_FRAME_SYNC, UART_PROTO_FRAME_SYNC,
+    UART_PROTO_FRAME_SYNC, button0, button1, legacy_dpad(state),
+    legacy_stick(state.left), legacy_stick(state.right), 0x00,
+  };
+  out.insert(out.end(), frame, frame + INPUT_FRAME_SIZE);
+}
+
+void append_packet(std::vector<uint8_t>& out, uint8_t type, const uint8_t* payload, size_t length)
+{
+  uint8_t packet[UART_PROTO_MAX_PACKET];
+  size_t size = uart_proto_encode(type, payload, static_cast<uint8_t>(length), packet);
+  out.insert(out.end(), packet, packet + size);
+}
+
+void append_state_packet(std::vector<uint8_t>& out, const ControllerState& state)
+{
+  uint8_t payload[7];
+  put_input(payload, state);
+  append_packet(out, UART_PKT_INPUT_STATE, payload, sizeof(payload));
+}
+
+void append_schedule_packets(std::vector<uint8_t>& out, const ScheduledState* entries, size_t count)
+{
+  const size_t per_packet = UART_PROTO_MAX_PAYLOAD / SCHEDULE_ENTRY_SIZE;
+  uint8_t payload[UART_PROTO_MAX_PAYLOAD];
+
+  for (size_t first = 0; first < count; first += per_packet)
+  {
+    size_t n = (count - first < per_packet) ? count - first : per_packet;
+    for (size_t i = 0; i < n; i++)
+    {
+      uint8_t* p = &payload[i * SCHEDULE_ENTRY_SIZE];
+      le_put_u32(p, entries[first + i].report);
+      put_input(&p[4], entries[first + i].state);
+    }
+    append_packet(out, UART_PKT_SCHEDULE, payload, n * SCHEDULE_ENTRY_SIZE);
+  }
+}
+
+}
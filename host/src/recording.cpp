@@ -0,0 +1,76 @@
+// Reassembles a recorder dump
+
+#include "nxpad/recording.hpp"
+
+#include <cstring>
+
+namespace nxpad
+{
+
+namespace
+{
+
+void collect(void* ctx, uint32_t report, const uint8_t* data)
+{
+  auto* reports = static_cast<std::vector<RecordedReport>*>(ctx);
+  RecordedReport r;
+  r.report = report;
+  std::memcpy(r.data.data(), data, RECORDER_REPORT_SIZE);
+  reports->push_back(r);
+}
+
+}
+
+bool RecordingReceiver::feed(uint8_t type, const uint8_t* payload, size_t length)
+{
+  switch (type)
+  {
+  case UART_PKT_RECORD_INFO:
+    if (length < 16)
+    {
+      break;
+    }
+    *this = RecordingReceiver();
+    started_ = true;
+    expected_ = le_get_u32(&payload[4]);
+    overwritten_ = le_get_u32(&payload[8]);
+    period_us_ = le_get_u32(&payload[12]);
+    reports_.reserve(expected_);
+    recorder_decode_begin(&cursor_);
+    break;
+  case UART_PKT_RECORD_DATA:
+    if (!started_ || complete_ || length < 2)
+    {
+      break;
+    }
+    if (le_get_u16(payload) != next_seq_)
+    {
+      errors_++;
+    }
+    next_seq_ = static_cast<uint16_t>(le_get_u16(payload) + 1);
+    bytes_ += length - 2;
+    if (!recorder_decode(&cursor_, &payload[2], length - 2, collect, &reports_))
+    {
+      errors_++;
+    }
+    break;
+  case UART_PKT_RECORD_END:
+    if (!started_ || length < 6)
+    {
+      break;
+    }
+    complete_ = true;
+    if (le_get_u16(payload) != next_seq_ || le_get_u32(&payload[2]) != bytes_ ||
+        reports_.size() != expected_)
+    {
+      errors_++;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return complete_;
+}
+
+}
@@ -0,0 +1,137 @@
+// POSIX serial port
+
+#include "nxpad/serial_port.hpp"
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace nxpad
+{
+
+#ifdef __linux__
+namespace detail
+{
+// serial_port_linux.cpp
+bool set_custom_baud(int fd, int baud);
+}
+#endif
+
+namespace
+{
+
+#ifdef __linux__
+constexpr bool kCustomBaud = true;
+#else
+constexpr bool kCustomBaud = false;
+#endif
+
+// B0 for rates the termios table does not have
+speed_t to_speed(int baud)
+{
+  switch (baud)
+  {
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 115200: return B115200;
+  case 230400: return B230400;
+#ifdef B460800
+  case 460800: return B460800;
+#endif
+#ifdef B921600
+  case 921600: return B921600;
+#endif
+  default:
+    return B0;
+  }
+}
+
+}
+
+SerialPort::SerialPort(const std::string& path, int baud)
+{
+  // Checked before anything is opened
+  speed_t speed = to_speed(baud);
+  if (baud <= 0 || (speed == B0 && !kCustomBaud))
+  {
+    throw std::system_error(EINVAL, std::generic_category(), "unsupported baud rate " + std::to_string(baud));
+  }
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd_ < 0)
+  {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+
+  termios tio;
+  if (tcgetattr(fd_, &tio) != 0)
+  {
+    int err = errno;
+    close();
+    throw std::system_error(err, std::generic_category(), "tcgetattr " + path);
+  }
+
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  if (speed != B0)
+  {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+
+  if (tcsetattr(fd_, TCSANOW, &tio) != 0)
+  {
+    int err = errno;
+    close();
+    throw std::system_error(err, std::generic_category(), "tcsetattr " + path);
+  }
+#ifdef __linux__
+  if (speed == B0 && !detail::set_custom_baud(fd_, baud))
+  {
+    int err = errno;
+    close();
+    throw std::system_error(err, std::generic_category(), "baud " + std::to_string(baud) + " " + path);
+  }
+#endif
+}
+
+SerialPort::~SerialPort()
+{
+  close();
+}
+
+SerialPort::SerialPort(SerialPort&& other) noexcept : fd_(other.fd_)
+{
+  other.fd_ = -1;
+}
+
+SerialPort& SerialPort::operator=(SerialPort&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    fd_ = other.fd_;
+    other.fd_ = -1;
+  }
+  return *this;
+}
+
+void SerialPort::close()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+}
@@ -0,0 +1,33 @@
+// Baud rates outside the termios speed table (Linux termios2)
+//
+// Kept apart from serial_port.cpp: <asm/termbits.h> and <termios.h> both
+// define struct termios.
+
+#ifdef __linux__
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+namespace nxpad
+{
+namespace detail
+{
+
+bool set_custom_baud(int fd, int baud)
+{
+  struct termios2 tio;
+  if (::ioctl(fd, TCGETS2, &tio) != 0)
+  {
+    return false;
+  }
+  tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+  tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  tio.c_ispeed = static_cast<speed_t>(baud);
+  tio.c_ospeed = static_cast<speed_t>(baud);
+  return ::ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,53 @@
+// Minimal checks for the host tests
+//
+// Every test file is one executable: it runs its test functions from main()
+// and returns check_result(). A failed CHECK prints where and carries on.
+
+#pragma once
+
+#include <cstdio>
+
+namespace nxtest
+{
+
+inline int& failures()
+{
+  static int count = 0;
+  return count;
+}
+
+inline int check_result(const char* name)
+{
+  if (failures() == 0)
+  {
+    std::printf("%s: ok\n", name);
+    return 0;
+  }
+  std::printf("%s: %d failed\n", name, failures());
+  return 1;
+}
+
+}
+
+#define CHECK(condition)                                                               \
+  do                                                                                   \
+  {                                                                                    \
+    if (!(condition))                                                                  \
+    {                                                                                  \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      nxtest::failures()++;                                                            \
+    }                                                                                  \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                          \
+  do                                                                                        \
+  {                                                                                         \
+    long long actual_ = static_cast<long long>(actual);                                     \
+    long long expected_ = static_cast<long long>(expected);                                 \
+    if (actual_ != expected_)                                                               \
+    {                                                                                       \
+      std::fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, \
+                   #actual, #expected, actual_, expected_);                                 \
+      nxtest::failures()++;                                                                 \
+    }                                                                                       \
+  } while (0)
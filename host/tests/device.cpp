@@ -0,0 +1,184 @@
+// Report path of the device core: reports, subcommand replies and the pairing checks
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+constexpr uint32_t kIdlePeriodUs = 1000000;
+constexpr int64_t kRetransmitUs = 300 * 1000;
+constexpr int64_t kTimeoutUs = 10 * 1000 * 1000;
+
+struct Sent
+{
+  uint8_t id;
+  std::vector<uint8_t> data;
+};
+
+void no_lock(void*) {}
+void no_packet(void*, uint8_t, const uint8_t*, uint8_t) {}
+
+void capture(void* context, uint8_t id, const uint8_t* data, size_t size)
+{
+  static_cast<std::vector<Sent>*>(context)->push_back({id, std::vector<uint8_t>(data, data + size)});
+}
+
+const device_hooks_t kHooks = {no_lock, no_lock, no_packet, nullptr, nullptr, nullptr, nullptr, capture};
+
+struct Device
+{
+  device_t device = {};
+  recorder_t recorder;
+  recorder_entry_t storage[16];
+  std::vector<Sent> sent;
+
+  Device()
+  {
+    const pairing_config_t pairing_config = {kRetransmitUs, 3, kTimeoutUs};
+    recorder_init(&recorder, storage, 16);
+    recorder_start(&recorder);
+    settings_default(&device.settings);
+    device_init(&device, &kHooks, &sent, &pairing_config, &recorder);
+  }
+
+  // Subcommand id with one argument byte, as the console sends it in an 0x01 output report
+  device_output_t subcommand(uint8_t id, uint8_t arg, int64_t now_us, subcommand_reply_t* reply = nullptr)
+  {
+    std::vector<uint8_t> data(48, 0);
+    data[9] = id;
+    data[10] = arg;
+    subcommand_reply_t ignored;
+    return device_output_report(&device, data.data(), data.size(), now_us, reply ? reply : &ignored);
+  }
+};
+
+// Short reports until the input mode is set; the timer byte counts reports
+void test_dummy()
+{
+  Device d;
+  CHECK_EQ(device_send_report(&d.device, kIdlePeriodUs), kIdlePeriodUs);
+
+  pairing_connected(&d.device.pairing, 1000);
+  CHECK_EQ(device_send_report(&d.device, kIdlePeriodUs), d.device.settings.report_period_us);
+  CHECK_EQ(d.sent.size(), 2u);
+  CHECK_EQ(d.sent[1].id, 0x30);
+  CHECK_EQ(d.sent[1].data.size(), static_cast<size_t>(DEVICE_DUMMY_SIZE));
+  CHECK_EQ(d.sent[1].data[0], 1);
+  CHECK_EQ(d.device.report_count, 2u);
+  CHECK_EQ(recorder_count(&d.recorder), 0u); // only reports with input are recorded
+}
+
+// A scheduled input shows in exactly the report it was scheduled for
+void test_schedule()
+{
+  Device d;
+  pairing_connected(&d.device.pairing, 1000);
+  d.device.pairing.state = PAIRING_INPUT_MODE;
+
+  const uint8_t entry[11] = {5, 0, 0, 0, 0x08, 0x00, 0x00, 0x10, 0x20, 0x30, 0x40};
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  proto.type = UART_PKT_SCHEDULE;
+  proto.length = sizeof(entry);
+  std::memcpy(proto.payload, entry, sizeof(entry));
+  CHECK(device_uart_packet(&d.device, &proto));
+
+  for (int i = 0; i < 7; i++)
+  {
+    device_send_report(&d.device, kIdlePeriodUs);
+  }
+  CHECK_EQ(d.sent.size(), 7u);
+
+  const controller_input_t scheduled = {0x08, 0x00, 0x00, 0x10, 0x20, 0x30, 0x40};
+  uint8_t expected[DEVICE_REPORT_SIZE] = {};
+  profile_encode_report(expected, &scheduled);
+  for (size_t i = 0; i < d.sent.size(); i++)
+  {
+    CHECK_EQ(d.sent[i].data.size(), static_cast<size_t>(DEVICE_REPORT_SIZE));
+    CHECK_EQ(d.sent[i].data[0], i);
+    bool applied = std::equal(&expected[2], &expected[11], &d.sent[i].data[2]);
+    CHECK(applied == (i >= 5));
+  }
+  CHECK_EQ(recorder_count(&d.recorder), 7u);
+}
+
+// The 0x40 subcommand switches the IMU block on and clears it again
+void test_imu()
+{
+  Device d;
+  pairing_connected(&d.device.pairing, 1000);
+  d.device.pairing.state = PAIRING_INPUT_MODE;
+
+  subcommand_reply_t reply;
+  CHECK_EQ(d.subcommand(0x40, 0x01, 2000, &reply), DEVICE_OUTPUT_REPLIED);
+  CHECK(d.device.imu_enabled);
+  CHECK_EQ(d.sent.back().id, 0x21);
+
+  std::memset(&d.device.report30[IMU_REPORT_OFFSET], 0x5A, IMU_SAMPLES_PER_REPORT * IMU_SAMPLE_SIZE);
+  CHECK_EQ(d.subcommand(0x40, 0x00, 3000), DEVICE_OUTPUT_REPLIED);
+  CHECK(!d.device.imu_enabled);
+  const uint8_t* imu = &d.device.report30[IMU_REPORT_OFFSET];
+  CHECK(std::all_of(imu, imu + IMU_SAMPLES_PER_REPORT * IMU_SAMPLE_SIZE, [](uint8_t b) { return b == 0; }));
+
+  // Rumble only: nothing to answer
+  std::vector<uint8_t> rumble(10, 0);
+  CHECK_EQ(device_output_report(&d.device, rumble.data(), rumble.size(), 4000, &reply), DEVICE_OUTPUT_NONE);
+}
+
+// The device info reply moves the handshake on and is sent again while unanswered
+void test_handshake()
+{
+  Device d;
+  const int64_t t = 1000000;
+  pairing_connected(&d.device.pairing, t);
+  device_send_report(&d.device, kIdlePeriodUs);
+  CHECK_EQ(device_pairing_check(&d.device, t), PAIRING_POLL_NONE);
+
+  subcommand_reply_t reply;
+  CHECK_EQ(d.subcommand(0x02, 0x00, t + 1000, &reply), DEVICE_OUTPUT_PAIRING);
+  CHECK_EQ(d.device.pairing.state, PAIRING_INFO);
+  const Sent info = d.sent.back();
+  CHECK_EQ(info.id, 0x21);
+
+  CHECK_EQ(device_pairing_check(&d.device, t + 2000), PAIRING_POLL_NONE);
+  CHECK_EQ(device_pairing_check(&d.device, t + 2000 + kRetransmitUs), PAIRING_POLL_RETRANSMIT);
+  CHECK(d.sent.back().id == 0x21 && d.sent.back().data == info.data);
+
+  CHECK_EQ(device_pairing_check(&d.device, t + 1000 + kTimeoutUs + 1), PAIRING_POLL_TIMEOUT);
+}
+
+// Without a send_report hook the report path still runs, nothing is sent
+void test_no_report_hook()
+{
+  static const device_hooks_t hooks = {no_lock, no_lock, no_packet, nullptr, nullptr, nullptr, nullptr, nullptr};
+  const pairing_config_t pairing_config = {kRetransmitUs, 3, kTimeoutUs};
+  device_t device = {};
+  settings_default(&device.settings);
+  device_init(&device, &hooks, nullptr, &pairing_config, nullptr);
+
+  pairing_connected(&device.pairing, 1000);
+  std::vector<uint8_t> data(48, 0);
+  data[9] = 0x02;
+  subcommand_reply_t reply;
+  CHECK_EQ(device_output_report(&device, data.data(), data.size(), 2000, &reply), DEVICE_OUTPUT_PAIRING);
+  CHECK_EQ(device_send_report(&device, kIdlePeriodUs), device.settings.report_period_us);
+  CHECK_EQ(device_pairing_check(&device, 2000 + kRetransmitUs + 1), PAIRING_POLL_RETRANSMIT);
+  CHECK_EQ(device.report_count, 1u);
+}
+
+}
+
+int main()
+{
+  test_dummy();
+  test_schedule();
+  test_imu();
+  test_handshake();
+  test_no_report_hook();
+  return nxtest::check_result("device");
+}
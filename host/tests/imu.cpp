@@ -0,0 +1,205 @@
+// IMU sample ring: report order, sequence gaps and late packets, overruns and underruns
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+// Sample n has accel x = n and gyro z = -n, so its position is visible in a report
+void put_sample(std::vector<uint8_t>& payload, int16_t n)
+{
+  const int16_t values[6] = {n, 0, IMU_ACCEL_1G, 0, 0, static_cast<int16_t>(-n)};
+  for (int16_t value : values)
+  {
+    payload.push_back(value & 0xFF);
+    payload.push_back((value >> 8) & 0xFF);
+  }
+}
+
+std::vector<uint8_t> samples_packet(uint16_t seq, int16_t first, int count)
+{
+  std::vector<uint8_t> payload = {static_cast<uint8_t>(seq & 0xFF), static_cast<uint8_t>(seq >> 8)};
+  for (int i = 0; i < count; i++)
+  {
+    put_sample(payload, static_cast<int16_t>(first + i));
+  }
+  return payload;
+}
+
+bool push(imu_stream_t& imu, const std::vector<uint8_t>& payload)
+{
+  return imu_push_packet(&imu, payload.data(), static_cast<uint8_t>(payload.size()));
+}
+
+int16_t read_i16(const uint8_t* p)
+{
+  return static_cast<int16_t>(p[0] | (p[1] << 8));
+}
+
+// accel x of the three samples in the next report
+std::vector<int16_t> next_report(imu_stream_t& imu)
+{
+  uint8_t report[48] = {};
+  imu_fill_report(&imu, report);
+  std::vector<int16_t> xs;
+  for (int i = 0; i < IMU_SAMPLES_PER_REPORT; i++)
+  {
+    const uint8_t* sample = &report[IMU_REPORT_OFFSET + i * IMU_SAMPLE_SIZE];
+    xs.push_back(read_i16(sample));
+    if (imu.source == IMU_SOURCE_HOST)
+    {
+      CHECK_EQ(read_i16(&sample[10]), -read_i16(sample));
+    }
+  }
+  return xs;
+}
+
+void test_report_order()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  CHECK(push(imu, samples_packet(0, 1, 4)));
+  CHECK(push(imu, samples_packet(4, 5, 5)));
+  CHECK(next_report(imu) == std::vector<int16_t>({1, 2, 3}));
+  CHECK(next_report(imu) == std::vector<int16_t>({4, 5, 6}));
+  CHECK(next_report(imu) == std::vector<int16_t>({7, 8, 9}));
+  CHECK_EQ(imu.seq_gaps, 0);
+  CHECK_EQ(imu.overruns, 0);
+  CHECK_EQ(imu.underruns, 0);
+}
+
+// An empty ring repeats the last sample instead of dropping to zero
+void test_underrun()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  CHECK(next_report(imu) == std::vector<int16_t>({0, 0, 0}));
+  CHECK_EQ(imu.underruns, 3);
+
+  CHECK(push(imu, samples_packet(0, 10, 2)));
+  CHECK(next_report(imu) == std::vector<int16_t>({10, 11, 11}));
+  CHECK_EQ(imu.underruns, 4);
+}
+
+void test_seq_gaps()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  CHECK(push(imu, samples_packet(0, 0, 3)));
+  CHECK(push(imu, samples_packet(5, 5, 3))); // samples 3 and 4 lost
+  CHECK_EQ(imu.seq_gaps, 2);
+  CHECK(push(imu, samples_packet(8, 8, 3)));
+  CHECK_EQ(imu.seq_gaps, 2);
+
+  // The sequence number wraps at 16 bits
+  imu_init(&imu);
+  imu.next_seq = 0xFFFE;
+  CHECK(push(imu, samples_packet(0xFFFE, 0, 3)));
+  CHECK(push(imu, samples_packet(1, 3, 1)));
+  CHECK_EQ(imu.seq_gaps, 0);
+  CHECK(push(imu, samples_packet(4, 4, 1)));
+  CHECK_EQ(imu.seq_gaps, 2);
+  CHECK_EQ(imu.seq_late, 0);
+}
+
+// A repeated or late packet is dropped and counted apart from the gaps
+void test_seq_late()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  CHECK(push(imu, samples_packet(0, 0, 3)));
+  CHECK(push(imu, samples_packet(0, 0, 3))); // repeated
+  CHECK(push(imu, samples_packet(6, 6, 3))); // 3-5 lost
+  CHECK(push(imu, samples_packet(3, 3, 3))); // 3-5 arrive late
+  CHECK_EQ(imu.seq_gaps, 3);
+  CHECK_EQ(imu.seq_late, 2);
+  CHECK(next_report(imu) == std::vector<int16_t>({0, 1, 2}));
+  CHECK(next_report(imu) == std::vector<int16_t>({6, 7, 8}));
+
+  // Late across the 16 bit wrap
+  imu_init(&imu);
+  imu.next_seq = 0xFFFE;
+  CHECK(push(imu, samples_packet(0xFFFE, 0, 3)));
+  CHECK(push(imu, samples_packet(0xFFFF, 1, 1)));
+  CHECK_EQ(imu.seq_late, 1);
+  CHECK_EQ(imu.seq_gaps, 0);
+
+  // A host that restarts its count is followed without counting anything
+  imu_init(&imu);
+  CHECK(push(imu, samples_packet(30000, 0, 3)));
+  CHECK(push(imu, samples_packet(0, 3, 3)));
+  CHECK_EQ(imu.seq_gaps, 0);
+  CHECK_EQ(imu.seq_late, 0);
+  CHECK_EQ(imu.next_seq, 3);
+}
+
+// A full ring keeps the oldest samples and counts the rest
+void test_overrun()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  for (int i = 0; i < IMU_RING_SIZE + 2; i += 3)
+  {
+    CHECK(push(imu, samples_packet(static_cast<uint16_t>(i), static_cast<int16_t>(i), 3)));
+  }
+  CHECK_EQ(imu.overruns, 2);
+  CHECK_EQ(imu.seq_gaps, 0);
+
+  for (int i = 0; i < IMU_RING_SIZE; i += 3)
+  {
+    std::vector<int16_t> xs = next_report(imu);
+    CHECK_EQ(xs[0], i);
+  }
+  CHECK_EQ(imu.underruns, 2); // 64 samples fill 21 reports and one slot of the 22nd
+}
+
+void test_malformed()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+
+  std::vector<uint8_t> payload = samples_packet(0, 0, 2);
+  payload.pop_back();
+  CHECK(!push(imu, payload));
+  CHECK(!push(imu, {0x00}));
+  CHECK(push(imu, {0x00, 0x00})); // no samples
+  CHECK_EQ(imu.head, 0);
+}
+
+// Switching source clears what the host had queued
+void test_generated_sources()
+{
+  imu_stream_t imu;
+  imu_init(&imu);
+  CHECK(push(imu, samples_packet(0, 50, 3)));
+
+  imu_set_source(&imu, IMU_SOURCE_TILT_L);
+  CHECK(next_report(imu) == std::vector<int16_t>(3, -IMU_ACCEL_1G * 7 / 10));
+  imu_set_source(&imu, IMU_SOURCE_TILT_R);
+  CHECK(next_report(imu) == std::vector<int16_t>(3, IMU_ACCEL_1G * 7 / 10));
+
+  imu_set_source(&imu, IMU_SOURCE_HOST);
+  CHECK_EQ(imu.head, imu.tail);
+}
+
+}
+
+int main()
+{
+  test_report_order();
+  test_underrun();
+  test_seq_gaps();
+  test_seq_late();
+  test_overrun();
+  test_malformed();
+  test_generated_sources();
+  return nxtest::check_result("imu");
+}
@@ -0,0 +1,99 @@
+// Latency self-test summary: lost samples, nearest-rank percentiles, average
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+latency_summary_t summarize(std::vector<uint32_t>& samples)
+{
+  latency_summary_t summary;
+  latency_summarize(samples.data(), samples.size(), &summary);
+  return summary;
+}
+
+void test_empty()
+{
+  std::vector<uint32_t> none;
+  latency_summary_t summary = summarize(none);
+  CHECK_EQ(summary.count, 0u);
+  CHECK_EQ(summary.lost, 0u);
+
+  std::vector<uint32_t> lost = {LATENCY_LOST, LATENCY_LOST};
+  summary = summarize(lost);
+  CHECK_EQ(summary.count, 0u);
+  CHECK_EQ(summary.lost, 2u);
+  CHECK_EQ(summary.min_us, 0u);
+  CHECK_EQ(summary.max_us, 0u);
+  CHECK_EQ(summary.avg_us, 0u);
+}
+
+void test_single()
+{
+  std::vector<uint32_t> samples = {42};
+  latency_summary_t summary = summarize(samples);
+  CHECK_EQ(summary.count, 1u);
+  CHECK_EQ(summary.min_us, 42u);
+  CHECK_EQ(summary.p50_us, 42u);
+  CHECK_EQ(summary.p99_us, 42u);
+  CHECK_EQ(summary.max_us, 42u);
+  CHECK_EQ(summary.avg_us, 42u);
+}
+
+// 1..200 shuffled, with lost samples in between that stay out of the statistics
+void test_percentiles()
+{
+  std::vector<uint32_t> samples;
+  for (uint32_t i = 0; i < 200; i++)
+  {
+    samples.push_back((i * 73) % 200 + 1);
+    if (i % 50 == 0)
+    {
+      samples.push_back(LATENCY_LOST);
+    }
+  }
+
+  latency_summary_t summary = summarize(samples);
+  CHECK_EQ(summary.count, 200u);
+  CHECK_EQ(summary.lost, 4u);
+  CHECK_EQ(summary.min_us, 1u);
+  CHECK_EQ(summary.p50_us, 100u);
+  CHECK_EQ(summary.p99_us, 198u);
+  CHECK_EQ(summary.max_us, 200u);
+  CHECK_EQ(summary.avg_us, 100u); // 100.5 truncated
+
+  // Sorted in place, lost samples last
+  bool sorted = true;
+  for (size_t i = 1; i < samples.size(); i++)
+  {
+    sorted = sorted && samples[i - 1] <= samples[i];
+  }
+  CHECK(sorted);
+  CHECK_EQ(samples.back(), LATENCY_LOST);
+}
+
+// One long stall among short wake-ups shows in max, not in p50
+void test_outlier()
+{
+  std::vector<uint32_t> samples(99, 20);
+  samples.push_back(30000);
+  latency_summary_t summary = summarize(samples);
+  CHECK_EQ(summary.p50_us, 20u);
+  CHECK_EQ(summary.p99_us, 20u);
+  CHECK_EQ(summary.max_us, 30000u);
+  CHECK_EQ(summary.avg_us, (99u * 20 + 30000) / 100);
+}
+
+}
+
+int main()
+{
+  test_empty();
+  test_single();
+  test_percentiles();
+  test_outlier();
+  return nxtest::check_result("latency");
+}
@@ -0,0 +1,169 @@
+// Link profiles and the report completion window sent as UART_PKT_LINK
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+struct Closed
+{
+  uint8_t profile;
+  uint16_t poll_slots;
+  uint16_t completed;
+  uint16_t errors;
+  uint32_t min_us;
+  uint32_t average_us;
+  uint32_t max_us;
+  uint16_t sniff_entries;
+  bool sniff;
+};
+
+Closed close(link_window_t& window, uint8_t profile = LINK_PROFILE_BALANCED, uint16_t poll_slots = 0)
+{
+  uint8_t out[LINK_WINDOW_ENCODED_SIZE + 1];
+  out[LINK_WINDOW_ENCODED_SIZE] = 0xA5;
+  CHECK_EQ(link_window_close(&window, profile, poll_slots, out), static_cast<size_t>(LINK_WINDOW_ENCODED_SIZE));
+  CHECK_EQ(out[LINK_WINDOW_ENCODED_SIZE], 0xA5);
+  return {out[0],
+          le_get_u16(&out[1]),
+          le_get_u16(&out[3]),
+          le_get_u16(&out[5]),
+          le_get_u32(&out[7]),
+          le_get_u32(&out[11]),
+          le_get_u32(&out[15]),
+          le_get_u16(&out[19]),
+          out[21] != 0};
+}
+
+void test_profiles()
+{
+  CHECK(link_profile_get(LINK_PROFILE_COUNT) == nullptr);
+  const link_profile_t* low = link_profile_get(LINK_PROFILE_LOW_LATENCY);
+  const link_profile_t* balanced = link_profile_get(LINK_PROFILE_BALANCED);
+  const link_profile_t* power = link_profile_get(LINK_PROFILE_LOW_POWER);
+  CHECK(low != nullptr && balanced != nullptr && power != nullptr);
+
+  // Lower latency asks for more: a fixed poll interval, tighter QoS, more TX power
+  CHECK_EQ(low->poll_slots, 8);
+  CHECK_EQ(low->service_type, LINK_QOS_GUARANTEED);
+  CHECK(low->access_latency_us < balanced->access_latency_us);
+  CHECK(balanced->access_latency_us < power->access_latency_us);
+  CHECK(low->tx_power_min > power->tx_power_max);
+  for (uint8_t id = 0; id < LINK_PROFILE_COUNT; id++)
+  {
+    const link_profile_t* profile = link_profile_get(id);
+    CHECK(profile->tx_power_min <= profile->tx_power_max);
+    CHECK(profile->tx_power_max <= 7);
+  }
+}
+
+void test_empty_window()
+{
+  link_window_t window;
+  link_window_reset(&window);
+  Closed closed = close(window, LINK_PROFILE_LOW_LATENCY, 8);
+  CHECK_EQ(closed.profile, LINK_PROFILE_LOW_LATENCY);
+  CHECK_EQ(closed.poll_slots, 8);
+  CHECK_EQ(closed.completed, 0);
+  CHECK_EQ(closed.min_us, 0u);
+  CHECK_EQ(closed.average_us, 0u);
+  CHECK_EQ(closed.max_us, 0u);
+}
+
+// Completions at 15 ms with one late and one early poll
+void test_intervals()
+{
+  link_window_t window;
+  link_window_reset(&window);
+  const std::vector<int64_t> at = {100000, 115000, 130000, 152000, 160000, 175000};
+  for (int64_t t : at)
+  {
+    link_window_done(&window, true, t);
+  }
+  link_window_done(&window, false, 180000);
+
+  Closed closed = close(window);
+  CHECK_EQ(closed.completed, 6);
+  CHECK_EQ(closed.errors, 1);
+  CHECK_EQ(closed.min_us, 8000u);
+  CHECK_EQ(closed.max_us, 22000u);
+  CHECK_EQ(closed.average_us, 15000u); // 75 ms over 5 intervals
+
+  // The next window measures from the last completion of this one
+  link_window_done(&window, true, 190000);
+  closed = close(window);
+  CHECK_EQ(closed.completed, 1);
+  CHECK_EQ(closed.errors, 0);
+  CHECK_EQ(closed.min_us, 15000u);
+  CHECK_EQ(closed.max_us, 15000u);
+}
+
+// A reconnect does not count the outage as an interval
+void test_restart()
+{
+  link_window_t window;
+  link_window_reset(&window);
+  link_window_done(&window, true, 1000000);
+  link_window_done(&window, true, 1015000);
+  link_window_restart(&window);
+  link_window_done(&window, true, 9000000);
+  link_window_done(&window, true, 9010000);
+
+  Closed closed = close(window);
+  CHECK_EQ(closed.completed, 4);
+  CHECK_EQ(closed.min_us, 10000u);
+  CHECK_EQ(closed.max_us, 15000u);
+  CHECK_EQ(closed.average_us, 12500u);
+}
+
+// Sniff entries are counted per window, the current mode carries over
+void test_sniff()
+{
+  link_window_t window;
+  link_window_reset(&window);
+  link_window_mode(&window, true);
+  link_window_mode(&window, true); // no change
+  link_window_mode(&window, false);
+  link_window_mode(&window, true);
+
+  Closed closed = close(window);
+  CHECK_EQ(closed.sniff_entries, 2);
+  CHECK(closed.sniff);
+
+  closed = close(window);
+  CHECK_EQ(closed.sniff_entries, 0);
+  CHECK(closed.sniff);
+
+  link_window_restart(&window);
+  CHECK(!close(window).sniff);
+}
+
+// More completions than the u16 field holds saturate instead of wrapping
+void test_saturation()
+{
+  link_window_t window;
+  link_window_reset(&window);
+  for (int i = 0; i < 70000; i++)
+  {
+    link_window_done(&window, true, 1000 + i * 1000LL);
+  }
+  Closed closed = close(window);
+  CHECK_EQ(closed.completed, 0xFFFF);
+  CHECK_EQ(closed.average_us, 1000u);
+}
+
+}
+
+int main()
+{
+  test_profiles();
+  test_empty_window();
+  test_intervals();
+  test_restart();
+  test_sniff();
+  test_saturation();
+  return nxtest::check_result("link_profile");
+}
@@ -0,0 +1,188 @@
+// Turbo and combo engine: the reports macro_apply() produces
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+const uint8_t kA = 0x08; // but1
+const uint8_t kB = 0x04; // but1
+const uint8_t kZL = 0x80; // but3
+
+controller_input_t neutral()
+{
+  controller_input_t input;
+  input_reset(&input);
+  return input;
+}
+
+controller_input_t with_but1(uint8_t but1)
+{
+  controller_input_t input = neutral();
+  input.but1 = but1;
+  return input;
+}
+
+// but1 of the next count reports for a constant live input
+std::vector<uint8_t> run_but1(macro_engine_t& engine, const controller_input_t& live, int count)
+{
+  std::vector<uint8_t> out;
+  for (int i = 0; i < count; i++)
+  {
+    controller_input_t report;
+    macro_apply(&engine, &live, &report);
+    out.push_back(report.but1);
+  }
+  return out;
+}
+
+void test_passthrough()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+  controller_input_t live = with_but1(kA | kB);
+  live.lx = 10;
+  live.ry = 250;
+
+  controller_input_t report;
+  macro_apply(&engine, &live, &report);
+  CHECK_EQ(report.but1, kA | kB);
+  CHECK_EQ(report.lx, 10);
+  CHECK_EQ(report.ry, 250);
+}
+
+void test_turbo()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+  const uint8_t turbo[6] = {0, kA, 0x00, 0x00, 2, 1}; // group 0: A, 2 on, 1 off
+  CHECK(macro_set_turbo(&engine.config, turbo, sizeof(turbo)));
+
+  // Held: on, on, off, repeating; B is not in the group and stays pressed
+  std::vector<uint8_t> expected = {kA | kB, kA | kB, kB, kA | kB, kA | kB, kB, kA | kB};
+  CHECK(run_but1(engine, with_but1(kA | kB), 7) == expected);
+
+  // Released mid-cycle, the next press starts with an "on" report again
+  CHECK(run_but1(engine, neutral(), 1) == std::vector<uint8_t>({0}));
+  CHECK(run_but1(engine, with_but1(kA), 3) == std::vector<uint8_t>({kA, kA, 0}));
+
+  // Turned off: plain pass-through
+  const uint8_t off[6] = {0, kA, 0x00, 0x00, 0, 0};
+  CHECK(macro_set_turbo(&engine.config, off, sizeof(off)));
+  CHECK(run_but1(engine, with_but1(kA), 4) == std::vector<uint8_t>(4, kA));
+}
+
+void test_turbo_other_byte()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+  const uint8_t turbo[6] = {3, 0x00, 0x00, kZL, 1, 1};
+  CHECK(macro_set_turbo(&engine.config, turbo, sizeof(turbo)));
+
+  controller_input_t live = neutral();
+  live.but3 = kZL;
+  std::vector<uint8_t> but3;
+  for (int i = 0; i < 4; i++)
+  {
+    controller_input_t report;
+    macro_apply(&engine, &live, &report);
+    but3.push_back(report.but3);
+  }
+  CHECK(but3 == std::vector<uint8_t>({kZL, 0, kZL, 0}));
+}
+
+void test_turbo_rejects()
+{
+  macro_config_t config;
+  macro_config_default(&config);
+  const uint8_t bad_group[6] = {MACRO_TURBO_GROUPS, kA, 0, 0, 1, 1};
+  const uint8_t short_payload[5] = {0, kA, 0, 0, 1};
+  CHECK(!macro_set_turbo(&config, bad_group, sizeof(bad_group)));
+  CHECK(!macro_set_turbo(&config, short_payload, sizeof(short_payload)));
+}
+
+// UART_PKT_COMBO_SET payload: slot, name[12], step_count, steps[] of 8 bytes
+std::vector<uint8_t> combo_payload(uint8_t slot, const std::vector<std::pair<uint8_t, uint8_t>>& steps)
+{
+  std::vector<uint8_t> payload = {slot};
+  const char name[MACRO_NAME_LEN] = "test";
+  payload.insert(payload.end(), name, name + MACRO_NAME_LEN);
+  payload.push_back(static_cast<uint8_t>(steps.size()));
+  for (const auto& step : steps)
+  {
+    const uint8_t bytes[8] = {step.first, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, step.second};
+    payload.insert(payload.end(), bytes, bytes + 8);
+  }
+  return payload;
+}
+
+void test_combo()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+  // A for 2 reports, an empty step that is skipped, B for 1 report
+  auto payload = combo_payload(2, {{kA, 2}, {0xFF, 0}, {kB, 1}});
+  CHECK(macro_set_combo(&engine.config, payload.data(), static_cast<uint8_t>(payload.size())));
+
+  const controller_input_t live = with_but1(0x01);
+  CHECK(run_but1(engine, live, 2) == std::vector<uint8_t>({0x01, 0x01}));
+
+  // Starts on the next report and owns every report until it ends
+  macro_trigger(&engine, 2);
+  CHECK(run_but1(engine, live, 5) == std::vector<uint8_t>({kA, kA, kB, 0x01, 0x01}));
+  CHECK_EQ(engine.combo, MACRO_NO_COMBO);
+
+  // Stopped halfway
+  macro_trigger(&engine, 2);
+  CHECK(run_but1(engine, live, 1) == std::vector<uint8_t>({kA}));
+  macro_trigger(&engine, MACRO_STOP);
+  CHECK(run_but1(engine, live, 2) == std::vector<uint8_t>({0x01, 0x01}));
+
+  // Retriggered while running restarts from the first step
+  macro_trigger(&engine, 2);
+  CHECK(run_but1(engine, live, 2) == std::vector<uint8_t>({kA, kA}));
+  macro_trigger(&engine, 2);
+  CHECK(run_but1(engine, live, 4) == std::vector<uint8_t>({kA, kA, kB, 0x01}));
+}
+
+void test_combo_rejects()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+
+  // Unknown slots are ignored
+  macro_trigger(&engine, MACRO_COMBO_SLOTS);
+  CHECK(run_but1(engine, with_but1(kB), 1) == std::vector<uint8_t>({kB}));
+
+  auto payload = combo_payload(0, {{kA, 1}});
+  payload.pop_back();
+  CHECK(!macro_set_combo(&engine.config, payload.data(), static_cast<uint8_t>(payload.size())));
+  payload = combo_payload(MACRO_COMBO_SLOTS, {{kA, 1}});
+  CHECK(!macro_set_combo(&engine.config, payload.data(), static_cast<uint8_t>(payload.size())));
+}
+
+// A combo with no steps (never configured) ends at once
+void test_empty_combo()
+{
+  macro_engine_t engine;
+  macro_init(&engine);
+  macro_trigger(&engine, 5);
+  CHECK(run_but1(engine, with_but1(kB), 2) == std::vector<uint8_t>({kB, kB}));
+}
+
+}
+
+int main()
+{
+  test_passthrough();
+  test_turbo();
+  test_turbo_other_byte();
+  test_turbo_rejects();
+  test_combo();
+  test_combo_rejects();
+  test_empty_combo();
+  return nxtest::check_result("macro");
+}
@@ -0,0 +1,342 @@
+// Movie files written and read back, and MoviePlayer against device.c on a socketpair
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+#include "nxpad/link.hpp"
+#include "nxpad/movie.hpp"
+
+namespace
+{
+
+constexpr uint32_t kPeriodUs = 2000;
+
+struct TempFile
+{
+  std::string path;
+
+  TempFile()
+  {
+    char name[] = "/tmp/nxpad-movie-XXXXXX";
+    int fd = ::mkstemp(name);
+    CHECK(fd >= 0);
+    ::close(fd);
+    path = name;
+  }
+  ~TempFile() { ::unlink(path.c_str()); }
+
+  void write(const std::vector<uint8_t>& bytes) const
+  {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+  }
+
+  std::vector<uint8_t> read() const
+  {
+    std::vector<uint8_t> bytes;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    int c;
+    while ((c = std::fgetc(file)) != EOF)
+    {
+      bytes.push_back(static_cast<uint8_t>(c));
+    }
+    std::fclose(file);
+    return bytes;
+  }
+};
+
+// State i of a test movie: a different left stick x every report, A held on odd ones
+nxpad::ControllerState movie_state(uint32_t i)
+{
+  nxpad::ControllerState state;
+  state.left.x = static_cast<uint8_t>(i * 7);
+  state.set(nxpad::Button::A, i & 1);
+  return state;
+}
+
+void test_round_trip()
+{
+  TempFile file;
+  nxpad::ControllerState a;
+  a.press(nxpad::Button::B).left = {0, 255};
+  nxpad::ControllerState b = a;
+  b.release(nxpad::Button::B).press(nxpad::Button::ZL);
+
+  nxpad::MovieWriter writer(file.path, JOYCON_L, 15000);
+  writer.append(nxpad::ControllerState(), 3); // input_reset(): only a hold
+  writer.append(a, 1);
+  writer.append(a, 299); // merged, hold needs two varint bytes
+  writer.append(b, 0);   // ignored
+  writer.append(b, 2);
+  CHECK(writer.finish());
+
+  nxpad::MovieReader reader(file.path);
+  CHECK_EQ(reader.header().version, nxpad::kMovieVersion);
+  CHECK_EQ(reader.header().controller, JOYCON_L);
+  CHECK_EQ(reader.header().period_us, 15000u);
+  CHECK_EQ(reader.header().reports, 305u);
+
+  nxpad::MovieReader::Cursor cursor = reader.records();
+  nxpad::MovieRecord record;
+  CHECK(cursor.next(record));
+  CHECK(record.offset == 0 && record.hold == 3 && record.state == nxpad::ControllerState());
+  CHECK(cursor.next(record));
+  CHECK(record.offset == 3 && record.hold == 300 && record.state == a);
+  CHECK(cursor.next(record));
+  CHECK(record.offset == 303 && record.hold == 2 && record.state == b);
+  CHECK(!cursor.next(record));
+  CHECK(!cursor.error());
+
+  // Records only carry the bytes that changed
+  CHECK_EQ(file.read().size(), nxpad::kMovieHeaderSize + 2 + (1 + 3 + 2) + (1 + 2 + 1));
+}
+
+void test_damaged()
+{
+  TempFile file;
+  {
+    nxpad::MovieWriter writer(file.path, PRO_CON, 0);
+    writer.append(movie_state(1), 1);
+    writer.append(movie_state(2), 200);
+  }
+  std::vector<uint8_t> bytes = file.read();
+
+  // A record cut inside its hold varint
+  file.write(std::vector<uint8_t>(bytes.begin(), bytes.end() - 1));
+  nxpad::MovieReader truncated(file.path);
+  nxpad::MovieReader::Cursor cursor = truncated.records();
+  nxpad::MovieRecord record;
+  CHECK(cursor.next(record));
+  CHECK(!cursor.next(record));
+  CHECK(cursor.error());
+
+  // Not a movie header
+  bytes[0] = 'X';
+  file.write(bytes);
+  bool threw = false;
+  try
+  {
+    nxpad::MovieReader reader(file.path);
+  }
+  catch (const std::runtime_error&)
+  {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+/// A device on the other end of a socketpair: device.c answers the UART side,
+/// a thread applies the schedule every kPeriodUs and keeps the input of each report
+
+struct Device
+{
+  std::mutex mutex;
+  int fd;
+  device_t device = {};
+  std::vector<controller_input_t> applied; // input_state at each report
+  std::atomic<bool> running{true};
+  std::thread reader;
+  std::thread reporter;
+
+  explicit Device(int fd_) : fd(fd_)
+  {
+    static const device_hooks_t hooks = {lock, unlock, send_packet, nullptr, nullptr, nullptr, nullptr, nullptr};
+    static const pairing_config_t pairing_config = {1, 1, 1};
+    settings_default(&device.settings);
+    device_init(&device, &hooks, this, &pairing_config, nullptr);
+    reader = std::thread(&Device::read_loop, this);
+    reporter = std::thread(&Device::report_loop, this);
+  }
+
+  ~Device()
+  {
+    running = false;
+    reader.join();
+    reporter.join();
+  }
+
+  static void lock(void* context) { static_cast<Device*>(context)->mutex.lock(); }
+  static void unlock(void* context) { static_cast<Device*>(context)->mutex.unlock(); }
+
+  static void send_packet(void* context, uint8_t type, const uint8_t* payload, uint8_t length)
+  {
+    uint8_t packet[UART_PROTO_MAX_PACKET];
+    size_t size = uart_proto_encode(type, payload, length, packet);
+    CHECK(::write(static_cast<Device*>(context)->fd, packet, size) == static_cast<ssize_t>(size));
+  }
+
+  void read_loop()
+  {
+    uart_proto_t proto;
+    uart_proto_init(&proto);
+    uart_proto_idle(&proto); // nothing was sent before the test
+    uint8_t buffer[256];
+    while (running)
+    {
+      pollfd pfd = {fd, POLLIN, 0};
+      if (::poll(&pfd, 1, 20) <= 0)
+      {
+        uart_proto_idle(&proto);
+        continue;
+      }
+      ssize_t n = ::read(fd, buffer, sizeof(buffer));
+      for (ssize_t i = 0; i < n; i++)
+      {
+        uart_proto_event_t event = uart_proto_feed(&proto, buffer[i]);
+        if (event == UART_PROTO_COMMAND)
+        {
+          device_uart_command(&device, proto.command);
+        }
+        else if (event == UART_PROTO_PACKET)
+        {
+          CHECK(device_uart_packet(&device, &proto));
+        }
+      }
+    }
+  }
+
+  void report_loop()
+  {
+    auto next = std::chrono::steady_clock::now();
+    while (running)
+    {
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        schedule_apply(&device.schedule, device.report_count, &device.input_state);
+        applied.push_back(device.input_state);
+        device.report_count++;
+        device.report_period_us = kPeriodUs;
+      }
+      next += std::chrono::microseconds(kPeriodUs);
+      std::this_thread::sleep_until(next);
+    }
+  }
+
+  uint32_t report_count()
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    return device.report_count;
+  }
+
+  // Input the device sent with report n, waiting for it if needed
+  nxpad::ControllerState state_at(uint32_t n)
+  {
+    while (report_count() <= n)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    return nxpad::ControllerState::from_input(applied[n]);
+  }
+};
+
+void write_movie(const TempFile& file, uint32_t reports)
+{
+  nxpad::MovieWriter writer(file.path, PRO_CON, kPeriodUs);
+  for (uint32_t i = 0; i < reports; i++)
+  {
+    writer.append(movie_state(i), 1);
+  }
+  CHECK(writer.finish());
+}
+
+// Every report gets its state, and the input is neutral again after the end
+void test_play()
+{
+  TempFile file;
+  write_movie(file, 150);
+  nxpad::MovieReader movie(file.path);
+
+  int fds[2];
+  CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  {
+    Device device(fds[1]);
+    nxpad::Link link(fds[0], nxpad::Protocol::Packet);
+    nxpad::MoviePlayer player(link, movie);
+    player.set_lead(30);
+
+    nxpad::ReportClock clock;
+    CHECK(player.fresh_clock(clock));
+    CHECK_EQ(clock.period_us, kPeriodUs);
+    CHECK_EQ(clock.controller, PRO_CON);
+
+    std::atomic<bool> running(true);
+    CHECK(player.play(running));
+    nxpad::MoviePlayerStats stats = player.stats();
+    CHECK_EQ(stats.late, 0u);
+    CHECK_EQ(stats.entries, 151u);
+
+    bool exact = true;
+    for (uint32_t i = 0; i < 150; i++)
+    {
+      exact = exact && device.state_at(stats.start_report + i) == movie_state(i);
+    }
+    CHECK(exact);
+    CHECK(device.state_at(stats.start_report + 150) == nxpad::ControllerState());
+  }
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// Stopped halfway: what was queued plays, then the input is neutral
+void test_stop()
+{
+  TempFile file;
+  write_movie(file, 1000);
+  nxpad::MovieReader movie(file.path);
+
+  int fds[2];
+  CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  {
+    Device device(fds[1]);
+    nxpad::Link link(fds[0], nxpad::Protocol::Packet);
+    nxpad::MoviePlayer player(link, movie);
+    player.set_lead(30);
+
+    std::atomic<bool> running(true);
+    std::thread stopper([&] {
+      std::this_thread::sleep_for(std::chrono::microseconds(kPeriodUs) * 100);
+      running = false;
+    });
+    CHECK(!player.play(running));
+    stopper.join();
+
+    // The reset follows every queued entry, and at most a full schedule is queued
+    nxpad::MoviePlayerStats stats = player.stats();
+    uint32_t queued = stats.entries - 1;
+    CHECK(queued > 0 && queued < 1000);
+    for (uint32_t i = 0; i < queued; i += 10)
+    {
+      CHECK(device.state_at(stats.start_report + i) == movie_state(i));
+    }
+    CHECK(device.state_at(stats.start_report + queued) == nxpad::ControllerState());
+    CHECK_EQ(device.device.schedule.overflows, 0);
+  }
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+}
+
+int main()
+{
+  test_round_trip();
+  test_damaged();
+  test_play();
+  test_stop();
+  return nxtest::check_result("movie");
+}
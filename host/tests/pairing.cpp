@@ -0,0 +1,126 @@
+// Pairing handshake: milestones, reply retransmits and the handshake timeout
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+constexpr int64_t kRetransmitUs = 300 * 1000;
+constexpr uint8_t kRetries = 3;
+constexpr int64_t kTimeoutUs = 10 * 1000 * 1000;
+
+struct Pairing
+{
+  pairing_t pairing;
+
+  Pairing()
+  {
+    const pairing_config_t config = {kRetransmitUs, kRetries, kTimeoutUs};
+    pairing_init(&pairing, &config);
+  }
+
+  // Answers subcommand id (argument bytes at data[10..]) the way device_output_report() does
+  bool reply(uint8_t id, int64_t now_us, uint8_t arg0 = 0, uint8_t arg1 = 0)
+  {
+    std::vector<uint8_t> data(SUBCOMMAND_MIN_LENGTH + 2, 0);
+    data[9] = id;
+    data[10] = arg0;
+    data[11] = arg1;
+    subcommand_reply_t reply;
+    CHECK(subcommand_lookup(data.data(), data.size(), &reply));
+    return pairing_replied(&pairing, id, &reply, now_us);
+  }
+
+  // pairing_poll() once per report from from_us to to_us, counting each outcome
+  int polls(int64_t from_us, int64_t to_us, pairing_poll_t outcome)
+  {
+    int count = 0;
+    for (int64_t t = from_us; t <= to_us; t += 15000)
+    {
+      count += pairing_poll(&pairing, t) == outcome;
+    }
+    return count;
+  }
+};
+
+void test_milestones()
+{
+  Pairing p;
+  CHECK_EQ(p.pairing.state, PAIRING_DISCOVERABLE);
+  CHECK(!p.reply(0x02, 0)); // nothing counts before the channel opens
+
+  CHECK(pairing_connected(&p.pairing, 1000000));
+  CHECK(p.reply(0x02, 1010000));
+  CHECK_EQ(p.pairing.state, PAIRING_INFO);
+  CHECK(p.reply(0x03, 1020000, 0x30)); // before the SPI reads, as the console does it
+  CHECK_EQ(p.pairing.state, PAIRING_INPUT_MODE);
+  CHECK_EQ(p.pairing.reached_ms[PAIRING_INPUT_MODE], 20u);
+  CHECK_EQ(p.pairing.reached_ms[PAIRING_SPI], PAIRING_NOT_REACHED);
+  CHECK(p.reply(0x21, 1030000, 0x21));
+  CHECK_EQ(p.pairing.state, PAIRING_PAIRED);
+
+  CHECK(pairing_disconnected(&p.pairing, 2000000));
+  CHECK_EQ(p.pairing.state, PAIRING_DISCOVERABLE);
+  CHECK_EQ(p.pairing.drops, 1);
+}
+
+// A quiet console gets the last reply again, at most kRetries times
+void test_retransmit()
+{
+  Pairing p;
+  pairing_connected(&p.pairing, 0);
+  p.reply(0x02, 1000);
+  CHECK_EQ(p.polls(1000, 1000 + kRetransmitUs, PAIRING_POLL_RETRANSMIT), 0);
+  CHECK_EQ(p.polls(1000 + kRetransmitUs + 15000, 5000000, PAIRING_POLL_RETRANSMIT), kRetries);
+  CHECK_EQ(p.pairing.retransmits, kRetries);
+
+  // A new request restarts the count
+  p.reply(0x08, 5000000);
+  CHECK_EQ(p.polls(5000000, 9000000, PAIRING_POLL_RETRANSMIT), kRetries);
+}
+
+// The input mode ack and anything after it is never sent again
+void test_no_retransmit_after_input_mode()
+{
+  Pairing p;
+  pairing_connected(&p.pairing, 0);
+  p.reply(0x02, 1000);
+  p.reply(0x03, 2000, 0x30);
+  CHECK_EQ(p.polls(2000, 20000000, PAIRING_POLL_RETRANSMIT), 0);
+
+  // SPI reads after the input mode, then a console that reconnects without 0x21 0x21
+  p.reply(0x10, 20000000, 0x00, 0x60);
+  p.reply(0x04, 20010000);
+  CHECK_EQ(p.polls(20010000, 40000000, PAIRING_POLL_RETRANSMIT), 0);
+  CHECK_EQ(p.pairing.retransmits, 0);
+  CHECK_EQ(p.pairing.state, PAIRING_INPUT_MODE);
+}
+
+// Silence drops the link only while the handshake has not set the input mode
+void test_timeout()
+{
+  Pairing p;
+  pairing_connected(&p.pairing, 0);
+  p.reply(0x02, 1000);
+  CHECK(pairing_poll(&p.pairing, 1000 + kTimeoutUs) != PAIRING_POLL_TIMEOUT);
+  CHECK_EQ(pairing_poll(&p.pairing, 1000 + kTimeoutUs + 1), PAIRING_POLL_TIMEOUT);
+  CHECK_EQ(p.pairing.timeouts, 1);
+
+  pairing_connected(&p.pairing, 0);
+  p.reply(0x03, 1000, 0x30);
+  CHECK_EQ(p.polls(1000, 3 * kTimeoutUs, PAIRING_POLL_TIMEOUT), 0);
+}
+
+}
+
+int main()
+{
+  test_milestones();
+  test_retransmit();
+  test_no_retransmit_after_input_mode();
+  test_timeout();
+  return nxtest::check_result("pairing");
+}
@@ -0,0 +1,120 @@
+// Controller profile masks in the 0x30 report
+//
+// profile.h resolves at compile time, so this file is built once per
+// controller with its CONFIG_CONTROLLER_PROFILE_* define.
+
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+struct Expected
+{
+  const char* name;
+  uint8_t type;
+  uint8_t but1;
+  uint8_t but2;
+  uint8_t but3;
+  bool left_stick;
+  bool right_stick;
+};
+
+#if defined(CONFIG_CONTROLLER_PROFILE_JOYCON_L)
+const Expected kExpected = {"profile_joycon_l", 0x01, 0x00, 0x29, 0xFF, true, false};
+#elif defined(CONFIG_CONTROLLER_PROFILE_JOYCON_R)
+const Expected kExpected = {"profile_joycon_r", 0x02, 0xFF, 0x16, 0x00, false, true};
+#else
+const Expected kExpected = {"profile_pro_con", 0x03, 0xCF, 0x3F, 0xCF, true, true};
+#endif
+
+std::vector<uint8_t> encode(const controller_input_t& input)
+{
+  uint8_t report[48] = {};
+  report[11] = 0x80;
+  profile_encode_report(report, &input);
+  CHECK_EQ(report[11], 0x80); // bytes past the input are left alone
+  return std::vector<uint8_t>(report + 2, report + 11);
+}
+
+void test_type()
+{
+  CHECK_EQ(CONTROLLER_TYPE, kExpected.type);
+}
+
+// Every button pressed: only the ones on this controller get through
+void test_button_masks()
+{
+  controller_input_t input = {0xFF, 0xFF, 0xFF, 128, 128, 128, 128};
+  std::vector<uint8_t> report = encode(input);
+  CHECK_EQ(report[0], kExpected.but1);
+  CHECK_EQ(report[1], kExpected.but2);
+  CHECK_EQ(report[2], kExpected.but3);
+}
+
+// Single buttons by name, checked against what each controller has
+void test_named_buttons()
+{
+  struct Button
+  {
+    int byte;
+    uint8_t bit;
+    bool pro, left, right;
+  };
+  const Button buttons[] = {
+    {0, 0x08, true, false, true},  // A
+    {0, 0x10, false, false, true}, // SR (right)
+    {0, 0x80, true, false, true},  // ZR
+    {1, 0x01, true, true, false},  // -
+    {1, 0x02, true, false, true},  // +
+    {1, 0x10, true, false, true},  // Home
+    {1, 0x20, true, true, false},  // Capture
+    {1, 0x80, false, false, false}, // Charging Grip
+    {2, 0x01, true, true, false},  // Down
+    {2, 0x20, false, true, false}, // SL (left)
+    {2, 0x80, true, true, false},  // ZL
+  };
+
+  for (const Button& button : buttons)
+  {
+    controller_input_t input = {0, 0, 0, 128, 128, 128, 128};
+    (&input.but1)[button.byte] = button.bit;
+#if defined(CONFIG_CONTROLLER_PROFILE_JOYCON_L)
+    bool present = button.left;
+#elif defined(CONFIG_CONTROLLER_PROFILE_JOYCON_R)
+    bool present = button.right;
+#else
+    bool present = button.pro;
+#endif
+    CHECK_EQ(encode(input)[button.byte], present ? button.bit : 0);
+  }
+}
+
+// A stick the controller does not have reads as all zero, not centered
+void test_sticks()
+{
+  controller_input_t input = {0, 0, 0, 0x12, 0x34, 0x56, 0x78};
+  std::vector<uint8_t> report = encode(input);
+
+  const std::vector<uint8_t> left(report.begin() + 3, report.begin() + 6);
+  const std::vector<uint8_t> right(report.begin() + 6, report.begin() + 9);
+  CHECK(left == (kExpected.left_stick ? std::vector<uint8_t>({0x20, 0x01, 0x34}) : std::vector<uint8_t>(3, 0)));
+  CHECK(right == (kExpected.right_stick ? std::vector<uint8_t>({0x60, 0x05, 0x78}) : std::vector<uint8_t>(3, 0)));
+
+  const uint8_t idle[6] = {PROFILE_LSTICK_IDLE, PROFILE_RSTICK_IDLE};
+  CHECK_EQ(idle[0] | idle[1] | idle[2], kExpected.left_stick ? 0x88 : 0);
+  CHECK_EQ(idle[3] | idle[4] | idle[5], kExpected.right_stick ? 0x88 : 0);
+}
+
+}
+
+int main()
+{
+  test_type();
+  test_button_masks();
+  test_named_buttons();
+  test_sticks();
+  return nxtest::check_result(kExpected.name);
+}
@@ -0,0 +1,247 @@
+// Input recorder: ring, delta stream and the UART dump read back by RecordingReceiver
+
+#include <algorithm>
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+#include "nxpad/recording.hpp"
+
+namespace
+{
+
+constexpr uint32_t kCapacity = 64;
+
+struct Packet
+{
+  uint8_t type;
+  std::vector<uint8_t> payload;
+};
+
+// device_hooks that keep every packet the device sends
+void no_lock(void*) {}
+
+void capture(void* context, uint8_t type, const uint8_t* payload, uint8_t length)
+{
+  static_cast<std::vector<Packet>*>(context)->push_back({type, std::vector<uint8_t>(payload, payload + length)});
+}
+
+const device_hooks_t kHooks = {no_lock, no_lock, capture, nullptr, nullptr, nullptr, nullptr, nullptr};
+
+// Report n: timer byte, a counter in the buttons, sticks that move now and
+// then and an IMU block that changes every report
+nxpad::RecordedReport make_report(uint32_t n)
+{
+  nxpad::RecordedReport r = {n, {}};
+  r.data[0] = n & 0xFF;
+  r.data[1] = 0x8E;
+  r.data[3] = (n / 4) & 0xFF;
+  r.data[6] = (n / 16) & 0xFF;
+  r.data[11] = 0x80;
+  for (int i = 13; i < RECORDER_REPORT_SIZE; i += 5)
+  {
+    r.data[i] = (n * i) & 0xFF;
+  }
+  return r;
+}
+
+// Report numbers with the gaps a stopped timer or a reconnect leaves
+std::vector<uint32_t> report_numbers(int count)
+{
+  std::vector<uint32_t> numbers;
+  uint32_t n = 1000;
+  for (int i = 0; i < count; i++)
+  {
+    numbers.push_back(n);
+    n += (i % 50 == 49) ? 300 : (i % 7 == 0) ? 3 : 1; // 300 needs an absolute number
+  }
+  return numbers;
+}
+
+bool same(const std::vector<nxpad::RecordedReport>& a, const std::vector<nxpad::RecordedReport>& b)
+{
+  if (a.size() != b.size())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    if (a[i].report != b[i].report || a[i].data != b[i].data)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Recorder
+{
+  recorder_t recorder;
+  recorder_entry_t storage[kCapacity];
+  std::vector<nxpad::RecordedReport> sent;
+
+  Recorder() { recorder_init(&recorder, storage, kCapacity); }
+
+  void record(const std::vector<uint32_t>& numbers)
+  {
+    for (uint32_t n : numbers)
+    {
+      nxpad::RecordedReport r = make_report(n);
+      recorder_record(&recorder, n, r.data.data());
+      sent.push_back(r);
+    }
+  }
+};
+
+// More reports than the ring holds: the dump carries the newest ones exactly
+void test_dump_round_trip()
+{
+  Recorder rec;
+  recorder_start(&rec.recorder);
+  rec.record(report_numbers(300));
+
+  std::vector<Packet> packets;
+  device_t device = {};
+  settings_default(&device.settings);
+  const pairing_config_t pairing_config = {1, 1, 1};
+  device_init(&device, &kHooks, &packets, &pairing_config, &rec.recorder);
+  device_uart_command(&device, UART_CMD_RECORD_DUMP);
+  CHECK(!rec.recorder.active);
+
+  nxpad::RecordingReceiver receiver;
+  for (const Packet& packet : packets)
+  {
+    receiver.feed(packet.type, packet.payload.data(), packet.payload.size());
+  }
+  CHECK(receiver.intact());
+  CHECK_EQ(receiver.overwritten(), 300 - kCapacity);
+  CHECK_EQ(receiver.period_us(), device.settings.report_period_us);
+  CHECK(same(receiver.reports(), std::vector<nxpad::RecordedReport>(rec.sent.end() - kCapacity, rec.sent.end())));
+  CHECK(packets.size() > 3); // the delta stream needs more than one chunk
+
+  // The same packets with one chunk missing are reported as damaged
+  nxpad::RecordingReceiver lossy;
+  for (size_t i = 0; i < packets.size(); i++)
+  {
+    if (i != 1)
+    {
+      lossy.feed(packets[i].type, packets[i].payload.data(), packets[i].payload.size());
+    }
+  }
+  CHECK(lossy.complete());
+  CHECK(!lossy.intact());
+}
+
+// Chunks of one record each decode in order with the state of the previous chunk
+void test_small_chunks()
+{
+  Recorder rec;
+  recorder_start(&rec.recorder);
+  rec.record(report_numbers(40));
+  recorder_stop(&rec.recorder);
+
+  recorder_cursor_t encoder;
+  recorder_cursor_t decoder;
+  recorder_dump_begin(&rec.recorder, &encoder);
+  recorder_decode_begin(&decoder);
+  std::vector<nxpad::RecordedReport> decoded;
+  auto collect = [](void* ctx, uint32_t report, const uint8_t* data) {
+    nxpad::RecordedReport r = {report, {}};
+    std::copy(data, data + RECORDER_REPORT_SIZE, r.data.begin());
+    static_cast<std::vector<nxpad::RecordedReport>*>(ctx)->push_back(r);
+  };
+
+  uint8_t chunk[RECORDER_MAX_RECORD];
+  size_t size;
+  int chunks = 0;
+  while ((size = recorder_dump_next(&rec.recorder, &encoder, chunk, sizeof(chunk))) > 0)
+  {
+    CHECK(recorder_decode(&decoder, chunk, size, collect, &decoded));
+    chunks++;
+  }
+  CHECK_EQ(chunks, 40);
+  CHECK(same(decoded, rec.sent));
+
+  // Too small for one record: nothing is written rather than half a record
+  recorder_dump_begin(&rec.recorder, &encoder);
+  CHECK_EQ(recorder_dump_next(&rec.recorder, &encoder, chunk, RECORDER_MAX_RECORD - 1), 0u);
+}
+
+// An unchanged report costs two bytes, one after a gap of 255 or more six
+void test_record_size()
+{
+  Recorder rec;
+  nxpad::RecordedReport r = make_report(8);
+  recorder_start(&rec.recorder);
+  recorder_record(&rec.recorder, 8, r.data.data());
+  recorder_record(&rec.recorder, 9, r.data.data());
+  recorder_record(&rec.recorder, 9 + 256, r.data.data());
+
+  recorder_cursor_t encoder;
+  uint8_t chunk[3 * RECORDER_MAX_RECORD];
+  recorder_dump_begin(&rec.recorder, &encoder);
+  size_t size = recorder_dump_next(&rec.recorder, &encoder, chunk, sizeof(chunk));
+
+  size_t first = size - 2 - 6;
+  CHECK_EQ(chunk[0], 0xFF);
+  CHECK_EQ(chunk[first], 0x00); // gap 0
+  CHECK_EQ(chunk[first + 1], 0x00); // no group changed
+  CHECK_EQ(chunk[first + 2], 0xFF);
+  CHECK_EQ(chunk[first + 7], 0x00);
+}
+
+void test_malformed()
+{
+  Recorder rec;
+  recorder_start(&rec.recorder);
+  rec.record(report_numbers(3));
+
+  recorder_cursor_t cursor;
+  uint8_t chunk[3 * RECORDER_MAX_RECORD];
+  recorder_dump_begin(&rec.recorder, &cursor);
+  size_t size = recorder_dump_next(&rec.recorder, &cursor, chunk, sizeof(chunk));
+
+  auto ignore = [](void*, uint32_t, const uint8_t*) {};
+  for (size_t cut = 1; cut < size; cut++)
+  {
+    recorder_decode_begin(&cursor);
+    int reports = 0;
+    auto count = [](void* ctx, uint32_t, const uint8_t*) { (*static_cast<int*>(ctx))++; };
+    bool ok = recorder_decode(&cursor, chunk, cut, count, &reports);
+    CHECK(!ok || reports < 3);
+  }
+  recorder_decode_begin(&cursor);
+  CHECK(recorder_decode(&cursor, chunk, size, ignore, nullptr));
+}
+
+// Nothing is kept while stopped, and a restart clears the ring
+void test_start_stop()
+{
+  Recorder rec;
+  rec.record(report_numbers(5));
+  CHECK_EQ(recorder_count(&rec.recorder), 0u);
+  CHECK_EQ(recorder_first(&rec.recorder), 0u);
+
+  recorder_start(&rec.recorder);
+  rec.record({7, 8});
+  recorder_stop(&rec.recorder);
+  rec.record({9});
+  CHECK_EQ(recorder_count(&rec.recorder), 2u);
+  CHECK_EQ(recorder_first(&rec.recorder), 7u);
+
+  recorder_start(&rec.recorder);
+  CHECK_EQ(recorder_count(&rec.recorder), 0u);
+  CHECK_EQ(recorder_overwritten(&rec.recorder), 0u);
+}
+
+}
+
+int main()
+{
+  test_dump_round_trip();
+  test_small_chunks();
+  test_record_size();
+  test_malformed();
+  test_start_stop();
+  return nxtest::check_result("recorder");
+}
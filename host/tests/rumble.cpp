@@ -0,0 +1,162 @@
+// HD rumble decoding on output reports recorded from a Switch (notes/JoyControl logs)
+
+#include <cmath>
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+// Frequency code to Hz, as documented in rumble.h
+double hz(uint8_t code)
+{
+  return 10.0 * std::pow(2.0, code / 32.0);
+}
+
+rumble_side_t decode(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+  const uint8_t data[4] = {b0, b1, b2, b3};
+  rumble_side_t side;
+  rumble_decode_side(data, &side);
+  return side;
+}
+
+bool near(double actual, double expected)
+{
+  return std::fabs(actual - expected) < expected * 0.01;
+}
+
+void test_neutral()
+{
+  // 00 01 40 40: 320Hz / 160Hz, silent
+  rumble_side_t side = decode(0x00, 0x01, 0x40, 0x40);
+  CHECK(near(hz(side.hf_freq), 320.0));
+  CHECK(near(hz(side.lf_freq), 160.0));
+  CHECK_EQ(side.hf_amp, 0);
+  CHECK_EQ(side.lf_amp, 0);
+
+  // The all-zero blocks the console sends before rumble is set up are silent too
+  side = decode(0x00, 0x00, 0x00, 0x00);
+  CHECK_EQ(side.hf_amp, 0);
+  CHECK_EQ(side.lf_amp, 0);
+}
+
+void test_recorded_blocks()
+{
+  // c2 18 03 72, a 0x10 report in both logs
+  rumble_side_t side = decode(0xC2, 0x18, 0x03, 0x72);
+  CHECK_EQ(side.hf_freq, 0x90);
+  CHECK(near(hz(side.hf_freq), 226.3));
+  CHECK_EQ(side.hf_amp, 0x0C);
+  CHECK_EQ(side.lf_freq, 0x43);
+  CHECK(near(hz(side.lf_freq), 42.7));
+  CHECK_EQ(side.lf_amp, 0x64);
+
+  // 02 98 60 40: loud high band, silent low band
+  side = decode(0x02, 0x98, 0x60, 0x40);
+  CHECK(near(hz(side.hf_freq), 80.0));
+  CHECK_EQ(side.hf_amp, 0x4C);
+  CHECK(near(hz(side.lf_freq), 320.0));
+  CHECK_EQ(side.lf_amp, 0);
+
+  // 02 78 60 40 (right side in log 2)
+  side = decode(0x02, 0x78, 0x60, 0x40);
+  CHECK_EQ(side.hf_amp, 0x3C);
+  CHECK_EQ(side.lf_amp, 0);
+
+  // 80 18 60 b2 and 80 04 63 80: the HF frequency bits span bytes 0 and 1
+  side = decode(0x80, 0x18, 0x60, 0xB2);
+  CHECK(near(hz(side.hf_freq), 160.0));
+  CHECK_EQ(side.hf_amp, 0x0C);
+  side = decode(0x80, 0x04, 0x63, 0x80);
+  CHECK(near(hz(side.hf_freq), 160.0));
+  CHECK_EQ(side.hf_amp, 0x02);
+  CHECK_EQ(side.lf_freq, 0x63 + 0x40);
+}
+
+struct Recorded
+{
+  int repeats;
+  uint8_t data[RUMBLE_DATA_SIZE];
+};
+
+// Rumble bytes 1-8 of every 0x01 and 0x10 output report in log 1, in order,
+// with repeats of the same bytes folded
+const Recorded kLog1[] = {
+  {4, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {2, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {4, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {1, {194, 24, 3, 114, 0, 0, 0, 0}},
+  {1, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {1, {2, 152, 96, 64, 0, 0, 0, 0}},
+  {4, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {8, {0, 0, 0, 0, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {1, {128, 24, 96, 178, 0, 0, 0, 0}},
+  {1, {0, 1, 64, 64, 0, 0, 0, 0}},
+  {1, {128, 4, 99, 128, 0, 0, 0, 0}},
+  {9, {0, 1, 64, 64, 0, 0, 0, 0}},
+};
+
+// One event per change, repeats only counted
+void test_filter_log()
+{
+  rumble_filter_t filter = {};
+  int events = 0;
+  int packets = 0;
+  std::vector<uint8_t> hf_amps;
+
+  for (const Recorded& recorded : kLog1)
+  {
+    for (int i = 0; i < recorded.repeats; i++)
+    {
+      rumble_event_t event;
+      packets++;
+      if (rumble_filter(&filter, recorded.data, &event))
+      {
+        events++;
+        hf_amps.push_back(event.left.hf_amp);
+        CHECK_EQ(i, 0);
+      }
+    }
+  }
+
+  CHECK_EQ(packets, 43);
+  CHECK_EQ(events, 18);
+  CHECK_EQ(filter.duplicates, 25);
+  CHECK(hf_amps == std::vector<uint8_t>({0, 0, 0, 0, 0, 0, 0x0C, 0, 0, 0x4C, 0, 0, 0, 0, 0x0C, 0, 0x02, 0}));
+}
+
+void test_event_encode()
+{
+  rumble_filter_t filter = {};
+  const uint8_t data[RUMBLE_DATA_SIZE] = {0x00, 0x00, 0x00, 0x00, 0xC2, 0x18, 0x03, 0x72};
+  rumble_event_t event;
+  CHECK(rumble_filter(&filter, data, &event));
+  event.time_ms = 0x01020304;
+
+  uint8_t payload[RUMBLE_EVENT_SIZE];
+  CHECK_EQ(rumble_event_encode(&event, payload), RUMBLE_EVENT_SIZE);
+  const uint8_t expected[RUMBLE_EVENT_SIZE] = {0x04, 0x03, 0x02, 0x01, 0x60, 0x00, 0x40, 0x00,
+                                               0x90, 0x0C, 0x43, 0x64};
+  CHECK(std::vector<uint8_t>(payload, payload + RUMBLE_EVENT_SIZE) ==
+        std::vector<uint8_t>(expected, expected + RUMBLE_EVENT_SIZE));
+}
+
+}
+
+int main()
+{
+  test_neutral();
+  test_recorded_blocks();
+  test_filter_log();
+  test_event_encode();
+  return nxtest::check_result("rumble");
+}
@@ -0,0 +1,92 @@
+// Serial port setup on a pty: table and custom baud rates, failures without a leaked descriptor
+
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "nxpad/serial_port.hpp"
+
+namespace
+{
+
+struct Pty
+{
+  int master;
+  std::string path;
+
+  Pty()
+  {
+    master = ::posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(master >= 0 && ::grantpt(master) == 0 && ::unlockpt(master) == 0);
+    path = ::ptsname(master);
+  }
+  ~Pty() { ::close(master); }
+};
+
+// The descriptor the next open() gets: unchanged when nothing leaked
+int next_fd()
+{
+  int fd = ::dup(0);
+  ::close(fd);
+  return fd;
+}
+
+bool throws(const std::string& path, int baud)
+{
+  try
+  {
+    nxpad::SerialPort port(path, baud);
+  }
+  catch (const std::system_error&)
+  {
+    return true;
+  }
+  return false;
+}
+
+void test_table_rate()
+{
+  Pty pty;
+  nxpad::SerialPort port(pty.path, 115200);
+  termios tio;
+  CHECK(::tcgetattr(port.fd(), &tio) == 0);
+  CHECK(::cfgetospeed(&tio) == B115200);
+  CHECK(::cfgetispeed(&tio) == B115200);
+}
+
+// 250000 is the power save limit of the firmware and not in the termios table
+void test_custom_rate()
+{
+  Pty pty;
+#ifdef __linux__
+  nxpad::SerialPort port(pty.path, 250000);
+  CHECK(port.is_open());
+#else
+  CHECK(throws(pty.path, 250000));
+#endif
+}
+
+void test_failures()
+{
+  Pty pty;
+  int fd = next_fd();
+  CHECK(throws(pty.path, 0));
+  CHECK(throws(pty.path, -9600));
+  CHECK(throws("/nonexistent/tty", 9600));
+  CHECK_EQ(next_fd(), fd);
+}
+
+}
+
+int main()
+{
+  test_table_rate();
+  test_custom_rate();
+  test_failures();
+  return nxtest::check_result("serial_port");
+}
@@ -0,0 +1,187 @@
+// Settings store: NVS blob upgrade, UART edits and the encoded payload
+//
+// Also built with CONFIG_UARTNX_POWER_SAVE, where settings.h caps the baud rate.
+
+#include <cstring>
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+#if CONFIG_UARTNX_POWER_SAVE
+const char* const kName = "settings_power_save";
+#else
+const char* const kName = "settings";
+#endif
+
+std::vector<uint8_t> set_u32(uint8_t id, uint32_t value)
+{
+  return {id, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16),
+          static_cast<uint8_t>(value >> 24)};
+}
+
+bool set(settings_t& settings, const std::vector<uint8_t>& payload)
+{
+  return settings_set(&settings, payload.data(), static_cast<uint8_t>(payload.size()));
+}
+
+bool same(const settings_t& a, const settings_t& b)
+{
+  return std::memcmp(&a, &b, sizeof(settings_t)) == 0;
+}
+
+void test_defaults()
+{
+  settings_t settings;
+  settings_default(&settings);
+  CHECK(settings_valid(&settings));
+  CHECK_EQ(settings.version, SETTINGS_VERSION);
+  CHECK_EQ(settings.baud, 9600u);
+  CHECK_EQ(settings.link_profile, LINK_PROFILE_BALANCED);
+}
+
+// A version 1 blob is what nvs_get_blob() leaves over the defaults: the first
+// 56 bytes, with the fields added since still at their defaults
+void test_upgrade_v1()
+{
+  settings_t stored;
+  settings_default(&stored);
+  stored.version = 1;
+  stored.log_level = 3;
+  stored.uart_buffer = 1024;
+  stored.baud = 115200;
+  stored.report_period_us = 8000;
+  std::strcpy(stored.device_name, "Left Pad");
+
+  settings_t loaded;
+  settings_default(&loaded);
+  std::memcpy(&loaded, &stored, SETTINGS_V1_SIZE);
+
+  CHECK(settings_upgrade(&loaded, SETTINGS_V1_SIZE));
+  CHECK(settings_valid(&loaded));
+  CHECK_EQ(loaded.version, SETTINGS_VERSION);
+  CHECK_EQ(loaded.log_level, 3);
+  CHECK_EQ(loaded.uart_buffer, 1024);
+  CHECK_EQ(loaded.baud, 115200u);
+  CHECK_EQ(loaded.report_period_us, 8000u);
+  CHECK(std::strcmp(loaded.device_name, "Left Pad") == 0);
+  CHECK_EQ(loaded.link_profile, LINK_PROFILE_BALANCED);
+}
+
+void test_upgrade_rejects()
+{
+  settings_t settings;
+
+  // Current blobs pass as they are
+  settings_default(&settings);
+  CHECK(settings_upgrade(&settings, sizeof(settings_t)));
+  CHECK(settings_valid(&settings));
+
+  // A version 1 blob of the wrong size, a truncated current blob
+  settings_default(&settings);
+  settings.version = 1;
+  CHECK(!settings_upgrade(&settings, SETTINGS_V1_SIZE + 1));
+  settings_default(&settings);
+  CHECK(!settings_upgrade(&settings, SETTINGS_V1_SIZE));
+
+  // A full-size blob that still says version 1 is not valid
+  settings_default(&settings);
+  settings.version = 1;
+  CHECK(settings_upgrade(&settings, sizeof(settings_t)));
+  CHECK(!settings_valid(&settings));
+
+  // A newer version than this firmware knows
+  settings_default(&settings);
+  settings.version = SETTINGS_VERSION + 1;
+  CHECK(!settings_valid(&settings));
+}
+
+void test_set()
+{
+  settings_t settings;
+  settings_default(&settings);
+
+  CHECK(set(settings, set_u32(SETTING_REPORT_PERIOD, 8000)));
+  CHECK_EQ(settings.report_period_us, 8000u);
+  CHECK(set(settings, {SETTING_UART_BUFFER, 0x00, 0x04}));
+  CHECK_EQ(settings.uart_buffer, 1024);
+  CHECK(set(settings, {SETTING_DEVICE_NAME, 'N', 'X'}));
+  CHECK(std::strcmp(settings.device_name, "NX") == 0);
+  CHECK(set(settings, {SETTING_LINK_PROFILE, LINK_PROFILE_LOW_LATENCY}));
+  CHECK_EQ(settings.link_profile, LINK_PROFILE_LOW_LATENCY);
+
+  // Rejected edits leave every field as it was
+  const settings_t before = settings;
+  CHECK(!set(settings, set_u32(SETTING_REPORT_PERIOD, SETTINGS_PERIOD_MIN_US - 1)));
+  CHECK(!set(settings, {SETTING_UART_BUFFER, 0x01, 0x10})); // 4097
+  CHECK(!set(settings, {SETTING_UART_BUFFER, 0x00}));
+  CHECK(!set(settings, {SETTING_DEVICE_NAME, 'N', 0x00, 'X'}));
+  CHECK(!set(settings, {SETTING_LOG_LEVEL, SETTINGS_LOG_LEVEL_MAX + 1}));
+  CHECK(!set(settings, {SETTING_LINK_PROFILE, LINK_PROFILE_COUNT}));
+  CHECK(!set(settings, {0x7F, 0x00}));
+  CHECK(!set(settings, {SETTING_LOG_LEVEL}));
+  CHECK(same(settings, before));
+}
+
+void test_baud_range()
+{
+  settings_t settings;
+  settings_default(&settings);
+
+  CHECK(set(settings, set_u32(SETTING_BAUD, 115200)));
+  CHECK(set(settings, set_u32(SETTING_BAUD, 230400)));
+  CHECK(!set(settings, set_u32(SETTING_BAUD, SETTINGS_BAUD_MIN - 1)));
+  CHECK(!set(settings, set_u32(SETTING_BAUD, SETTINGS_BAUD_MAX + 1)));
+#if CONFIG_UARTNX_POWER_SAVE
+  CHECK_EQ(SETTINGS_BAUD_MAX, 250000);
+  CHECK(!set(settings, set_u32(SETTING_BAUD, 460800)));
+  CHECK(!set(settings, set_u32(SETTING_BAUD, 921600)));
+#else
+  CHECK(set(settings, set_u32(SETTING_BAUD, 921600)));
+#endif
+
+  // A blob saved by a build without the cap falls back to the defaults
+  settings_t stored;
+  settings_default(&stored);
+  stored.baud = 921600;
+#if CONFIG_UARTNX_POWER_SAVE
+  CHECK(!settings_valid(&stored));
+#else
+  CHECK(settings_valid(&stored));
+#endif
+}
+
+void test_encode()
+{
+  settings_t settings;
+  settings_default(&settings);
+  settings.baud = 0x0001C200;             // 115200
+  settings.report_period_us = 0x00001F40; // 8000
+
+  uint8_t out[SETTINGS_ENCODED_SIZE];
+  CHECK_EQ(settings_encode(&settings, out), static_cast<size_t>(SETTINGS_ENCODED_SIZE));
+  CHECK_EQ(out[0], SETTINGS_VERSION);
+  CHECK_EQ(out[2], 0x00);
+  CHECK_EQ(out[3], 0x01); // uart buffer 256
+  CHECK(std::vector<uint8_t>(out + 4, out + 12) ==
+        std::vector<uint8_t>({0x00, 0xC2, 0x01, 0x00, 0x40, 0x1F, 0x00, 0x00}));
+  CHECK(std::memcmp(&out[12], settings.colors, SETTINGS_COLORS_LEN) == 0);
+  CHECK(std::strcmp(reinterpret_cast<const char*>(&out[24]), settings.device_name) == 0);
+  CHECK_EQ(out[56], settings.link_profile);
+}
+
+}
+
+int main()
+{
+  test_defaults();
+  test_upgrade_v1();
+  test_upgrade_rejects();
+  test_set();
+  test_baud_range();
+  test_encode();
+  return nxtest::check_result(kName);
+}
@@ -0,0 +1,271 @@
+// UART stream decoder: frames, commands, packets and resync after broken frames
+
+#include <cstring>
+#include <vector>
+
+#include "check.hpp"
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+struct Decoded
+{
+  std::vector<std::vector<uint8_t>> frames;
+  std::vector<uint8_t> commands;
+  std::vector<uint8_t> packets; // types
+  int errors = 0;
+};
+
+Decoded feed(uart_proto_t& proto, const std::vector<uint8_t>& stream)
+{
+  Decoded decoded;
+  for (uint8_t byte : stream)
+  {
+    switch (uart_proto_feed(&proto, byte))
+    {
+    case UART_PROTO_FRAME:
+      decoded.frames.emplace_back(proto.frame, proto.frame + INPUT_FRAME_SIZE);
+      break;
+    case UART_PROTO_COMMAND:
+      decoded.commands.push_back(proto.command);
+      break;
+    case UART_PROTO_PACKET:
+      decoded.packets.push_back(proto.type);
+      break;
+    case UART_PROTO_ERROR:
+      decoded.errors++;
+      break;
+    default:
+      break;
+    }
+  }
+  return decoded;
+}
+
+Decoded feed(const std::vector<uint8_t>& stream)
+{
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  return feed(proto, stream);
+}
+
+std::vector<uint8_t> frame(uint8_t b5, uint8_t b6, uint8_t b7, uint8_t b8, uint8_t b9)
+{
+  return {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, b5, b6, b7, b8, b9, 0x00};
+}
+
+// Button bytes that look like sync bytes, commands (0xE8 saves settings,
+// 0xC0 starts a combo) or a packet start
+std::vector<std::vector<uint8_t>> awkward_frames(int count)
+{
+  static const uint8_t b5[] = {0xE8, 0xC0, 0x55, 0xAA, 0x80, 0x00, 0xFF, 0xE3};
+  static const uint8_t b6[] = {0x00, 0x3F, 0xAA, 0x10};
+  std::vector<std::vector<uint8_t>> frames;
+  for (int i = 0; i < count; i++)
+  {
+    frames.push_back(frame(b5[i % 8], b6[i % 4], static_cast<uint8_t>(i % 9), static_cast<uint8_t>(i % 16),
+                           static_cast<uint8_t>((i * 7) % 16)));
+  }
+  return frames;
+}
+
+std::vector<uint8_t> join(const std::vector<std::vector<uint8_t>>& frames)
+{
+  std::vector<uint8_t> stream;
+  for (const auto& f : frames)
+  {
+    stream.insert(stream.end(), f.begin(), f.end());
+  }
+  return stream;
+}
+
+void test_aligned_stream()
+{
+  auto frames = awkward_frames(1000);
+  Decoded decoded = feed(join(frames));
+
+  CHECK(decoded.frames == frames);
+  CHECK(decoded.commands.empty());
+  CHECK(decoded.packets.empty());
+  CHECK_EQ(decoded.errors, 0);
+}
+
+// A host started mid-frame: every frame after the broken one decodes and no
+// button byte of the broken one runs as a command
+void test_misaligned_start()
+{
+  auto frames = awkward_frames(1000);
+  std::vector<uint8_t> stream = join(frames);
+
+  for (size_t offset = 1; offset < INPUT_FRAME_SIZE; offset++)
+  {
+    Decoded decoded = feed(std::vector<uint8_t>(stream.begin() + offset, stream.end()));
+    std::vector<std::vector<uint8_t>> expected(frames.begin() + 1, frames.end());
+
+    CHECK(decoded.frames == expected);
+    CHECK(decoded.commands.empty());
+    CHECK(decoded.packets.empty());
+  }
+}
+
+// Every possible first button byte, with the stream cut at every offset
+void test_resync_any_button_byte()
+{
+  for (int b5 = 0; b5 < 256; b5++)
+  {
+    std::vector<std::vector<uint8_t>> frames = {
+      frame(static_cast<uint8_t>(b5), 0x05, 0x08, 0x00, 0x00),
+      frame(0x01, 0x00, 0x08, 0x00, 0x00),
+      frame(0x02, 0x00, 0x08, 0x00, 0x00),
+    };
+    std::vector<uint8_t> stream = join(frames);
+
+    for (size_t offset = 1; offset < INPUT_FRAME_SIZE; offset++)
+    {
+      Decoded decoded = feed(std::vector<uint8_t>(stream.begin() + offset, stream.end()));
+      CHECK_EQ(decoded.frames.size(), 2u);
+      CHECK(decoded.commands.empty());
+    }
+  }
+}
+
+// A host that opens the port on a quiet line can start with a command
+void test_commands_and_packets()
+{
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  uart_proto_idle(&proto);
+
+  std::vector<uint8_t> stream = {UART_CMD_CLOCK};
+  uint8_t payload[7] = {0x08, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80};
+  uint8_t packet[UART_PROTO_MAX_PACKET];
+  size_t size = uart_proto_encode(UART_PKT_INPUT_STATE, payload, sizeof(payload), packet);
+  stream.insert(stream.end(), packet, packet + size);
+  auto f = frame(0x04, 0x00, 0x08, 0x00, 0x00);
+  stream.insert(stream.end(), f.begin(), f.end());
+  stream.push_back(UART_CMD_SETTINGS_GET);
+  stream.push_back(0x80); // both ends of the command range
+  stream.push_back(0xFF);
+
+  Decoded decoded = feed(proto, stream);
+  CHECK(decoded.commands == std::vector<uint8_t>({UART_CMD_CLOCK, UART_CMD_SETTINGS_GET, 0x80, 0xFF}));
+  CHECK(decoded.packets == std::vector<uint8_t>({UART_PKT_INPUT_STATE}));
+  CHECK_EQ(decoded.frames.size(), 1u);
+  CHECK_EQ(decoded.errors, 0);
+}
+
+// After a broken frame, commands wait for the next valid frame or packet
+void test_commands_after_broken_frame()
+{
+  auto f = frame(0x04, 0x00, 0x08, 0x00, 0x00);
+  std::vector<uint8_t> stream(f.begin() + 3, f.end());
+  stream.push_back(UART_CMD_SETTINGS_SAVE);
+  stream.insert(stream.end(), f.begin(), f.end());
+  stream.push_back(UART_CMD_CLOCK);
+
+  Decoded decoded = feed(stream);
+  CHECK(decoded.commands == std::vector<uint8_t>({UART_CMD_CLOCK}));
+  CHECK_EQ(decoded.frames.size(), 1u);
+
+  uint8_t packet[UART_PROTO_MAX_PACKET];
+  size_t size = uart_proto_encode(UART_PKT_MACRO_SAVE, nullptr, 0, packet);
+  stream.assign(f.begin() + 3, f.end());
+  stream.push_back(UART_CMD_SETTINGS_SAVE);
+  stream.insert(stream.end(), packet, packet + size);
+  stream.push_back(UART_CMD_CLOCK);
+
+  decoded = feed(stream);
+  CHECK(decoded.commands == std::vector<uint8_t>({UART_CMD_CLOCK}));
+  CHECK(decoded.packets == std::vector<uint8_t>({UART_PKT_MACRO_SAVE}));
+}
+
+// A new decoder takes no commands before a quiet line: the device may have booted mid-frame
+void test_quiet_line()
+{
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  Decoded decoded = feed(proto, {UART_CMD_COMBO_BASE, 0x05, 0x00});
+  CHECK(decoded.commands.empty());
+
+  // The quiet line also ends a frame that never finished
+  feed(proto, {0xAA, 0xAA, 0xAA});
+  uart_proto_idle(&proto);
+  decoded = feed(proto, {UART_CMD_CLOCK, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0x01, 0x00, 0x08, 0x00, 0x00, 0x00});
+  CHECK(decoded.commands == std::vector<uint8_t>({UART_CMD_CLOCK}));
+  CHECK_EQ(decoded.frames.size(), 1u);
+  CHECK_EQ(proto.errors, 1);
+}
+
+// A 0x55 button byte of a broken frame must not swallow the frames after it
+void test_stray_packet_start()
+{
+  std::vector<std::vector<uint8_t>> frames = {
+    frame(0x55, 0x07, 0x40, 0x00, 0x00), // type 0x07, length 0x40
+    frame(0x01, 0x00, 0x08, 0x00, 0x00),
+    frame(0x02, 0x00, 0x08, 0x00, 0x00),
+  };
+  std::vector<uint8_t> stream = join(frames);
+
+  Decoded decoded = feed(std::vector<uint8_t>(stream.begin() + 2, stream.end()));
+  std::vector<std::vector<uint8_t>> expected(frames.begin() + 1, frames.end());
+  CHECK(decoded.frames == expected);
+  CHECK(decoded.packets.empty());
+}
+
+// Power save: the bytes that wake the chip from light sleep are lost. The
+// frame they belonged to is dropped, the next one decodes.
+void test_lost_wake_bytes()
+{
+  auto frames = awkward_frames(64);
+
+  for (size_t lost = 1; lost <= 3; lost++)
+  {
+    uart_proto_t proto;
+    uart_proto_init(&proto);
+    uart_proto_idle(&proto);
+    std::vector<std::vector<uint8_t>> decoded_frames;
+    int commands = 0;
+
+    // Pairs of frames sent after a quiet line, so the first loses its head
+    for (size_t i = 0; i + 1 < frames.size(); i += 2)
+    {
+      std::vector<uint8_t> burst(frames[i].begin() + lost, frames[i].end());
+      burst.insert(burst.end(), frames[i + 1].begin(), frames[i + 1].end());
+
+      Decoded decoded = feed(proto, burst);
+      decoded_frames.insert(decoded_frames.end(), decoded.frames.begin(), decoded.frames.end());
+      commands += static_cast<int>(decoded.commands.size());
+      uart_proto_idle(&proto);
+
+      CHECK(decoded.frames == std::vector<std::vector<uint8_t>>({frames[i + 1]}));
+    }
+    CHECK_EQ(decoded_frames.size(), frames.size() / 2);
+    CHECK_EQ(commands, 0);
+  }
+
+  // Without the quiet line in between, as when the read did not time out
+  std::vector<uint8_t> stream;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    stream.insert(stream.end(), frames[i].begin() + (i % 2 == 0 ? 2 : 0), frames[i].end());
+  }
+  Decoded decoded = feed(stream);
+  CHECK_EQ(decoded.frames.size(), frames.size() / 2);
+  CHECK(decoded.commands.empty());
+}
+
+}
+
+int main()
+{
+  test_aligned_stream();
+  test_misaligned_start();
+  test_resync_any_button_byte();
+  test_commands_and_packets();
+  test_commands_after_broken_frame();
+  test_quiet_line();
+  test_stray_packet_start();
+  test_lost_wake_bytes();
+  return nxtest::check_result("uart_proto");
+}
@@ -0,0 +1,302 @@
+// Reads and edits the device settings
+//
+//   nxpad-config PORT [--baud N] get
+//   nxpad-config PORT [--baud N] set KEY VALUE
+//   nxpad-config PORT [--baud N] save
+//
+// KEY is baud, uart-buffer, period-us, colors (24 hex digits), name,
+// log-level or link-profile (low_latency, balanced, low_power or 0-2).
+// "set baud" switches the port to the new rate and confirms it, so the
+// device keeps it; "save" stores the current settings in NVS.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nxpad/firmware.hpp"
+#include "nxpad/link.hpp"
+#include "nxpad/serial_port.hpp"
+
+namespace
+{
+
+struct Setting
+{
+  const char* key;
+  uint8_t id;
+};
+
+const Setting kSettings[] = {
+  {"baud", SETTING_BAUD},
+  {"uart-buffer", SETTING_UART_BUFFER},
+  {"period-us", SETTING_REPORT_PERIOD},
+  {"colors", SETTING_COLORS},
+  {"name", SETTING_DEVICE_NAME},
+  {"log-level", SETTING_LOG_LEVEL},
+  {"link-profile", SETTING_LINK_PROFILE},
+};
+
+void usage(const char* name)
+{
+  std::fprintf(stderr, "usage: %s PORT [--baud N] get | set KEY VALUE | save\n", name);
+}
+
+// UART_PKT_SETTING_SET payload for KEY VALUE, empty when malformed
+std::vector<uint8_t> encode_setting(const std::string& key, const std::string& value)
+{
+  std::vector<uint8_t> payload;
+  for (const auto& setting : kSettings)
+  {
+    if (key == setting.key)
+    {
+      payload.push_back(setting.id);
+    }
+  }
+  if (payload.empty())
+  {
+    return payload;
+  }
+
+  char* end = nullptr;
+  unsigned long number = std::strtoul(value.c_str(), &end, 0);
+  bool numeric = !value.empty() && *end == '\0';
+
+  switch (payload[0])
+  {
+  case SETTING_BAUD:
+  case SETTING_REPORT_PERIOD:
+    if (!numeric)
+    {
+      return {};
+    }
+    payload.resize(5);
+    le_put_u32(&payload[1], static_cast<uint32_t>(number));
+    break;
+  case SETTING_UART_BUFFER:
+    if (!numeric || number > 0xFFFF)
+    {
+      return {};
+    }
+    payload.resize(3);
+    le_put_u16(&payload[1], static_cast<uint16_t>(number));
+    break;
+  case SETTING_LOG_LEVEL:
+    if (!numeric || number > 0xFF)
+    {
+      return {};
+    }
+    payload.push_back(static_cast<uint8_t>(number));
+    break;
+  case SETTING_LINK_PROFILE:
+    for (uint8_t id = 0; id < LINK_PROFILE_COUNT; id++)
+    {
+      if (value == link_profile_get(id)->name)
+      {
+        number = id;
+        numeric = true;
+      }
+    }
+    if (!numeric || number > 0xFF)
+    {
+      return {};
+    }
+    payload.push_back(static_cast<uint8_t>(number));
+    break;
+  case SETTING_COLORS:
+    if (value.size() != SETTINGS_COLORS_LEN * 2)
+    {
+      return {};
+    }
+    for (size_t i = 0; i < value.size(); i += 2)
+    {
+      std::string digits = value.substr(i, 2);
+      payload.push_back(static_cast<uint8_t>(std::strtoul(digits.c_str(), &end, 16)));
+      if (*end != '\0')
+      {
+        return {};
+      }
+    }
+    break;
+  case SETTING_DEVICE_NAME:
+    payload.insert(payload.end(), value.begin(), value.end());
+    break;
+  }
+  return payload;
+}
+
+void print_settings(const uint8_t* p)
+{
+  std::printf("version %u\n", p[0]);
+  std::printf("log-level %u\n", p[1]);
+  std::printf("uart-buffer %u\n", le_get_u16(&p[2]));
+  std::printf("baud %u\n", le_get_u32(&p[4]));
+  std::printf("period-us %u\n", le_get_u32(&p[8]));
+  std::printf("colors ");
+  for (int i = 0; i < SETTINGS_COLORS_LEN; i++)
+  {
+    std::printf("%02x", p[12 + i]);
+  }
+  std::printf("\nname %.*s\n", SETTINGS_NAME_LEN, reinterpret_cast<const char*>(&p[24]));
+  const link_profile_t* profile = link_profile_get(p[56]);
+  std::printf("link-profile %s\n", profile != nullptr ? profile->name : "?");
+}
+
+// Waits for device packets on one port at one baud
+class Session
+{
+public:
+  Session(const std::string& path, int baud)
+    : port_(path, baud), link_(port_.fd(), nxpad::Protocol::Packet)
+  {
+    link_.on_packet([this](uint8_t type, const uint8_t* payload, size_t length) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (type == UART_PKT_SETTINGS && length == SETTINGS_ENCODED_SIZE)
+      {
+        std::memcpy(settings_, payload, SETTINGS_ENCODED_SIZE);
+        has_settings_ = true;
+      }
+      else if (type == UART_PKT_BAUD_PENDING && length == 6)
+      {
+        pending_baud_ = le_get_u32(payload);
+      }
+      else
+      {
+        return;
+      }
+      received_.notify_all();
+    });
+  }
+
+  nxpad::Link& link() { return link_; }
+
+  // Settings packet that arrives after this call
+  bool wait_settings(uint8_t* out)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!received_.wait_for(lock, std::chrono::seconds(2), [this] { return has_settings_; }))
+    {
+      return false;
+    }
+    std::memcpy(out, settings_, SETTINGS_ENCODED_SIZE);
+    return true;
+  }
+
+  // Settings or baud pending, whichever the device answers with
+  bool wait_answer()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return received_.wait_for(lock, std::chrono::seconds(2), [this] { return has_settings_ || pending_baud_ != 0; });
+  }
+
+  uint32_t pending_baud()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_baud_;
+  }
+
+  bool has_settings()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_settings_;
+  }
+
+private:
+  nxpad::SerialPort port_;
+  nxpad::Link link_;
+  std::mutex mutex_;
+  std::condition_variable received_;
+  uint8_t settings_[SETTINGS_ENCODED_SIZE];
+  bool has_settings_ = false;
+  uint32_t pending_baud_ = 0;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::string path = argv[1];
+  int baud = 9600;
+  std::vector<std::string> args;
+  for (int i = 2; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+    {
+      baud = std::atoi(argv[++i]);
+    }
+    else
+    {
+      args.push_back(argv[i]);
+    }
+  }
+
+  auto session = std::make_unique<Session>(path, baud);
+  uint8_t settings[SETTINGS_ENCODED_SIZE];
+
+  if (args.size() == 1 && args[0] == "save")
+  {
+    session->link().command(UART_CMD_SETTINGS_SAVE);
+    session->link().flush();
+    return 0;
+  }
+
+  if (args.size() == 1 && args[0] == "get")
+  {
+    session->link().command(UART_CMD_SETTINGS_GET);
+    if (!session->wait_settings(settings))
+    {
+      std::fprintf(stderr, "no settings received\n");
+      return 1;
+    }
+    print_settings(settings);
+    return 0;
+  }
+
+  if (args.size() != 3 || args[0] != "set")
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> payload = encode_setting(args[1], args[2]);
+  if (payload.empty())
+  {
+    std::fprintf(stderr, "bad setting: %s %s\n", args[1].c_str(), args[2].c_str());
+    return 2;
+  }
+
+  session->link().packet(UART_PKT_SETTING_SET, payload.data(), payload.size());
+  if (!session->wait_answer())
+  {
+    std::fprintf(stderr, "setting rejected (out of range?)\n");
+    return 1;
+  }
+
+  // The device already runs at the new rate; confirm from there before it reverts
+  uint32_t new_baud = session->pending_baud();
+  if (!session->has_settings() && new_baud != 0)
+  {
+    session.reset();
+    session = std::make_unique<Session>(path, static_cast<int>(new_baud));
+    session->link().command(UART_CMD_BAUD_CONFIRM);
+  }
+
+  if (!session->wait_settings(settings))
+  {
+    std::fprintf(stderr, "no settings received\n");
+    return 1;
+  }
+  print_settings(settings);
+  return 0;
+}
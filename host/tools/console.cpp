@@ -0,0 +1,802 @@
+// Console stand-in for soak tests
+//
+// Runs the firmware's report and handshake paths (device.c, as send_task and
+// esp_bt_hidd_cb call it) against a simulated console over a simulated
+// Bluetooth link. The console runs the pairing handshake in
+// the order a real one does (see notes/), polls one report per poll interval
+// and reconnects after every drop. The link injects delay, loss, duplicate
+// subcommands and disconnects. A host stand-in keeps changing the input with
+// UART_PKT_INPUT_STATE packets timed at the UART baud rate; the time until a
+// change shows up in a 0x30 report at the console is the input latency.
+//
+// Time is simulated, so hours run in seconds; --realtime paces the run to
+// the wall clock instead.
+//
+//   nxpad-console [--duration S] [--seed N] [--realtime] [--progress S]
+//                 [--period-us N] [--poll-us N] [--baud N] [--input-ms N]
+//                 [--delay-ms N] [--jitter-ms N] [--drop P] [--dup P]
+//                 [--disconnect-every S] [--mtbf S] [--outage-ms N]
+//                 [--script FILE]
+//
+// Script lines are "SECONDS OPTION [VALUE]", with OPTION one of the options
+// above from --period-us to --outage-ms without the dashes, or "disconnect".
+// '#' starts a comment.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+// Kconfig defaults of the pairing options
+constexpr int64_t kPairingRetransmitUs = 300 * 1000;
+constexpr uint8_t kPairingRetries = 3;
+constexpr int64_t kPairingTimeoutUs = 10 * 1000 * 1000;
+
+// DUMMY_PERIOD_US in main.c with the default CONFIG_FREERTOS_HZ of 100
+constexpr uint32_t kIdlePeriodUs = 100 * 10 * 1000;
+
+// What the console does when a subcommand goes unanswered
+constexpr int64_t kConsoleTimeoutUs = 500 * 1000;
+constexpr int kConsoleRetries = 5;
+
+// Reports the Bluetooth stack accepts before send_report fails
+constexpr size_t kTxQueue = 8;
+
+constexpr size_t kOutputReportSize = 48;
+
+struct Config
+{
+  double duration_s = 3600;
+  uint32_t seed = 1;
+  bool realtime = false;
+  double progress_s = 600;
+  uint32_t period_us = 15000;
+  uint32_t poll_us = 7500;
+  uint32_t baud = 9600;
+  uint32_t input_ms = 50;
+  uint32_t delay_ms = 2;
+  uint32_t jitter_ms = 3;
+  double drop = 0;
+  double dup = 0;
+  double disconnect_every_s = 0;
+  double mtbf_s = 0;
+  uint32_t outage_ms = 1000;
+};
+
+// Options that scripts may change during the run
+bool set_option(Config& config, const std::string& key, const std::string& value)
+{
+  char* end = nullptr;
+  double number = std::strtod(value.c_str(), &end);
+  if (value.empty() || *end != '\0' || number < 0)
+  {
+    return false;
+  }
+
+  if (key == "period-us" && number >= SETTINGS_PERIOD_MIN_US && number <= SETTINGS_PERIOD_MAX_US)
+  {
+    config.period_us = static_cast<uint32_t>(number);
+  }
+  else if (key == "poll-us" && number >= 1000)
+  {
+    config.poll_us = static_cast<uint32_t>(number);
+  }
+  else if (key == "baud" && number >= SETTINGS_BAUD_MIN && number <= SETTINGS_BAUD_MAX)
+  {
+    config.baud = static_cast<uint32_t>(number);
+  }
+  else if (key == "input-ms" && number >= 1)
+  {
+    config.input_ms = static_cast<uint32_t>(number);
+  }
+  else if (key == "delay-ms")
+  {
+    config.delay_ms = static_cast<uint32_t>(number);
+  }
+  else if (key == "jitter-ms")
+  {
+    config.jitter_ms = static_cast<uint32_t>(number);
+  }
+  else if (key == "drop" && number <= 1)
+  {
+    config.drop = number;
+  }
+  else if (key == "dup" && number <= 1)
+  {
+    config.dup = number;
+  }
+  else if (key == "disconnect-every")
+  {
+    config.disconnect_every_s = number;
+  }
+  else if (key == "mtbf")
+  {
+    config.mtbf_s = number;
+  }
+  else if (key == "outage-ms")
+  {
+    config.outage_ms = static_cast<uint32_t>(number);
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+struct ScriptEntry
+{
+  int64_t at_us;
+  std::string key;
+  std::string value;
+};
+
+bool load_script(const std::string& path, std::vector<ScriptEntry>& script)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+    std::perror(path.c_str());
+    return false;
+  }
+
+  std::string line;
+  Config scratch;
+  for (int number = 1; std::getline(in, line); number++)
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    double seconds;
+    ScriptEntry entry;
+    if (!(fields >> seconds))
+    {
+      continue;
+    }
+    fields >> entry.key >> entry.value;
+    if (seconds < 0 || (entry.key != "disconnect" && !set_option(scratch, entry.key, entry.value)))
+    {
+      std::fprintf(stderr, "%s:%d: expected SECONDS OPTION VALUE or SECONDS disconnect\n", path.c_str(), number);
+      return false;
+    }
+    entry.at_us = static_cast<int64_t>(seconds * 1e6);
+    script.push_back(entry);
+  }
+  return true;
+}
+
+// One step of the console's handshake: subcommand id and its first arguments
+struct Step
+{
+  uint8_t id;
+  uint8_t arg0;
+  uint8_t arg1;
+};
+
+// As recorded from a console pairing a new controller (notes/), ending with
+// the pairing confirmation the firmware waits for
+const Step kHandshake[] = {
+  {0x02, 0x00, 0x00}, {0x08, 0x00, 0x00}, {0x10, 0x00, 0x60}, {0x10, 0x50, 0x60},
+  {0x03, 0x30, 0x00}, {0x04, 0x00, 0x00}, {0x10, 0x80, 0x60}, {0x10, 0x98, 0x60},
+  {0x10, 0x10, 0x80}, {0x10, 0x3D, 0x60}, {0x10, 0x20, 0x60}, {0x40, 0x01, 0x00},
+  {0x48, 0x01, 0x00}, {0x30, 0x01, 0x00}, {0x21, 0x21, 0x00},
+};
+constexpr size_t kHandshakeSteps = sizeof(kHandshake) / sizeof(kHandshake[0]);
+
+// An input change on its way to the console
+struct PendingInput
+{
+  uint8_t bytes[9]; // 0x30 report bytes 2-10
+  int64_t sent_us;
+};
+
+struct Packet
+{
+  uint8_t id;
+  std::vector<uint8_t> data;
+};
+
+// Latency samples of one kind, summarized with the firmware's latency.c
+class Samples
+{
+public:
+  void add(int64_t us) { samples_.push_back(static_cast<uint32_t>(std::min<int64_t>(us, LATENCY_LOST - 1))); }
+  size_t size() const { return samples_.size(); }
+  void clear() { samples_.clear(); }
+
+  latency_summary_t summary() const
+  {
+    std::vector<uint32_t> sorted = samples_;
+    latency_summary_t summary;
+    latency_summarize(sorted.data(), sorted.size(), &summary);
+    return summary;
+  }
+
+private:
+  std::vector<uint32_t> samples_;
+};
+
+void print_summary(const char* name, const Samples& samples, double scale, const char* unit)
+{
+  latency_summary_t s = samples.summary();
+  std::printf("%-10s %8u samples  min %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f  avg %8.1f %s\n", name, s.count,
+              s.min_us / scale, s.p50_us / scale, s.p99_us / scale, s.max_us / scale, s.avg_us / scale, unit);
+}
+
+struct Counters
+{
+  uint64_t live_reports = 0;  // 0x30 reports with input received by the console
+  uint64_t dummy_reports = 0; // short reports before the input mode is set
+  uint64_t replies = 0;       // 0x21 reports received
+  uint64_t lost = 0;          // packets dropped on the link, either direction
+  uint64_t rejected = 0;      // reports refused because the stack queue was full
+  uint64_t subcommands = 0;   // output reports sent by the console
+  uint64_t console_retries = 0;
+  uint64_t duplicates = 0;
+  uint64_t inputs = 0;        // input changes sent by the host
+  uint64_t superseded = 0;    // replaced before a report carried them to the console
+  uint64_t interrupted = 0;   // in flight when the link went down
+  uint64_t connections = 0;
+  uint64_t drops_injected = 0;
+  uint64_t drops_device = 0;  // device gave up on a stalled handshake
+  uint64_t drops_console = 0; // console gave up on unanswered subcommands
+};
+
+class Soak
+{
+public:
+  Soak(const Config& config, const std::vector<ScriptEntry>& script)
+    : config_(config), script_(script), random_(config.seed)
+  {
+    const pairing_config_t pairing_config = {kPairingRetransmitUs, kPairingRetries, kPairingTimeoutUs};
+    settings_default(&device_.settings);
+    device_.settings.report_period_us = config_.period_us;
+    device_init(&device_, &kHooks, this, &pairing_config, nullptr);
+    uart_proto_init(&uart_);
+    host_input_ = device_.input_state;
+  }
+
+  int run()
+  {
+    const int64_t end_us = kStartUs + static_cast<int64_t>(config_.duration_s * 1e6);
+    const auto wall_start = std::chrono::steady_clock::now();
+
+    for (const auto& entry : script_)
+    {
+      at(kStartUs + entry.at_us, [this, entry] { run_script(entry); });
+    }
+    at(kStartUs, [this] { console_connect(); });
+    at(kStartUs, [this] { host_input(); });
+    schedule_disconnect();
+    schedule_failure();
+    if (config_.progress_s > 0)
+    {
+      at(kStartUs + static_cast<int64_t>(config_.progress_s * 1e6), [this] { progress(); });
+    }
+
+    while (!events_.empty() && events_.top().at_us <= end_us)
+    {
+      Event event = events_.top();
+      events_.pop();
+      now_us_ = event.at_us;
+      if (config_.realtime)
+      {
+        std::this_thread::sleep_until(wall_start + std::chrono::microseconds(now_us_ - kStartUs));
+      }
+      event.run();
+    }
+    now_us_ = end_us;
+
+    report();
+    return latency_.size() > 0 ? 0 : 1;
+  }
+
+private:
+  static constexpr int64_t kStartUs = 1000 * 1000; // pairing_t keeps 0 for "never"
+
+  struct Event
+  {
+    int64_t at_us;
+    uint64_t seq;
+    std::function<void()> run;
+
+    bool operator>(const Event& other) const
+    {
+      return at_us != other.at_us ? at_us > other.at_us : seq > other.seq;
+    }
+  };
+
+  void at(int64_t at_us, std::function<void()> run) { events_.push({at_us, next_seq_++, std::move(run)}); }
+
+  // Runs fn only while the connection that scheduled it is still up
+  void on_link(int64_t at_us, std::function<void()> run)
+  {
+    uint64_t epoch = epoch_;
+    at(at_us, [this, epoch, run] {
+      if (epoch == epoch_ && link_up_)
+      {
+        run();
+      }
+    });
+  }
+
+  double uniform() { return std::uniform_real_distribution<double>(0, 1)(random_); }
+
+  int64_t link_delay_us()
+  {
+    return config_.delay_ms * 1000LL + static_cast<int64_t>(uniform() * config_.jitter_ms * 1000);
+  }
+
+  /// Device: device.c the way send_task, esp_bt_hidd_cb and uart_task call it
+
+  // One thread, so no locking; answers to the host over UART are not modeled
+  static void hooks_no_lock(void*) {}
+  static void hooks_send_packet(void*, uint8_t, const uint8_t*, uint8_t) {}
+
+  static void hooks_send_report(void* context, uint8_t id, const uint8_t* data, size_t size)
+  {
+    static_cast<Soak*>(context)->device_send(id, data, size);
+  }
+
+  static constexpr device_hooks_t kHooks = {
+    hooks_no_lock, hooks_no_lock, hooks_send_packet, nullptr, nullptr, nullptr, nullptr, hooks_send_report,
+  };
+
+  // send_task: a report, then pairing_check()
+  void device_report()
+  {
+    uint32_t period = device_send_report(&device_, kIdlePeriodUs);
+    if (device_pairing_check(&device_, now_us_) == PAIRING_POLL_TIMEOUT)
+    {
+      counters_.drops_device++;
+      link_down();
+      return;
+    }
+
+    on_link(now_us_ + period, [this] { device_report(); });
+  }
+
+  // ESP_HIDD_INTR_DATA_EVT
+  void device_output(const std::vector<uint8_t>& data)
+  {
+    subcommand_reply_t reply;
+    device_output_report(&device_, data.data(), data.size(), now_us_, &reply);
+  }
+
+  // esp_bt_hid_device_send_report(): queued until the console polls
+  void device_send(uint8_t id, const uint8_t* data, size_t size)
+  {
+    if (tx_.size() >= kTxQueue)
+    {
+      counters_.rejected++;
+      return;
+    }
+    tx_.push_back({id, std::vector<uint8_t>(data, data + size)});
+  }
+
+  // uart_task receiving one packet
+  void device_uart(const std::vector<uint8_t>& bytes)
+  {
+    for (uint8_t byte : bytes)
+    {
+      if (uart_proto_feed(&uart_, byte) == UART_PROTO_PACKET)
+      {
+        device_uart_packet(&device_, &uart_);
+      }
+    }
+  }
+
+  /// Link
+
+  void console_connect()
+  {
+    epoch_++;
+    link_up_ = true;
+    tx_.clear();
+    counters_.connections++;
+    connected_us_ = now_us_;
+    console_step_ = 0;
+    last_arrival_us_ = now_us_;
+
+    // ESP_HIDD_OPEN_EVT, then send_task sends the first report right away
+    pairing_connected(&device_.pairing, now_us_);
+    device_report();
+    console_poll();
+    console_send_step();
+  }
+
+  void link_down()
+  {
+    if (!link_up_)
+    {
+      return;
+    }
+    link_up_ = false;
+    live_ = false;
+    epoch_++;
+    tx_.clear();
+    if (down_us_ == 0)
+    {
+      down_us_ = now_us_;
+    }
+    counters_.interrupted += pending_.size();
+    pending_.clear();
+
+    // ESP_HIDD_CLOSE_EVT; the timer stops with the link
+    pairing_disconnected(&device_.pairing, now_us_);
+    at(now_us_ + config_.outage_ms * 1000LL, [this] {
+      if (!link_up_)
+      {
+        console_connect();
+      }
+    });
+  }
+
+  void schedule_disconnect()
+  {
+    if (config_.disconnect_every_s <= 0)
+    {
+      return;
+    }
+    at(now_us_ + static_cast<int64_t>(config_.disconnect_every_s * 1e6), [this] {
+      if (link_up_)
+      {
+        counters_.drops_injected++;
+        link_down();
+      }
+      schedule_disconnect();
+    });
+  }
+
+  // Random link loss, exponentially distributed
+  void schedule_failure()
+  {
+    if (config_.mtbf_s <= 0)
+    {
+      return;
+    }
+    double seconds = std::exponential_distribution<double>(1.0 / config_.mtbf_s)(random_);
+    at(now_us_ + static_cast<int64_t>(seconds * 1e6), [this] {
+      if (link_up_)
+      {
+        counters_.drops_injected++;
+        link_down();
+      }
+      schedule_failure();
+    });
+  }
+
+  void run_script(const ScriptEntry& entry)
+  {
+    if (entry.key == "disconnect")
+    {
+      counters_.drops_injected++;
+      link_down();
+      return;
+    }
+    bool rearm_disconnect = entry.key == "disconnect-every" && config_.disconnect_every_s <= 0;
+    bool rearm_failure = entry.key == "mtbf" && config_.mtbf_s <= 0;
+    set_option(config_, entry.key, entry.value);
+    device_.settings.report_period_us = config_.period_us;
+    if (rearm_disconnect)
+    {
+      schedule_disconnect();
+    }
+    if (rearm_failure)
+    {
+      schedule_failure();
+    }
+  }
+
+  /// Console
+
+  // Takes one queued report per poll, the way the console polls the controller
+  void console_poll()
+  {
+    if (!tx_.empty())
+    {
+      Packet packet = std::move(tx_.front());
+      tx_.pop_front();
+      if (uniform() < config_.drop)
+      {
+        counters_.lost++;
+      }
+      else
+      {
+        // The link keeps packets in order, jitter only delays them
+        last_arrival_us_ = std::max(last_arrival_us_, now_us_ + link_delay_us());
+        on_link(last_arrival_us_, [this, packet] { console_receive(packet); });
+      }
+    }
+    on_link(now_us_ + config_.poll_us, [this] { console_poll(); });
+  }
+
+  void console_receive(const Packet& packet)
+  {
+    if (packet.id == 0x21)
+    {
+      counters_.replies++;
+      // data[12] ack, data[13] subcommand id
+      if (console_step_ < kHandshakeSteps && packet.data.size() > 13 &&
+          packet.data[13] == kHandshake[console_step_].id)
+      {
+        console_step_++;
+        console_retries_ = 0;
+        if (console_step_ == kHandshakeSteps)
+        {
+          handshake_.add(now_us_ - connected_us_);
+        }
+        else
+        {
+          console_send_step();
+        }
+      }
+      return;
+    }
+
+    if (packet.data.size() != DEVICE_REPORT_SIZE)
+    {
+      counters_.dummy_reports++;
+      return;
+    }
+    counters_.live_reports++;
+    window_reports_++;
+    live_ = true;
+    if (down_us_ != 0)
+    {
+      recovery_.add(now_us_ - down_us_);
+      down_us_ = 0;
+    }
+
+    // Changes older than the one this report carries were never seen
+    for (size_t i = 0; i < pending_.size(); i++)
+    {
+      if (std::memcmp(&packet.data[2], pending_[i].bytes, sizeof(pending_[i].bytes)) == 0)
+      {
+        latency_.add(now_us_ - pending_[i].sent_us);
+        window_latency_.add(now_us_ - pending_[i].sent_us);
+        counters_.superseded += i;
+        pending_.erase(pending_.begin(), pending_.begin() + i + 1);
+        break;
+      }
+    }
+  }
+
+  void console_send_step()
+  {
+    const Step& step = kHandshake[console_step_];
+    std::vector<uint8_t> data(kOutputReportSize, 0);
+    data[0] = console_counter_++ & 0x0F;
+    data[9] = step.id;
+    data[10] = step.arg0;
+    data[11] = step.arg1;
+    console_output(data);
+    if (uniform() < config_.dup)
+    {
+      counters_.duplicates++;
+      console_output(data);
+    }
+
+    size_t sent_step = console_step_;
+    uint64_t sent_seq = ++console_send_seq_;
+    on_link(now_us_ + kConsoleTimeoutUs, [this, sent_step, sent_seq] {
+      if (console_step_ != sent_step || console_send_seq_ != sent_seq)
+      {
+        return;
+      }
+      if (++console_retries_ > kConsoleRetries)
+      {
+        console_retries_ = 0;
+        counters_.drops_console++;
+        link_down();
+        return;
+      }
+      counters_.console_retries++;
+      console_send_step();
+    });
+  }
+
+  void console_output(const std::vector<uint8_t>& data)
+  {
+    counters_.subcommands++;
+    if (uniform() < config_.drop)
+    {
+      counters_.lost++;
+      return;
+    }
+    on_link(now_us_ + link_delay_us(), [this, data] { device_output(data); });
+  }
+
+  /// Host: input changes over UART
+
+  void host_input()
+  {
+    counters_.inputs++;
+    input_counter_++;
+    host_input_.but1 = input_counter_ & 0x0F; // Y, X, B, A
+    host_input_.lx = static_cast<uint8_t>(input_counter_ * 37);
+    host_input_.ly = static_cast<uint8_t>(input_counter_ >> 8);
+
+    // Changes made while the console cannot see them yet would measure the handshake
+    if (live_)
+    {
+      PendingInput pending;
+      uint8_t report[DEVICE_REPORT_SIZE] = {};
+      profile_encode_report(report, &host_input_);
+      std::memcpy(pending.bytes, &report[2], sizeof(pending.bytes));
+      pending.sent_us = now_us_;
+      pending_.push_back(pending);
+    }
+
+    const uint8_t payload[7] = {host_input_.but1, host_input_.but2, host_input_.but3, host_input_.lx,
+                                host_input_.ly, host_input_.rx, host_input_.ry};
+    std::vector<uint8_t> packet(UART_PROTO_MAX_PACKET);
+    packet.resize(uart_proto_encode(UART_PKT_INPUT_STATE, payload, sizeof(payload), packet.data()));
+    int64_t transfer_us = static_cast<int64_t>(packet.size()) * 10 * 1000000 / config_.baud;
+    at(now_us_ + transfer_us, [this, packet] { device_uart(packet); });
+
+    int64_t next_us = static_cast<int64_t>(config_.input_ms * 1000 * (0.5 + uniform()));
+    at(now_us_ + std::max<int64_t>(next_us, 1), [this] { host_input(); });
+  }
+
+  /// Output
+
+  void progress()
+  {
+    double window_s = config_.progress_s;
+    latency_summary_t s = window_latency_.summary();
+    std::printf("%8.0f s  %7.1f reports/s  latency p50 %6.1f p99 %6.1f max %6.1f ms  connections %llu\n",
+                (now_us_ - kStartUs) / 1e6, window_reports_ / window_s, s.p50_us / 1000.0, s.p99_us / 1000.0,
+                s.max_us / 1000.0, static_cast<unsigned long long>(counters_.connections));
+    std::fflush(stdout);
+    window_reports_ = 0;
+    window_latency_.clear();
+    at(now_us_ + static_cast<int64_t>(config_.progress_s * 1e6), [this] { progress(); });
+  }
+
+  void report()
+  {
+    double seconds = (now_us_ - kStartUs) / 1e6;
+    auto u = [](uint64_t value) { return static_cast<unsigned long long>(value); };
+    const Counters& c = counters_;
+
+    std::printf("simulated %.0f s, report period %u us, poll %u us\n", seconds, config_.period_us, config_.poll_us);
+    std::printf("reports    %llu live (%.1f/s), %llu short, %llu replies, %llu refused by a full queue\n",
+                u(c.live_reports), c.live_reports / seconds, u(c.dummy_reports), u(c.replies), u(c.rejected));
+    std::printf("link       %llu connections, drops: %llu injected, %llu by the device, %llu by the console; "
+                "%llu packets lost\n",
+                u(c.connections), u(c.drops_injected), u(c.drops_device), u(c.drops_console), u(c.lost));
+    std::printf("subcmds    %llu sent, %llu console retries, %llu duplicated\n", u(c.subcommands),
+                u(c.console_retries), u(c.duplicates));
+    std::printf("inputs     %llu sent, %llu superseded, %llu cut by a drop\n", u(c.inputs), u(c.superseded),
+                u(c.interrupted));
+    print_summary("latency", latency_, 1000.0, "ms");
+    print_summary("handshake", handshake_, 1000.0, "ms");
+    print_summary("recovery", recovery_, 1000.0, "ms");
+
+    std::printf("device     state %s, %u retransmits, %u timeouts, %u connections, %u drops, "
+                "first report latency max %u us\n",
+                pairing_state_names[device_.pairing.state], device_.pairing.retransmits, device_.pairing.timeouts,
+                device_.pairing.connections, device_.pairing.drops, device_.pairing.latency_max_us);
+  }
+
+  Config config_;
+  std::vector<ScriptEntry> script_;
+  std::mt19937 random_;
+
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  uint64_t next_seq_ = 0;
+  int64_t now_us_ = kStartUs;
+
+  // device
+  device_t device_ = {};
+  uart_proto_t uart_;
+
+  // link
+  bool link_up_ = false;
+  uint64_t epoch_ = 0;
+  std::deque<Packet> tx_;
+  int64_t last_arrival_us_ = 0;
+  int64_t connected_us_ = 0;
+  int64_t down_us_ = 0; // first drop not yet recovered from
+  bool live_ = false;   // 0x30 reports with input reach the console
+
+  // console
+  size_t console_step_ = 0;
+  int console_retries_ = 0;
+  uint64_t console_send_seq_ = 0;
+  uint8_t console_counter_ = 0;
+
+  // host
+  controller_input_t host_input_;
+  uint32_t input_counter_ = 0;
+  std::deque<PendingInput> pending_;
+
+  Counters counters_;
+  Samples latency_;
+  Samples handshake_;
+  Samples recovery_;
+  Samples window_latency_;
+  uint64_t window_reports_ = 0;
+};
+
+void usage(const char* name)
+{
+  std::fprintf(stderr,
+               "usage: %s [--duration S] [--seed N] [--realtime] [--progress S]\n"
+               "          [--period-us N] [--poll-us N] [--baud N] [--input-ms N]\n"
+               "          [--delay-ms N] [--jitter-ms N] [--drop P] [--dup P]\n"
+               "          [--disconnect-every S] [--mtbf S] [--outage-ms N] [--script FILE]\n",
+               name);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  Config config;
+  std::vector<ScriptEntry> script;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--realtime")
+    {
+      config.realtime = true;
+      continue;
+    }
+    if (arg.compare(0, 2, "--") != 0 || i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+    std::string key = arg.substr(2);
+    std::string value = argv[++i];
+    bool ok = true;
+    if (key == "duration")
+    {
+      config.duration_s = std::atof(value.c_str());
+    }
+    else if (key == "seed")
+    {
+      config.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+    }
+    else if (key == "progress")
+    {
+      config.progress_s = std::atof(value.c_str());
+    }
+    else if (key == "script")
+    {
+      ok = load_script(value, script);
+    }
+    else
+    {
+      ok = set_option(config, key, value);
+    }
+    if (!ok)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::stable_sort(script.begin(), script.end(),
+                   [](const ScriptEntry& a, const ScriptEntry& b) { return a.at_us < b.at_us; });
+  Soak soak(config, script);
+  return soak.run();
+}
@@ -0,0 +1,103 @@
+// Controls the on-device input recorder and prints its dump
+//
+//   nxpad-dump PORT [--baud N] [--start | --stop]
+//
+// Without --start/--stop the recorder is stopped and dumped, and every
+// recorded report is printed as "report: 48 bytes of hex".
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "nxpad/link.hpp"
+#include "nxpad/recording.hpp"
+#include "nxpad/serial_port.hpp"
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "usage: %s PORT [--baud N] [--start | --stop]\n", argv[0]);
+    return 2;
+  }
+
+  std::string path = argv[1];
+  int baud = 9600;
+  uint8_t command = UART_CMD_RECORD_DUMP;
+  for (int i = 2; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+    {
+      baud = std::atoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--start") == 0)
+    {
+      command = UART_CMD_RECORD_START;
+    }
+    else if (std::strcmp(argv[i], "--stop") == 0)
+    {
+      command = UART_CMD_RECORD_STOP;
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s PORT [--baud N] [--start | --stop]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  nxpad::SerialPort port(path, baud);
+  nxpad::Link link(port.fd(), nxpad::Protocol::Packet);
+
+  if (command != UART_CMD_RECORD_DUMP)
+  {
+    link.command(command);
+    link.flush();
+    return 0;
+  }
+
+  std::mutex mutex;
+  std::condition_variable done;
+  nxpad::RecordingReceiver receiver;
+  auto last_packet = std::chrono::steady_clock::now();
+
+  link.on_packet([&](uint8_t type, const uint8_t* payload, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    last_packet = std::chrono::steady_clock::now();
+    if (receiver.feed(type, payload, length))
+    {
+      done.notify_one();
+    }
+  });
+  link.command(UART_CMD_RECORD_DUMP);
+
+  // The dump takes a while at 9600 baud; give up only when the device goes quiet
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!receiver.complete())
+  {
+    if (!done.wait_for(lock, std::chrono::seconds(1), [&] { return receiver.complete(); }) &&
+        std::chrono::steady_clock::now() - last_packet > std::chrono::seconds(3))
+    {
+      std::fprintf(stderr, "no complete dump received\n");
+      return 1;
+    }
+  }
+
+  for (const auto& r : receiver.reports())
+  {
+    std::printf("%u:", r.report);
+    for (uint8_t b : r.data)
+    {
+      std::printf(" %02x", b);
+    }
+    std::printf("\n");
+  }
+
+  std::fprintf(stderr, "%zu reports (%zu stream bytes, %u overwritten), report period %u us%s\n",
+               receiver.reports().size(), receiver.stream_bytes(), receiver.overwritten(), receiver.period_us(),
+               receiver.intact() ? "" : ", DUMP DAMAGED");
+  return receiver.intact() ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// Builds and inspects input movie files
+//
+//   nxpad-movie encode TEXT OUT [--period-us N] [--controller pro|joycon-l|joycon-r]
+//   nxpad-movie print MOVIE
+//
+// TEXT has one state per line, "HOLD but1 but2 but3 lx ly rx ry" with the
+// state bytes in hex and HOLD in reports (decimal); '#' starts a comment.
+// print writes the same format back, one line per record.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "nxpad/movie.hpp"
+
+namespace
+{
+
+void usage(const char* name)
+{
+  std::fprintf(stderr,
+               "usage: %s encode TEXT OUT [--period-us N] [--controller pro|joycon-l|joycon-r]\n"
+               "       %s print MOVIE\n",
+               name, name);
+}
+
+bool parse_controller(const char* name, uint8_t& controller)
+{
+  if (std::strcmp(name, "pro") == 0)
+  {
+    controller = PRO_CON;
+  }
+  else if (std::strcmp(name, "joycon-l") == 0)
+  {
+    controller = JOYCON_L;
+  }
+  else if (std::strcmp(name, "joycon-r") == 0)
+  {
+    controller = JOYCON_R;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+// One text line; false when malformed
+bool parse_line(const std::string& line, uint32_t& hold, nxpad::ControllerState& state)
+{
+  std::istringstream in(line);
+  unsigned long value;
+  if (!(in >> std::dec >> value) || value == 0 || value > 0xFFFFFFFF)
+  {
+    return false;
+  }
+  hold = static_cast<uint32_t>(value);
+
+  uint8_t bytes[7];
+  for (auto& byte : bytes)
+  {
+    if (!(in >> std::hex >> value) || value > 0xFF)
+    {
+      return false;
+    }
+    byte = static_cast<uint8_t>(value);
+  }
+  std::string rest;
+  if (in >> rest)
+  {
+    return false;
+  }
+
+  controller_input_t input = {bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5], bytes[6]};
+  state = nxpad::ControllerState::from_input(input);
+  return true;
+}
+
+int encode(const std::string& text, const std::string& out, uint32_t period_us, uint8_t controller)
+{
+  std::ifstream in(text);
+  if (!in)
+  {
+    std::perror(text.c_str());
+    return 1;
+  }
+
+  nxpad::MovieWriter writer(out, controller, period_us);
+  std::string line;
+  for (int number = 1; std::getline(in, line); number++)
+  {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+    {
+      continue;
+    }
+    uint32_t hold;
+    nxpad::ControllerState state;
+    if (!parse_line(line, hold, state))
+    {
+      std::fprintf(stderr, "%s:%d: expected HOLD but1 but2 but3 lx ly rx ry\n", text.c_str(), number);
+      return 1;
+    }
+    writer.append(state, hold);
+  }
+
+  if (!writer.finish())
+  {
+    std::perror(out.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+int print(const std::string& path)
+{
+  nxpad::MovieReader movie(path);
+  const nxpad::MovieHeader& header = movie.header();
+  std::printf("# controller 0x%02x, period %u us, %u reports\n", header.controller, header.period_us,
+              header.reports);
+
+  nxpad::MovieReader::Cursor cursor = movie.records();
+  nxpad::MovieRecord record;
+  while (cursor.next(record))
+  {
+    controller_input_t input = record.state.to_input();
+    std::printf("%u %02x %02x %02x %02x %02x %02x %02x\n", record.hold, input.but1, input.but2, input.but3,
+                input.lx, input.ly, input.rx, input.ry);
+  }
+  if (cursor.error())
+  {
+    std::fprintf(stderr, "%s: truncated record\n", path.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc == 3 && std::strcmp(argv[1], "print") == 0)
+  {
+    try
+    {
+      return print(argv[2]);
+    }
+    catch (const std::exception& e)
+    {
+      std::fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+  }
+
+  if (argc < 4 || std::strcmp(argv[1], "encode") != 0)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  uint32_t period_us = 0;
+  uint8_t controller = PRO_CON;
+  for (int i = 4; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--period-us") == 0 && i + 1 < argc)
+    {
+      period_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    }
+    else if (std::strcmp(argv[i], "--controller") == 0 && i + 1 < argc && parse_controller(argv[i + 1], controller))
+    {
+      i++;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  try
+  {
+    return encode(argv[2], argv[3], period_us, controller);
+  }
+  catch (const std::exception& e)
+  {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,119 @@
+// Plays an input movie on the device
+//
+//   nxpad-play PORT MOVIE [--baud N] [--lead N] [--force]
+//
+// Every movie record goes into the device input schedule for its exact
+// report, LEAD reports (default 8) after the first clock answer. A movie
+// made for another report period or controller type is refused unless
+// --force is given. Prints the start report and the player counters when
+// the movie is over.
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include "nxpad/link.hpp"
+#include "nxpad/movie.hpp"
+#include "nxpad/serial_port.hpp"
+
+namespace
+{
+
+std::atomic<bool> running(true);
+
+void stop(int)
+{
+  running = false;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::fprintf(stderr, "usage: %s PORT MOVIE [--baud N] [--lead N] [--force]\n", argv[0]);
+    return 2;
+  }
+
+  int baud = 9600;
+  uint32_t lead = 8;
+  bool force = false;
+  for (int i = 3; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+    {
+      baud = std::atoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--lead") == 0 && i + 1 < argc)
+    {
+      lead = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    }
+    else if (std::strcmp(argv[i], "--force") == 0)
+    {
+      force = true;
+    }
+  }
+
+  try
+  {
+    nxpad::MovieReader movie(argv[2]);
+    nxpad::SerialPort port(argv[1], baud);
+    nxpad::Link link(port.fd(), nxpad::Protocol::Packet);
+    nxpad::MoviePlayer player(link, movie);
+    player.set_lead(lead);
+
+    // A period of 0 in the movie or a controller type of 0 from older
+    // firmware is not checked
+    const nxpad::MovieHeader& header = movie.header();
+    nxpad::ReportClock clock;
+    if (!player.fresh_clock(clock))
+    {
+      std::fprintf(stderr, "device does not answer clock requests\n");
+      return 1;
+    }
+    bool mismatch = false;
+    if (header.period_us != 0 && clock.period_us != header.period_us)
+    {
+      std::fprintf(stderr, "movie made for %u us reports, device runs at %u us\n", header.period_us,
+                   clock.period_us);
+      mismatch = true;
+    }
+    if (clock.controller != 0 && clock.controller != header.controller)
+    {
+      std::fprintf(stderr, "movie made for controller 0x%02x, device is 0x%02x\n", header.controller,
+                   clock.controller);
+      mismatch = true;
+    }
+    if (mismatch && !force)
+    {
+      std::fprintf(stderr, "not playing, use --force to play anyway\n");
+      return 1;
+    }
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    // Stopped early, entries already queued on the device still play out
+    // and the input is released after them
+    bool done = player.play(running);
+
+    nxpad::MoviePlayerStats stats = player.stats();
+    std::printf("start report %u, %u reports, %u entries, %u late, %u clock requests\n", stats.start_report,
+                movie.header().reports, stats.entries, stats.late, stats.clock_requests);
+    if (!done && running)
+    {
+      std::fprintf(stderr, "device stopped answering or the movie is truncated\n");
+    }
+    return done ? 0 : 1;
+  }
+  catch (const std::exception& e)
+  {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,304 @@
+// Device stand-in on a pseudo terminal
+//
+// Runs the firmware's UART decoder, command dispatch and report path
+// (device.c) against a pty so host tools can be exercised without an ESP32.
+// A console that has set the input mode and enabled the IMU is assumed, so
+// device_send_report() builds the full report every period just like
+// send_task, and every command and packet is answered by the same code as on
+// the device. Settings and macros are kept in RAM only.
+//
+//   nxpad-standin [--period-us N] [--trace] [--record FILE]
+//
+// --record saves every received byte, for replay with nxpad-bench --stream.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "nxpad/firmware.hpp"
+
+namespace
+{
+
+std::atomic<bool> running(true);
+
+// Kconfig defaults of the pairing options
+constexpr int64_t kPairingRetransmitUs = 300 * 1000;
+constexpr uint8_t kPairingRetries = 3;
+constexpr int64_t kPairingTimeoutUs = 10 * 1000 * 1000;
+
+// DUMMY_PERIOD_US in main.c with the default CONFIG_FREERTOS_HZ of 100
+constexpr uint32_t kIdlePeriodUs = 100 * 10 * 1000;
+
+struct Standin
+{
+  std::mutex mutex;
+  int fd = -1;
+  device_t device;
+  recorder_t recorder;
+  recorder_entry_t recorder_storage[256];
+  std::chrono::steady_clock::time_point baud_deadline;
+  bool trace = false;
+  uint8_t traced[9] = {0}; // buttons and sticks of the last traced report
+
+  uint64_t frames = 0;
+  uint64_t packets = 0;
+  uint64_t commands = 0;
+  uint64_t rejected = 0;
+};
+
+/// device_hooks: settings and macros are kept in RAM, the pty has no baud rate,
+/// reports only go to the --trace output
+
+void hooks_lock(void* context)
+{
+  static_cast<Standin*>(context)->mutex.lock();
+}
+
+void hooks_unlock(void* context)
+{
+  static_cast<Standin*>(context)->mutex.unlock();
+}
+
+void hooks_send_packet(void* context, uint8_t type, const uint8_t* payload, uint8_t length)
+{
+  uint8_t packet[UART_PROTO_MAX_PACKET];
+  size_t size = uart_proto_encode(type, payload, length, packet);
+  if (::write(static_cast<Standin*>(context)->fd, packet, size) < 0)
+  {
+    std::perror("write");
+  }
+}
+
+void hooks_baud_change(void* context, uint32_t)
+{
+  static_cast<Standin*>(context)->baud_deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(DEVICE_BAUD_CONFIRM_MS);
+}
+
+// --trace prints the buttons and sticks of every 0x30 report that changed them
+void hooks_send_report(void* context, uint8_t id, const uint8_t* data, size_t size)
+{
+  Standin* standin = static_cast<Standin*>(context);
+  if (!standin->trace || id != 0x30 || size < 11 || std::memcmp(standin->traced, &data[2], 9) == 0)
+  {
+    return;
+  }
+  // report_count has already moved on to the next report
+  std::printf("%u: %02x %02x %02x  %02x %02x %02x %02x %02x %02x\n", standin->device.report_count - 1, data[2],
+              data[3], data[4], data[5], data[6], data[7], data[8], data[9], data[10]);
+  std::fflush(stdout);
+  std::memcpy(standin->traced, &data[2], 9);
+}
+
+const device_hooks_t kHooks = {
+  hooks_lock, hooks_unlock, hooks_send_packet, nullptr, nullptr, hooks_baud_change, nullptr, hooks_send_report,
+};
+
+int64_t now_us()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The part of the handshake the report path depends on: device info, input
+// report mode 0x30 and the IMU switched on
+void connect_console(device_t* device)
+{
+  static const uint8_t requests[][2] = {{0x02, 0x00}, {0x03, 0x30}, {0x40, 0x01}};
+
+  pairing_connected(&device->pairing, now_us());
+  for (const auto& request : requests)
+  {
+    uint8_t data[SUBCOMMAND_MIN_LENGTH] = {0};
+    data[9] = request[0];
+    data[10] = request[1];
+    subcommand_reply_t reply;
+    device_output_report(device, data, sizeof(data), now_us(), &reply);
+  }
+}
+
+void reader(Standin& standin, std::FILE* record)
+{
+  device_t* device = &standin.device;
+  uart_proto_t proto;
+  uart_proto_init(&proto);
+  uint8_t buffer[256];
+
+  while (running)
+  {
+    // baud_check() in main.c
+    if (device->baud_pending != 0 && std::chrono::steady_clock::now() > standin.baud_deadline)
+    {
+      std::fprintf(stderr, "baud %u not confirmed, back to %u\n", device->baud_pending, device->settings.baud);
+      device->baud_pending = 0;
+    }
+
+    pollfd pfd = {standin.fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 100) <= 0 || !(pfd.revents & POLLIN))
+    {
+      // Quiet line, as uart_task sees it
+      uart_proto_idle(&proto);
+      continue;
+    }
+
+    ssize_t n = ::read(standin.fd, buffer, sizeof(buffer));
+    if (record != nullptr && n > 0)
+    {
+      std::fwrite(buffer, 1, static_cast<size_t>(n), record);
+    }
+    for (ssize_t i = 0; i < n; i++)
+    {
+      switch (uart_proto_feed(&proto, buffer[i]))
+      {
+      case UART_PROTO_FRAME:
+        standin.frames++;
+        device_uart_frame(device, proto.frame);
+        break;
+      case UART_PROTO_COMMAND:
+        standin.commands++;
+        device_uart_command(device, proto.command);
+        break;
+      case UART_PROTO_PACKET:
+        standin.packets++;
+        if (!device_uart_packet(device, &proto))
+        {
+          standin.rejected++;
+          std::fprintf(stderr, "rejected packet type 0x%02x, length %d\n", proto.type, proto.length);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  std::fprintf(stderr, "uart: %llu frames, %llu packets, %llu commands, %u malformed, %llu rejected\n",
+               static_cast<unsigned long long>(standin.frames), static_cast<unsigned long long>(standin.packets),
+               static_cast<unsigned long long>(standin.commands), static_cast<unsigned>(proto.errors),
+               static_cast<unsigned long long>(standin.rejected));
+}
+
+// send_task: a report, then the pairing check, on the period device.c returns
+void reporter(Standin& standin)
+{
+  device_t* device = &standin.device;
+  auto next = std::chrono::steady_clock::now();
+
+  while (running)
+  {
+    uint32_t period = device_send_report(device, kIdlePeriodUs);
+    device_pairing_check(device, now_us());
+    {
+      std::lock_guard<std::mutex> lock(standin.mutex);
+      device->report_period_us = period;
+    }
+    next += std::chrono::microseconds(period);
+    std::this_thread::sleep_until(next);
+  }
+
+  std::lock_guard<std::mutex> lock(standin.mutex);
+  std::fprintf(stderr, "reports: %u, schedule late %u, overflows %u\n", device->report_count,
+               static_cast<unsigned>(device->schedule.late), static_cast<unsigned>(device->schedule.overflows));
+}
+
+void stop(int)
+{
+  running = false;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  Standin standin;
+  device_t* device = &standin.device;
+  settings_default(&device->settings);
+  std::FILE* record = nullptr;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--period-us") == 0 && i + 1 < argc)
+    {
+      device->settings.report_period_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    }
+    else if (std::strcmp(argv[i], "--trace") == 0)
+    {
+      standin.trace = true;
+    }
+    else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+    {
+      record = std::fopen(argv[++i], "wb");
+      if (record == nullptr)
+      {
+        std::perror(argv[i]);
+        return 1;
+      }
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s [--period-us N] [--trace] [--record FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!settings_valid(&device->settings))
+  {
+    std::fprintf(stderr, "period must be %u to %u us\n", SETTINGS_PERIOD_MIN_US, SETTINGS_PERIOD_MAX_US);
+    return 2;
+  }
+
+  int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0)
+  {
+    std::perror("posix_openpt");
+    return 1;
+  }
+  std::string path = ::ptsname(master);
+
+  // Keep one slave handle open so the master does not see hangups between clients
+  int slave = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+  termios tio;
+  if (slave < 0 || ::tcgetattr(slave, &tio) != 0)
+  {
+    std::perror(path.c_str());
+    return 1;
+  }
+  ::cfmakeraw(&tio);
+  ::tcsetattr(slave, TCSANOW, &tio);
+
+  standin.fd = master;
+  const pairing_config_t pairing_config = {kPairingRetransmitUs, kPairingRetries, kPairingTimeoutUs};
+  recorder_init(&standin.recorder, standin.recorder_storage, 256);
+  device_init(device, &kHooks, &standin, &pairing_config, &standin.recorder);
+  connect_console(device);
+
+  std::signal(SIGINT, stop);
+  std::signal(SIGTERM, stop);
+
+  std::fprintf(stderr, "device stand-in on %s, report period %u us\n", path.c_str(), device->settings.report_period_us);
+  std::printf("%s\n", path.c_str());
+  std::fflush(stdout);
+
+  std::thread uart(reader, std::ref(standin), record);
+  reporter(standin);
+  uart.join();
+
+  if (record != nullptr)
+  {
+    std::fclose(record);
+  }
+  ::close(slave);
+  ::close(master);
+  return 0;
+}
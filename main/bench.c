@@ -0,0 +1,218 @@
+// Hot path benchmark: per-frame, per-report and per-subcommand work
+
+#include "bench.h"
+
+#include <string.h>
+
+#include "imu.h"
+#include "little_endian.h"
+#include "macro.h"
+#include "profile.h"
+#include "recorder.h"
+#include "schedule.h"
+#include "subcommand.h"
+#include "uart_proto.h"
+
+#define BENCH_REPORTS_PER_ROUND 1024
+#define BENCH_SUBCOMMAND_ROUNDS 64
+
+const char* const bench_path_names[BENCH_COUNT] = { "frame", "report", "subcommand" };
+
+// Subcommands of a full pairing, as data[9], data[10], data[11]; the last one is unknown
+static const uint8_t subcommands[][3] = {
+  { 0x02, 0x00, 0x00 }, { 0x08, 0x00, 0x00 }, { 0x10, 0x00, 0x60 }, { 0x10, 0x50, 0x60 },
+  { 0x03, 0x30, 0x00 }, { 0x04, 0x00, 0x00 }, { 0x10, 0x80, 0x60 }, { 0x10, 0x98, 0x60 },
+  { 0x10, 0x10, 0x80 }, { 0x10, 0x3D, 0x60 }, { 0x10, 0x20, 0x60 }, { 0x40, 0x01, 0x00 },
+  { 0x48, 0x01, 0x00 }, { 0x22, 0x01, 0x00 }, { 0x30, 0x01, 0x00 }, { 0x21, 0x21, 0x00 },
+  { 0x38, 0x00, 0x00 },
+};
+
+#define SUBCOMMAND_COUNT (sizeof(subcommands) / sizeof(subcommands[0]))
+
+static uart_proto_t proto;
+static schedule_t schedule;
+static macro_engine_t macro;
+static imu_stream_t imu;
+static recorder_entry_t recorder_storage[64];
+static recorder_t recorder;
+
+// Keeps results observable so the work is not optimized away
+static volatile uint32_t sink;
+
+static uint32_t next_random(uint32_t* seed)
+{
+  *seed = *seed * 1664525u + 1013904223u;
+  return *seed >> 8;
+}
+
+size_t bench_synth_stream(uint8_t* out, size_t size, uint32_t seed)
+{
+  static const uint8_t sticks[] = { 0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0A };
+  size_t n = 0;
+
+  while (n + UART_PROTO_MAX_PACKET <= size)
+  {
+    uint32_t r = next_random(&seed);
+
+    if ((r & 0x0F) == 0)
+    {
+      // analog input state packet
+      uint8_t payload[7];
+      for (int i = 0; i < 7; i++)
+      {
+        payload[i] = next_random(&seed) & 0xFF;
+      }
+      n += uart_proto_encode(UART_PKT_INPUT_STATE, payload, sizeof(payload), &out[n]);
+    }
+    else if ((r & 0x3F) == 1)
+    {
+      out[n++] = UART_CMD_COMBO_STOP;
+    }
+    else
+    {
+      // legacy frame, mostly idle with occasional buttons like a real capture
+      memset(&out[n], UART_PROTO_FRAME_SYNC, 5);
+      out[n + 5] = ((r >> 10) & 1) ? ((r >> 4) & 0x3F) : 0x00;
+      out[n + 6] = ((r >> 11) & 1) ? ((r >> 12) & 0x3F) : 0x00;
+      out[n + 7] = ((r >> 18) & 1) ? ((r >> 19) % 9) : A_DPAD_CENTER;
+      out[n + 8] = sticks[(r >> 23) % 9];
+      out[n + 9] = sticks[(r >> 27) % 9];
+      out[n + 10] = 0x00;
+      n += INPUT_FRAME_SIZE;
+    }
+  }
+
+  return n;
+}
+
+// uart_task: decode, then store the result as the live input
+static uint32_t run_frames(const uint8_t* stream, size_t size, controller_input_t* state)
+{
+  uint32_t items = 0;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    switch (uart_proto_feed(&proto, stream[i]))
+    {
+    case UART_PROTO_FRAME:
+    {
+      controller_input_t input;
+      if (input_decode_frame(proto.frame, &input))
+      {
+        *state = input;
+      }
+      items++;
+      break;
+    }
+    case UART_PROTO_PACKET:
+      if (proto.type == UART_PKT_INPUT_STATE && proto.length == 7)
+      {
+        schedule_decode_input(proto.payload, state);
+      }
+      items++;
+      break;
+    case UART_PROTO_COMMAND:
+      if (proto.command == UART_CMD_COMBO_STOP)
+      {
+        macro_trigger(&macro, MACRO_STOP);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  return items;
+}
+
+// send_buttons, without the Bluetooth send
+static void run_reports(controller_input_t* state, uint32_t first, uint8_t* report)
+{
+  for (uint32_t count = first; count < first + BENCH_REPORTS_PER_ROUND; count++)
+  {
+    controller_input_t output;
+
+    schedule_apply(&schedule, count, state);
+    macro_apply(&macro, state, &output);
+    report[0] = count & 0xFF;
+    profile_encode_report(report, &output);
+    imu_fill_report(&imu, report);
+    recorder_record(&recorder, count, report);
+    sink += report[3];
+  }
+}
+
+// esp_bt_hidd_cb INTR_DATA, without the Bluetooth send
+static uint32_t run_subcommands(const uint8_t* report)
+{
+  uint8_t data[48] = { 0 };
+  uint8_t reply_buffer[SUBCOMMAND_REPLY_MAX];
+
+  for (uint32_t round = 0; round < BENCH_SUBCOMMAND_ROUNDS; round++)
+  {
+    for (size_t i = 0; i < SUBCOMMAND_COUNT; i++)
+    {
+      subcommand_reply_t reply;
+
+      memcpy(&data[9], subcommands[i], 3);
+      if (subcommand_lookup(data, sizeof(data), &reply))
+      {
+        sink += subcommand_build_reply(report, &reply, reply_buffer);
+      }
+    }
+  }
+
+  return BENCH_SUBCOMMAND_ROUNDS * SUBCOMMAND_COUNT;
+}
+
+void bench_run(bench_clock_t clock, const uint8_t* stream, size_t size, uint32_t rounds,
+               bench_result_t results[BENCH_COUNT])
+{
+  static const uint8_t turbo[] = { 0, 0x08, 0x00, 0x00, 1, 1 }; // A every other report
+  uint8_t report[48] = { 0 };
+  controller_input_t state;
+
+  memset(results, 0, sizeof(bench_result_t) * BENCH_COUNT);
+  uart_proto_init(&proto);
+  uart_proto_idle(&proto); // the stream starts on a boundary
+  schedule_init(&schedule);
+  macro_init(&macro);
+  macro_set_turbo(&macro.config, turbo, sizeof(turbo));
+  imu_init(&imu);
+  imu_set_source(&imu, IMU_SOURCE_SHAKE);
+  recorder_init(&recorder, recorder_storage, 64);
+  recorder_start(&recorder);
+  input_reset(&state);
+
+  for (uint32_t round = 0; round < rounds; round++)
+  {
+    uint32_t start = clock();
+    uint32_t items = run_frames(stream, size, &state);
+    results[BENCH_FRAME].ticks += (uint32_t)(clock() - start);
+    results[BENCH_FRAME].items += items;
+
+    // a few scheduled inputs per round keep the schedule path warm
+    uint32_t first = round * BENCH_REPORTS_PER_ROUND;
+    uint8_t entries[4 * SCHEDULE_ENTRY_SIZE];
+    for (int i = 0; i < 4; i++)
+    {
+      uint8_t* p = &entries[i * SCHEDULE_ENTRY_SIZE];
+      uint32_t at = first + i * (BENCH_REPORTS_PER_ROUND / 4);
+      le_put_u32(p, at);
+      memset(&p[4], 0, 3);
+      memset(&p[7], 0x80, 4);
+      p[4] = 1 << i;
+    }
+    schedule_push_packet(&schedule, entries, sizeof(entries));
+
+    start = clock();
+    run_reports(&state, first, report);
+    results[BENCH_REPORT].ticks += (uint32_t)(clock() - start);
+    results[BENCH_REPORT].items += BENCH_REPORTS_PER_ROUND;
+
+    start = clock();
+    items = run_subcommands(report);
+    results[BENCH_SUBCOMMAND].ticks += (uint32_t)(clock() - start);
+    results[BENCH_SUBCOMMAND].items += items;
+  }
+}
@@ -0,0 +1,45 @@
+// Hot path benchmark: per-frame, per-report and per-subcommand work
+//
+// Each workload runs the same module calls, in the same order, as the
+// firmware path it stands for (uart_task, send_buttons, esp_bt_hidd_cb),
+// minus the RTOS and Bluetooth calls. The caller supplies the clock, so the
+// same code is timed with a nanosecond clock on the host (host/bench) and
+// with the CPU cycle counter on target (CONFIG_UARTNX_BENCH).
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input.h"
+
+typedef enum
+{
+  BENCH_FRAME = 0, // uart_proto_feed + frame decode / INPUT_STATE apply, per frame or packet
+  BENCH_REPORT,    // schedule + macro + profile encode + IMU fill + recorder, per report
+  BENCH_SUBCOMMAND,// reply lookup + reply build, per subcommand
+  BENCH_COUNT,
+} bench_path_t;
+
+typedef struct
+{
+  uint32_t items;
+  uint64_t ticks;
+} bench_result_t;
+
+// Free running counter; only differences are used, wrap-around is fine
+// as long as one round takes less than a full wrap.
+typedef uint32_t (*bench_clock_t)(void);
+
+extern const char* const bench_path_names[BENCH_COUNT];
+
+// Writes a synthetic UART stream of legacy frames with input packets and
+// commands mixed in. Returns the number of bytes written.
+size_t bench_synth_stream(uint8_t* out, size_t size, uint32_t seed);
+
+// Runs every path `rounds` times. The frame path decodes stream[0..size).
+void bench_run(bench_clock_t clock, const uint8_t* stream, size_t size, uint32_t rounds,
+               bench_result_t results[BENCH_COUNT]);
+
+#endif
@@ -1,4 +1,6 @@
 #
 # "main" pseudo-component makefile.
 #
-# (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
\ No newline at end of file
+# (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
+
+COMPONENT_ADD_LDFRAGMENTS += linker.lf
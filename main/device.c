@@ -0,0 +1,408 @@
+// Device core shared by the firmware and the host stand-ins
+
+#include "device.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+#include "profile.h"
+
+static void device_lock(device_t* device)
+{
+  device->hooks->lock(device->context);
+}
+
+static void device_unlock(device_t* device)
+{
+  device->hooks->unlock(device->context);
+}
+
+static void device_send(device_t* device, uint8_t type, const uint8_t* payload, uint8_t length)
+{
+  device->hooks->send_packet(device->context, type, payload, length);
+}
+
+static const uint8_t report30_init[DEVICE_REPORT_SIZE] = {[0] = 0x00, [1] = 0x8E, [11] = 0x80};
+static const uint8_t dummy_init[DEVICE_DUMMY_SIZE] = {
+  0x00, 0x8E, 0x00, 0x00, 0x00, PROFILE_LSTICK_IDLE, PROFILE_RSTICK_IDLE,
+};
+
+void device_init(device_t* device, const device_hooks_t* hooks, void* context,
+                 const pairing_config_t* pairing_config, recorder_t* recorder)
+{
+  device->hooks = hooks;
+  device->context = context;
+  input_reset(&device->input_state);
+  schedule_init(&device->schedule);
+  macro_init(&device->macro);
+  imu_init(&device->imu);
+  pairing_init(&device->pairing, pairing_config);
+  device->recorder = recorder;
+  device->report_count = 0;
+  device->report_period_us = 0;
+  memcpy(device->report30, report30_init, DEVICE_REPORT_SIZE);
+  memcpy(device->dummy, dummy_init, DEVICE_DUMMY_SIZE);
+  device->imu_enabled = false;
+  device->baud_pending = 0;
+  device->stats_streaming = false;
+  device->stats_requested = false;
+  subcommand_set_colors(device->settings.colors);
+}
+
+void device_send_settings(device_t* device)
+{
+  uint8_t payload[SETTINGS_ENCODED_SIZE];
+
+  device_lock(device);
+  settings_encode(&device->settings, payload);
+  device_unlock(device);
+  device_send(device, UART_PKT_SETTINGS, payload, sizeof(payload));
+}
+
+void device_send_pairing(device_t* device)
+{
+  uint8_t payload[PAIRING_ENCODED_SIZE];
+
+  device_lock(device);
+  pairing_encode(&device->pairing, payload);
+  device_unlock(device);
+  device_send(device, UART_PKT_PAIRING, payload, sizeof(payload));
+}
+
+// Stops recording and streams the ring: RECORD_INFO, RECORD_DATA chunks, RECORD_END.
+// The report path only checks the stopped flag meanwhile.
+static void device_recorder_dump(device_t* device)
+{
+  // One UART side per device, kept off its small stack
+  static uint8_t payload[UART_PROTO_MAX_PAYLOAD];
+  static recorder_cursor_t cursor;
+  recorder_t* recorder = device->recorder;
+
+  device_lock(device);
+  recorder_stop(recorder);
+  device_unlock(device);
+
+  recorder_dump_begin(recorder, &cursor);
+  le_put_u32(&payload[0], recorder_first(recorder));
+  le_put_u32(&payload[4], recorder_count(recorder));
+  le_put_u32(&payload[8], recorder_overwritten(recorder));
+  le_put_u32(&payload[12], device->settings.report_period_us);
+  device_send(device, UART_PKT_RECORD_INFO, payload, 16);
+
+  uint16_t seq = 0;
+  uint32_t bytes = 0;
+  size_t size;
+  while ((size = recorder_dump_next(recorder, &cursor, &payload[2], UART_PROTO_MAX_PAYLOAD - 2)) > 0)
+  {
+    le_put_u16(&payload[0], seq);
+    device_send(device, UART_PKT_RECORD_DATA, payload, size + 2);
+    seq++;
+    bytes += size;
+  }
+
+  le_put_u16(&payload[0], seq);
+  le_put_u32(&payload[2], bytes);
+  device_send(device, UART_PKT_RECORD_END, payload, 6);
+}
+
+// Announces the new rate at the old one, then lets the platform switch
+static void device_baud_change(device_t* device, uint32_t baud)
+{
+  uint8_t payload[6];
+
+  le_put_u32(&payload[0], baud);
+  le_put_u16(&payload[4], DEVICE_BAUD_CONFIRM_MS);
+  device_send(device, UART_PKT_BAUD_PENDING, payload, sizeof(payload));
+
+  if (device->hooks->baud_change != NULL)
+  {
+    device->hooks->baud_change(device->context, baud);
+  }
+  device->baud_pending = baud;
+}
+
+// Validates one UART_PKT_SETTING_SET and applies what can change live
+static bool device_setting_set(device_t* device, const uint8_t* payload, uint8_t length)
+{
+  settings_t updated = device->settings;
+
+  if (!settings_set(&updated, payload, length))
+  {
+    return false;
+  }
+
+  if (payload[0] == SETTING_BAUD)
+  {
+    device_baud_change(device, updated.baud);
+    return true;
+  }
+  if (device->hooks->setting_changed != NULL)
+  {
+    device->hooks->setting_changed(device->context, payload[0], &updated);
+  }
+
+  device_lock(device);
+  device->settings = updated;
+  if (payload[0] == SETTING_COLORS)
+  {
+    subcommand_set_colors(device->settings.colors);
+  }
+  device_unlock(device);
+
+  device_send_settings(device);
+  return true;
+}
+
+void device_uart_frame(device_t* device, const uint8_t* frame)
+{
+  controller_input_t input;
+
+  if (input_decode_frame(frame, &input))
+  {
+    device_lock(device);
+    device->input_state = input;
+    device_unlock(device);
+  }
+}
+
+void device_uart_command(device_t* device, uint8_t command)
+{
+  if (command >= UART_CMD_COMBO_BASE && command < UART_CMD_COMBO_BASE + MACRO_COMBO_SLOTS)
+  {
+    device_lock(device);
+    macro_trigger(&device->macro, command - UART_CMD_COMBO_BASE);
+    device_unlock(device);
+  }
+  else if (command == UART_CMD_COMBO_STOP)
+  {
+    device_lock(device);
+    macro_trigger(&device->macro, MACRO_STOP);
+    device_unlock(device);
+  }
+  else if (command == UART_CMD_STATS_ONCE)
+  {
+    device->stats_requested = true;
+  }
+  else if (command == UART_CMD_STATS_STREAM_ON || command == UART_CMD_STATS_STREAM_OFF)
+  {
+    device->stats_streaming = (command == UART_CMD_STATS_STREAM_ON);
+  }
+  else if (command == UART_CMD_CLOCK)
+  {
+    uint8_t payload[11];
+
+    device_lock(device);
+    uint32_t report = device->report_count;
+    uint32_t period = device->report_period_us;
+    uint16_t free = schedule_free(&device->schedule);
+    device_unlock(device);
+
+    le_put_u32(&payload[0], report);
+    le_put_u32(&payload[4], period);
+    le_put_u16(&payload[8], free);
+    payload[10] = CONTROLLER_TYPE;
+    device_send(device, UART_PKT_CLOCK, payload, sizeof(payload));
+  }
+  else if ((command == UART_CMD_RECORD_START || command == UART_CMD_RECORD_STOP) && device->recorder != NULL)
+  {
+    device_lock(device);
+    if (command == UART_CMD_RECORD_START)
+    {
+      recorder_start(device->recorder);
+    }
+    else
+    {
+      recorder_stop(device->recorder);
+    }
+    device_unlock(device);
+  }
+  else if (command == UART_CMD_RECORD_DUMP && device->recorder != NULL)
+  {
+    device_recorder_dump(device);
+  }
+  else if (command == UART_CMD_PAIRING)
+  {
+    device_send_pairing(device);
+  }
+  else if (command == UART_CMD_SETTINGS_GET)
+  {
+    device_send_settings(device);
+  }
+  else if (command == UART_CMD_SETTINGS_SAVE)
+  {
+    if (device->hooks->settings_save != NULL)
+    {
+      device->hooks->settings_save(device->context);
+    }
+  }
+  else if (command == UART_CMD_BAUD_CONFIRM && device->baud_pending != 0)
+  {
+    device_lock(device);
+    device->settings.baud = device->baud_pending;
+    device_unlock(device);
+    device->baud_pending = 0;
+    device_send_settings(device);
+  }
+  else if (command >= UART_CMD_IMU_BASE && command <= UART_CMD_IMU_LAST)
+  {
+    device_lock(device);
+    imu_set_source(&device->imu, (imu_source_t)(command - UART_CMD_IMU_BASE));
+    device_unlock(device);
+  }
+}
+
+bool device_uart_packet(device_t* device, const uart_proto_t* proto)
+{
+  bool ok = true;
+
+  switch (proto->type)
+  {
+  case UART_PKT_TURBO_SET:
+    device_lock(device);
+    ok = macro_set_turbo(&device->macro.config, proto->payload, proto->length);
+    device_unlock(device);
+    break;
+  case UART_PKT_COMBO_SET:
+    device_lock(device);
+    ok = macro_set_combo(&device->macro.config, proto->payload, proto->length);
+    device_unlock(device);
+    break;
+  case UART_PKT_MACRO_SAVE:
+    if (proto->length != 0)
+    {
+      ok = false;
+      break;
+    }
+    if (device->hooks->macro_save != NULL)
+    {
+      device->hooks->macro_save(device->context);
+    }
+    break;
+  case UART_PKT_INPUT_STATE:
+    if (proto->length != 7)
+    {
+      ok = false;
+      break;
+    }
+    device_lock(device);
+    schedule_decode_input(proto->payload, &device->input_state);
+    device_unlock(device);
+    break;
+  case UART_PKT_SCHEDULE:
+    device_lock(device);
+    ok = schedule_push_packet(&device->schedule, proto->payload, proto->length);
+    device_unlock(device);
+    break;
+  case UART_PKT_SETTING_SET:
+    ok = device_setting_set(device, proto->payload, proto->length);
+    break;
+  case UART_PKT_IMU_SAMPLES:
+    device_lock(device);
+    ok = imu_push_packet(&device->imu, proto->payload, proto->length);
+    device_unlock(device);
+    break;
+  default:
+    ok = false;
+    break;
+  }
+
+  return ok;
+}
+
+uint32_t device_send_report(device_t* device, uint32_t idle_period_us)
+{
+  controller_input_t output;
+
+  device_lock(device);
+  bool live = pairing_live(&device->pairing);
+  bool connected = device->pairing.state != PAIRING_DISCOVERABLE;
+  // host inputs scheduled for this report replace the live state first
+  schedule_apply(&device->schedule, device->report_count, &device->input_state);
+  // turbo and combos are evaluated here so they step exactly once per report
+  macro_apply(&device->macro, &device->input_state, &output);
+  // The timer byte is the low byte of the report number.
+  // Apparently, it can be used to detect packet loss/excess latency
+  device->report30[0] = device->report_count & 0xFF;
+  device->dummy[0] = device->report_count & 0xFF;
+  profile_encode_report(device->report30, &output);
+  if (device->imu_enabled)
+  {
+    imu_fill_report(&device->imu, device->report30);
+  }
+  if (live && device->recorder != NULL)
+  {
+    recorder_record(device->recorder, device->report_count, device->report30);
+  }
+  device->report_count++;
+  uint32_t period = connected ? device->settings.report_period_us : idle_period_us;
+  device_unlock(device);
+
+  if (device->hooks->send_report == NULL)
+  {
+    return period;
+  }
+  if (live)
+  {
+    device->hooks->send_report(device->context, 0x30, device->report30, DEVICE_REPORT_SIZE);
+  }
+  else
+  {
+    device->hooks->send_report(device->context, 0x30, device->dummy, DEVICE_DUMMY_SIZE);
+  }
+  return period;
+}
+
+// Replies start with the bytes of the last input report, so they are built under the lock
+static void device_send_reply(device_t* device, const subcommand_reply_t* reply)
+{
+  uint8_t buffer[SUBCOMMAND_REPLY_MAX];
+
+  if (device->hooks->send_report == NULL)
+  {
+    return;
+  }
+  device_lock(device);
+  size_t size = subcommand_build_reply(device->report30, reply, buffer);
+  device_unlock(device);
+  device->hooks->send_report(device->context, 0x21, buffer, size);
+}
+
+pairing_poll_t device_pairing_check(device_t* device, int64_t now_us)
+{
+  device_lock(device);
+  pairing_report_sent(&device->pairing, now_us);
+  pairing_poll_t poll = pairing_poll(&device->pairing, now_us);
+  subcommand_reply_t reply = device->pairing.last_reply;
+  device_unlock(device);
+
+  if (poll == PAIRING_POLL_RETRANSMIT)
+  {
+    device_send_reply(device, &reply);
+  }
+  return poll;
+}
+
+device_output_t device_output_report(device_t* device, const uint8_t* data, size_t length, int64_t now_us,
+                                     subcommand_reply_t* reply)
+{
+  if (!subcommand_lookup(data, length, reply))
+  {
+    return DEVICE_OUTPUT_NONE;
+  }
+  if (reply->action == SUBCOMMAND_ACTION_IMU_ON || reply->action == SUBCOMMAND_ACTION_IMU_OFF)
+  {
+    device_lock(device);
+    device->imu_enabled = (reply->action == SUBCOMMAND_ACTION_IMU_ON);
+    if (!device->imu_enabled)
+    {
+      memset(&device->report30[IMU_REPORT_OFFSET], 0, IMU_SAMPLES_PER_REPORT * IMU_SAMPLE_SIZE);
+    }
+    device_unlock(device);
+  }
+  device_send_reply(device, reply);
+
+  device_lock(device);
+  bool changed = pairing_replied(&device->pairing, data[9], reply, now_us);
+  device_unlock(device);
+  return changed ? DEVICE_OUTPUT_PAIRING : DEVICE_OUTPUT_REPLIED;
+}
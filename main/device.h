@@ -0,0 +1,123 @@
+// Device core shared by the firmware and the host stand-ins
+//
+// Holds the state uart_task and the report path share, and runs what the
+// host asks for over UART: legacy frames, single-byte commands and packets.
+// It also builds the reports and subcommand replies for the console, so
+// send_task and esp_bt_hidd_cb in main.c and nxpad-console run the same code.
+// Platform work (locking, UART and Bluetooth output, NVS, the baud rate, log
+// level and TX power) goes through device_hooks_t, so main.c and the host
+// stand-ins run the same dispatch. Hooks are always called with the lock
+// released.
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu.h"
+#include "input.h"
+#include "macro.h"
+#include "pairing.h"
+#include "recorder.h"
+#include "schedule.h"
+#include "settings.h"
+#include "subcommand.h"
+#include "uart_proto.h"
+
+// A baud change is reverted unless UART_CMD_BAUD_CONFIRM arrives at the new rate in time
+#define DEVICE_BAUD_CONFIRM_MS 5000
+
+#define DEVICE_REPORT_SIZE 48 // 0x30 input report with IMU data
+#define DEVICE_DUMMY_SIZE 11  // short 0x30 report sent until the input mode is set
+
+typedef struct
+{
+  void (*lock)(void* context);
+  void (*unlock)(void* context);
+  void (*send_packet)(void* context, uint8_t type, const uint8_t* payload, uint8_t length);
+
+  // The rest may be NULL: the request is then accepted and nothing else happens
+  void (*settings_save)(void* context); // UART_CMD_SETTINGS_SAVE
+  void (*macro_save)(void* context);    // UART_PKT_MACRO_SAVE
+  // UART_PKT_BAUD_PENDING went out at the old rate: switch to the new one
+  // and revert at the deadline unless baud_pending is cleared by then
+  void (*baud_change)(void* context, uint32_t baud);
+  // Applies what changes live outside this module (log level, TX power)
+  // before the setting is stored
+  void (*setting_changed)(void* context, uint8_t id, const settings_t* updated);
+  // One HID interrupt report to the console: 0x30 input or 0x21 reply.
+  // Only the report path calls it; when NULL the reports are built and dropped.
+  void (*send_report)(void* context, uint8_t id, const uint8_t* data, size_t size);
+} device_hooks_t;
+
+// What device_output_report() did with an output report
+typedef enum
+{
+  DEVICE_OUTPUT_NONE,    // no subcommand in it, e.g. rumble only
+  DEVICE_OUTPUT_REPLIED, // answered with a 0x21 reply
+  DEVICE_OUTPUT_PAIRING, // answered, and the pairing state moved on
+} device_output_t;
+
+typedef struct
+{
+  const device_hooks_t* hooks;
+  void* context;
+
+  // Guarded by the lock hooks
+  controller_input_t input_state;
+  schedule_t schedule;
+  macro_engine_t macro;
+  imu_stream_t imu;
+  pairing_t pairing;
+  recorder_t* recorder;     // NULL when built without the recorder
+  settings_t settings;      // only the UART side writes it
+  uint32_t report_count;    // reports sent since boot, host schedules refer to it
+  uint32_t report_period_us; // current report period, 0 while no reports are sent
+  uint8_t report30[DEVICE_REPORT_SIZE]; // last input report, replies carry its first bytes
+  uint8_t dummy[DEVICE_DUMMY_SIZE];
+  bool imu_enabled;         // the console turned the IMU on
+
+  // UART side only
+  uint32_t baud_pending;    // 0 when no change waits for its confirmation
+
+  // Set by the stats commands, cleared by whoever sends the stats
+  volatile bool stats_streaming;
+  volatile bool stats_requested;
+} device_t;
+
+// settings must already be loaded; recorder is initialised by the caller
+void device_init(device_t* device, const device_hooks_t* hooks, void* context,
+                 const pairing_config_t* pairing_config, recorder_t* recorder);
+
+// UART_PROTO_FRAME: the frame replaces the live input state
+void device_uart_frame(device_t* device, const uint8_t* frame);
+
+// UART_PROTO_COMMAND
+void device_uart_command(device_t* device, uint8_t command);
+
+// UART_PROTO_PACKET. Returns false when the type is unknown or the payload is rejected.
+bool device_uart_packet(device_t* device, const uart_proto_t* proto);
+
+// UART_PKT_SETTINGS and UART_PKT_PAIRING, also sent unasked when they change
+void device_send_settings(device_t* device);
+void device_send_pairing(device_t* device);
+
+// Sends report number report_count: scheduled inputs and macros applied, the
+// full report once the console set the input mode and the short one before.
+// Returns the period until the next report, idle_period_us while no console
+// is connected.
+uint32_t device_send_report(device_t* device, uint32_t idle_period_us);
+
+// Runs after every report: notes the first report of a connection, then
+// retransmits the last handshake reply. Returns PAIRING_POLL_TIMEOUT when a
+// stalled handshake should be dropped; disconnecting is up to the caller.
+pairing_poll_t device_pairing_check(device_t* device, int64_t now_us);
+
+// Output report from the console (0x01 or 0x10): answers its subcommand and
+// applies the IMU switch. reply is filled unless DEVICE_OUTPUT_NONE.
+device_output_t device_output_report(device_t* device, const uint8_t* data, size_t length, int64_t now_us,
+                                     subcommand_reply_t* reply);
+
+#endif
@@ -0,0 +1,131 @@
+// 6-axis (IMU) sample ring for the 0x30 report
+
+#include "imu.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+
+// Generator samples per shake half period (one report carries three)
+#define SHAKE_HALF_PERIOD 12
+#define SHAKE_PEAK (IMU_ACCEL_1G * 2)
+
+static const imu_sample_t rest_sample = {.accel = {0, 0, IMU_ACCEL_1G}};
+
+void imu_init(imu_stream_t* imu)
+{
+  memset(imu, 0, sizeof(imu_stream_t));
+  imu->last = rest_sample;
+}
+
+void imu_set_source(imu_stream_t* imu, imu_source_t source)
+{
+  imu->source = source;
+  imu->phase = 0;
+  imu->head = imu->tail = 0;
+}
+
+bool imu_push_packet(imu_stream_t* imu, const uint8_t* payload, uint8_t length)
+{
+  if(length < 2 || (length - 2) % IMU_SAMPLE_SIZE != 0)
+  {
+    return false;
+  }
+
+  uint16_t seq = le_get_u16(payload);
+  int count = (length - 2) / IMU_SAMPLE_SIZE;
+
+  // seq counts samples, so a jump ahead means the host skipped or we lost a
+  // packet, and one back a repeated or reordered packet
+  int16_t jump = (int16_t)(seq - imu->next_seq);
+  if(jump < 0 && jump > -IMU_SEQ_WINDOW)
+  {
+    imu->seq_late++;
+    return true;
+  }
+  if(jump > 0 && jump < IMU_SEQ_WINDOW)
+  {
+    imu->seq_gaps += jump;
+  }
+  imu->next_seq = seq + count;
+
+  const uint8_t* p = &payload[2];
+  for(int i = 0; i < count; i++, p += IMU_SAMPLE_SIZE)
+  {
+    if((uint16_t)(imu->head - imu->tail) >= IMU_RING_SIZE)
+    {
+      imu->overruns++;
+      continue;
+    }
+
+    imu_sample_t* sample = &imu->ring[imu->head % IMU_RING_SIZE];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      sample->accel[axis] = (int16_t)le_get_u16(&p[axis * 2]);
+      sample->gyro[axis] = (int16_t)le_get_u16(&p[6 + axis * 2]);
+    }
+    imu->head++;
+  }
+
+  return true;
+}
+
+static void imu_generate(imu_stream_t* imu, imu_sample_t* sample)
+{
+  *sample = rest_sample;
+
+  switch(imu->source)
+  {
+    case IMU_SOURCE_TILT_L:
+      // about 45 degrees around the Y axis
+      sample->accel[0] = -IMU_ACCEL_1G * 7 / 10;
+      sample->accel[2] = IMU_ACCEL_1G * 7 / 10;
+      break;
+    case IMU_SOURCE_TILT_R:
+      sample->accel[0] = IMU_ACCEL_1G * 7 / 10;
+      sample->accel[2] = IMU_ACCEL_1G * 7 / 10;
+      break;
+    case IMU_SOURCE_SHAKE:
+    {
+      // triangle wave between -SHAKE_PEAK and +SHAKE_PEAK
+      int pos = imu->phase % (SHAKE_HALF_PERIOD * 2);
+      int ramp = (pos < SHAKE_HALF_PERIOD) ? pos : (SHAKE_HALF_PERIOD * 2 - pos);
+      sample->accel[0] = (int16_t)(SHAKE_PEAK * (2 * ramp - SHAKE_HALF_PERIOD) / SHAKE_HALF_PERIOD);
+      imu->phase++;
+      break;
+    }
+    case IMU_SOURCE_REST:
+    case IMU_SOURCE_HOST:
+    default:
+      break;
+  }
+}
+
+void imu_fill_report(imu_stream_t* imu, uint8_t* report)
+{
+  uint8_t* p = &report[IMU_REPORT_OFFSET];
+
+  for(int i = 0; i < IMU_SAMPLES_PER_REPORT; i++, p += IMU_SAMPLE_SIZE)
+  {
+    if(imu->source != IMU_SOURCE_HOST)
+    {
+      imu_generate(imu, &imu->last);
+    }
+    else if(imu->head != imu->tail)
+    {
+      imu->last = imu->ring[imu->tail % IMU_RING_SIZE];
+      imu->tail++;
+    }
+    else
+    {
+      // Host is behind: hold the last sample rather than jumping to zero
+      imu->underruns++;
+    }
+
+    for(int axis = 0; axis < 3; axis++)
+    {
+      le_put_u16(&p[axis * 2], (uint16_t)imu->last.accel[axis]);
+      le_put_u16(&p[6 + axis * 2], (uint16_t)imu->last.gyro[axis]);
+    }
+  }
+}
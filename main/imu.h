@@ -0,0 +1,69 @@
+// 6-axis (IMU) sample ring for the 0x30 report
+//
+// Once the Switch enables the IMU (subcommand 0x40), every 0x30 report
+// carries three accelerometer/gyro samples in bytes 12-47 of report30.
+// Samples come either from the host (UART_PKT_IMU_SAMPLES) or from a small
+// on-device generator selected by a single command byte.
+
+#ifndef IMU_H
+#define IMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IMU_RING_SIZE 64 // must be a power of two
+#define IMU_SAMPLES_PER_REPORT 3
+#define IMU_SAMPLE_SIZE 12
+#define IMU_REPORT_OFFSET 12
+
+// 1G at the default +-8G accelerometer range
+#define IMU_ACCEL_1G 4096
+
+// Sequence jumps within this many samples are counted as gaps or late
+// packets; a larger jump means the host restarted its count
+#define IMU_SEQ_WINDOW 1024
+
+typedef struct
+{
+  int16_t accel[3]; // x, y, z
+  int16_t gyro[3];  // x, y, z
+} imu_sample_t;
+
+typedef enum
+{
+  IMU_SOURCE_HOST = 0, // samples streamed over UART
+  IMU_SOURCE_REST,     // lying flat, no motion
+  IMU_SOURCE_TILT_L,   // held tilted to the left
+  IMU_SOURCE_TILT_R,   // held tilted to the right
+  IMU_SOURCE_SHAKE,    // shaken along the X axis
+} imu_source_t;
+
+typedef struct
+{
+  imu_sample_t ring[IMU_RING_SIZE];
+  uint16_t head; // next write
+  uint16_t tail; // next read
+  imu_sample_t last;
+
+  imu_source_t source;
+  uint16_t phase;
+
+  uint16_t next_seq; // expected sequence number of the next host sample
+  uint32_t seq_gaps; // host samples missing from the stream
+  uint32_t seq_late; // host packets dropped because they repeat or precede samples already queued
+  uint32_t overruns; // host samples dropped because the ring was full
+  uint32_t underruns; // report slots filled by repeating the last sample
+} imu_stream_t;
+
+void imu_init(imu_stream_t* imu);
+
+void imu_set_source(imu_stream_t* imu, imu_source_t source);
+
+// Queues a UART_PKT_IMU_SAMPLES payload: seq (u16 LE), then samples of
+// accel x, y, z, gyro x, y, z (int16 LE each). Returns false if malformed.
+bool imu_push_packet(imu_stream_t* imu, const uint8_t* payload, uint8_t length);
+
+// Writes three samples into a 0x30 report, oldest first
+void imu_fill_report(imu_stream_t* imu, uint8_t* report);
+
+#endif
@@ -0,0 +1,213 @@
+// Controller input state and its 0x30 report encoding
+
+#include "input.h"
+
+typedef struct
+{
+  // Buttons
+  uint8_t A;
+  uint8_t B;
+  uint8_t X;
+  uint8_t Y;
+
+  // Triggers
+  uint8_t L;
+  uint8_t R;
+  uint8_t ZL;
+  uint8_t ZR;
+
+  // Dpad
+  uint8_t Dpad_Up;
+  uint8_t Dpad_Down;
+  uint8_t Dpad_Left;
+  uint8_t Dpad_Right;
+
+  // Functions
+  uint8_t Plus;
+  uint8_t Minus;
+  uint8_t Capture;
+  uint8_t Home;
+
+  // Sticks
+  uint8_t StickL_X;
+  uint8_t StickL_Y;
+  uint8_t StickL_Click;
+  uint8_t StickR_X;
+  uint8_t StickR_Y;
+  uint8_t StickR_Click;
+
+} ControlInputStatus;
+
+void input_reset(controller_input_t* input)
+{
+  input->but1 = 0;
+  input->but2 = 0;
+  input->but3 = 0;
+  input->lx = 128;
+  input->ly = 128;
+  input->rx = 128;
+  input->ry = 128;
+}
+
+bool input_decode_frame(const uint8_t* frame, controller_input_t* input)
+{
+  // 受信したデータの正当性を確認する
+  if((frame[0] != 0xAA) || (frame[1] != 0xAA) ||
+     (frame[2] != 0xAA) || (frame[3] != 0xAA) ||
+     (frame[4] != 0xAA) || (frame[10] != 0x00))
+  {
+    // 受信したデータの形が不正だった
+    return false;
+  }
+
+  // 入力情報をまとめる
+  ControlInputStatus inputStatus;
+
+  inputStatus.ZR = ((frame[5] >> 7) & 1); // ZR
+  inputStatus.ZL = ((frame[5] >> 6) & 1); // ZL
+  inputStatus.R = ((frame[5] >> 5) & 1); // R
+  inputStatus.L = ((frame[5] >> 4) & 1); // L
+  inputStatus.X = ((frame[5] >> 3) & 1); // X
+  inputStatus.A = ((frame[5] >> 2) & 1); // A
+  inputStatus.B = ((frame[5] >> 1) & 1); // B
+  inputStatus.Y = (frame[5] & 1); // Y
+
+  inputStatus.Capture = ((frame[6] >> 5) & 1); // Capture
+  inputStatus.Home = ((frame[6] >> 4) & 1); // Home
+  inputStatus.StickR_Click = ((frame[6] >> 3) & 1); // StickR_Click
+  inputStatus.StickL_Click = ((frame[6] >> 2) & 1); // StickL_Click
+  inputStatus.Plus = ((frame[6] >> 1) & 1); // Plus
+  inputStatus.Minus = (frame[6] & 1); // Minus
+
+  // Dpad initialize
+  inputStatus.Dpad_Up = 0;
+  inputStatus.Dpad_Down = 0;
+  inputStatus.Dpad_Left = 0;
+  inputStatus.Dpad_Right = 0;
+
+  switch(frame[7])
+  {
+    case A_DPAD_U:
+      inputStatus.Dpad_Up = 1;
+      break;
+    case A_DPAD_R:
+      inputStatus.Dpad_Right = 1;
+      break;
+    case A_DPAD_D:
+      inputStatus.Dpad_Down = 1;
+      break;
+    case A_DPAD_L:
+      inputStatus.Dpad_Left = 1;
+      break;
+    case A_DPAD_U_R:
+      inputStatus.Dpad_Up = 1;
+      inputStatus.Dpad_Right = 1;
+      break;
+    case A_DPAD_U_L:
+      inputStatus.Dpad_Up = 1;
+      inputStatus.Dpad_Left = 1;
+      break;
+    case A_DPAD_D_R:
+      inputStatus.Dpad_Down = 1;
+      inputStatus.Dpad_Right = 1;
+      break;
+    case A_DPAD_D_L:
+      inputStatus.Dpad_Down = 1;
+      inputStatus.Dpad_Left = 1;
+      break;
+    case A_DPAD_CENTER:
+    default:
+      break;
+  }
+
+  // Stick initialize
+  inputStatus.StickL_X = 128;
+  inputStatus.StickL_Y = 128;
+  inputStatus.StickR_X = 128;
+  inputStatus.StickR_Y = 128;
+
+  // StickL_X
+  if(frame[8] & 0x01) // Left
+  {
+    inputStatus.StickL_X = 0;
+  }
+  else if(frame[8] & 0x02) // Right
+  {
+    inputStatus.StickL_X = 255;
+  }
+
+  // StickL_Y
+  if(frame[8] & 0x04) // Up
+  {
+    inputStatus.StickL_Y = 255;
+  }
+  else if(frame[8] & 0x08) // Down
+  {
+    inputStatus.StickL_Y = 0;
+  }
+
+  // StickR_X
+  if(frame[9] & 0x01) // Left
+  {
+    inputStatus.StickR_X = 0;
+  }
+  else if(frame[9] & 0x02) // Right
+  {
+    inputStatus.StickR_X = 255;
+  }
+
+  // StickR_Y
+  if(frame[9] & 0x04) // Up
+  {
+    inputStatus.StickR_Y = 255;
+  }
+  else if(frame[9] & 0x08) // Down
+  {
+    inputStatus.StickR_Y = 0;
+  }
+
+  // まとめた入力情報を送信用データにセットする
+  input->but1 = (inputStatus.Y) +       // Y
+                (inputStatus.X << 1) +  // X
+                (inputStatus.B << 2) +  // B
+                (inputStatus.A << 3) +  // A
+                (inputStatus.R << 6) +  // R
+                (inputStatus.ZR << 7);  // ZR
+
+  input->but2 = (inputStatus.Minus) +     // Minus/Select
+                (inputStatus.Plus << 1) + // Plus/Start
+                (inputStatus.StickR_Click << 2) + // R Stick Click
+                (inputStatus.StickL_Click << 3) + // L Stick Click
+                (inputStatus.Home << 4) +   // Home
+                (inputStatus.Capture << 5); // Capture
+
+  input->but3 = (inputStatus.Dpad_Down) +       // Dpad_Down
+                (inputStatus.Dpad_Up << 1) +    // Dpad_Up
+                (inputStatus.Dpad_Right << 2) + // Dpad_Right
+                (inputStatus.Dpad_Left << 3) +  // Dpad_Left
+                (inputStatus.L << 6) + // L
+                (inputStatus.ZL << 7); // ZL
+
+  input->lx = inputStatus.StickL_X;
+  input->ly = inputStatus.StickL_Y;
+  input->rx = inputStatus.StickR_X;
+  input->ry = inputStatus.StickR_Y;
+
+  return true;
+}
+
+void input_encode_report(uint8_t* report, const controller_input_t* input)
+{
+  // buttons
+  report[2] = input->but1;
+  report[3] = input->but2;
+  report[4] = input->but3;
+  // encode left stick
+  report[5] = (input->lx << 4) & 0xF0;
+  report[6] = (input->lx & 0xF0) >> 4;
+  report[7] = input->ly;
+  // encode right stick
+  report[8] = (input->rx << 4) & 0xF0;
+  report[9] = (input->rx & 0xF0) >> 4;
+  report[10] = input->ry;
+}
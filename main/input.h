@@ -0,0 +1,47 @@
+// Controller input state and its 0x30 report encoding
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 1フレーム分のバイト数 ( Size of one legacy UART frame )
+#define INPUT_FRAME_SIZE 11
+
+// Dpad input defines
+#define A_DPAD_CENTER 0x08
+#define A_DPAD_U 0x00
+#define A_DPAD_U_R 0x01
+#define A_DPAD_R 0x02
+#define A_DPAD_D_R 0x03
+#define A_DPAD_D 0x04
+#define A_DPAD_D_L 0x05
+#define A_DPAD_L 0x06
+#define A_DPAD_U_L 0x07
+
+// Controller state in the same layout as bytes 2-10 of the 0x30 report.
+// From least to most significant bits:
+typedef struct
+{
+  uint8_t but1; // (Right) Y, X, B, A, SR, SL, R, ZR
+  uint8_t but2; // (Shared) -, +, Rs, Ls, H, Cap, --, Charging Grip
+  uint8_t but3; // (Left) D, U, R, L, SR, SL, L, ZL
+
+  uint8_t lx;
+  uint8_t ly;
+  uint8_t rx;
+  uint8_t ry;
+} controller_input_t;
+
+// Sets buttons released and both sticks centered
+void input_reset(controller_input_t* input);
+
+// Decodes one 11-byte legacy frame (0xAA x5, Button0, Button1, DPad, LStick, RStick, 0x00).
+// Returns false and leaves *input untouched when the frame flags are invalid.
+bool input_decode_frame(const uint8_t* frame, controller_input_t* input);
+
+// Writes buttons and sticks into bytes 2-10 of a 0x30 report
+void input_encode_report(uint8_t* report, const controller_input_t* input);
+
+#endif
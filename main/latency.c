@@ -0,0 +1,49 @@
+// Latency self-test summary
+
+#include "latency.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_u32(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the first count sorted samples
+static uint32_t percentile(const uint32_t* sorted, uint32_t count, uint32_t percent)
+{
+  uint32_t rank = (count * percent + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void latency_summarize(uint32_t* samples, size_t count, latency_summary_t* summary)
+{
+  memset(summary, 0, sizeof(latency_summary_t));
+  // LATENCY_LOST sorts last
+  qsort(samples, count, sizeof(uint32_t), compare_u32);
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (samples[i] == LATENCY_LOST)
+    {
+      summary->lost++;
+      continue;
+    }
+    summary->count++;
+    sum += samples[i];
+  }
+  if (summary->count == 0)
+  {
+    return;
+  }
+
+  summary->min_us = samples[0];
+  summary->p50_us = percentile(samples, summary->count, 50);
+  summary->p99_us = percentile(samples, summary->count, 99);
+  summary->max_us = samples[summary->count - 1];
+  summary->avg_us = (uint32_t)(sum / summary->count);
+}
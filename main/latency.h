@@ -0,0 +1,37 @@
+// Latency self-test summary
+//
+// The boot self-test (CONFIG_UARTNX_LATENCY_TEST) collects wake-up latency
+// samples in us for the task layout it was built with:
+//
+//   report  esp_timer one-shot due time to a task in the send_task slot
+//           running; includes the esp_timer task dispatch
+//   uart    one byte written in UART loopback to uart_read_bytes() returning
+//           it in the uart_task slot; includes the byte time and the RX
+//           timeout of the driver
+//
+// each once idle and once while another task keeps reading flash, which
+// disables the cache and holds off interrupts that are not in IRAM.
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATENCY_LOST 0xFFFFFFFF // sample that never arrived
+
+typedef struct
+{
+  uint32_t count; // samples that arrived
+  uint32_t lost;
+  uint32_t min_us;
+  uint32_t p50_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+  uint32_t avg_us;
+} latency_summary_t;
+
+// Sorts samples in place. Zeros the summary when nothing arrived.
+void latency_summarize(uint32_t* samples, size_t count, latency_summary_t* summary);
+
+#endif
@@ -0,0 +1,108 @@
+// Bluetooth link profiles and report completion timing
+
+#include "link_profile.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+
+static const link_profile_t profiles[LINK_PROFILE_COUNT] = {
+  [LINK_PROFILE_LOW_LATENCY] = {
+    .name = "low_latency",
+    .poll_slots = 8, // 5 ms
+    .service_type = LINK_QOS_GUARANTEED,
+    .access_latency_us = 1250,
+    .tx_power_min = 5, // +3 dBm
+    .tx_power_max = 7, // +9 dBm
+  },
+  [LINK_PROFILE_BALANCED] = {
+    .name = "balanced",
+    .poll_slots = 0,
+    .service_type = LINK_QOS_BEST_EFFORT,
+    .access_latency_us = 11250,
+    .tx_power_min = 4, // 0 dBm
+    .tx_power_max = 6, // +6 dBm, the stack default
+  },
+  [LINK_PROFILE_LOW_POWER] = {
+    .name = "low_power",
+    .poll_slots = 0,
+    .service_type = LINK_QOS_BEST_EFFORT,
+    .access_latency_us = 0xFFFFFFFF, // no preference
+    .tx_power_min = 0, // -12 dBm
+    .tx_power_max = 3, // -3 dBm
+  },
+};
+
+const link_profile_t* link_profile_get(uint8_t id)
+{
+  return id < LINK_PROFILE_COUNT ? &profiles[id] : NULL;
+}
+
+void link_window_reset(link_window_t* window)
+{
+  memset(window, 0, sizeof(link_window_t));
+}
+
+void link_window_done(link_window_t* window, bool ok, int64_t now_us)
+{
+  if (!ok)
+  {
+    window->errors++;
+    return;
+  }
+
+  window->completed++;
+  if (window->last_us != 0)
+  {
+    uint32_t interval = (uint32_t)(now_us - window->last_us);
+    if (window->intervals == 0 || interval < window->interval_min)
+    {
+      window->interval_min = interval;
+    }
+    if (interval > window->interval_max)
+    {
+      window->interval_max = interval;
+    }
+    window->interval_sum += interval;
+    window->intervals++;
+  }
+  window->last_us = now_us;
+}
+
+void link_window_mode(link_window_t* window, bool sniff)
+{
+  if (sniff && !window->sniff)
+  {
+    window->sniff_entries++;
+  }
+  window->sniff = sniff;
+}
+
+void link_window_restart(link_window_t* window)
+{
+  window->last_us = 0;
+  window->sniff = false;
+}
+
+size_t link_window_close(link_window_t* window, uint8_t profile, uint16_t poll_slots, uint8_t* out)
+{
+  uint32_t average = window->intervals ? (uint32_t)(window->interval_sum / window->intervals) : 0;
+
+  out[0] = profile;
+  le_put_u16(&out[1], poll_slots);
+  le_put_u16(&out[3], window->completed > 0xFFFF ? 0xFFFF : (uint16_t)window->completed);
+  le_put_u16(&out[5], window->errors);
+  le_put_u32(&out[7], window->interval_min);
+  le_put_u32(&out[11], average);
+  le_put_u32(&out[15], window->interval_max);
+  le_put_u16(&out[19], window->sniff_entries);
+  out[21] = window->sniff;
+
+  // The link keeps its state across windows, only the counters restart
+  int64_t last_us = window->last_us;
+  bool sniff = window->sniff;
+  link_window_reset(window);
+  window->last_us = last_us;
+  window->sniff = sniff;
+  return LINK_WINDOW_ENCODED_SIZE;
+}
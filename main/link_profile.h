@@ -0,0 +1,76 @@
+// Bluetooth link profiles and report completion timing
+//
+// A profile decides what the controller asks of the link: the L2CAP QoS
+// registered for the HID channels, the ACL poll interval requested once
+// the console connects, and the BR/EDR TX power range. Sniff mode and the
+// master/slave role stay with the console; mode changes are only counted.
+//
+// The completion window measures the time between consecutive
+// ESP_HIDD_SEND_REPORT_EVT for 0x30 reports: the completion interval at the
+// local stack, i.e. when Bluedroid/L2CAP accepted each report. It follows
+// the poll interval while the stack's queue is full, but it does not show
+// when the console received a report.
+
+#ifndef LINK_PROFILE_H
+#define LINK_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  LINK_PROFILE_LOW_LATENCY = 0,
+  LINK_PROFILE_BALANCED,
+  LINK_PROFILE_LOW_POWER,
+  LINK_PROFILE_COUNT,
+} link_profile_id_t;
+
+typedef struct
+{
+  const char* name;
+  uint16_t poll_slots;        // ACL poll interval in 0.625 ms slots, 0 leaves the console's choice
+  uint8_t service_type;       // L2CAP QoS service type for both HID channels
+  uint32_t access_latency_us; // L2CAP QoS latency hint
+  uint8_t tx_power_min;       // esp_power_level_t (0: -12 dBm ... 7: +9 dBm)
+  uint8_t tx_power_max;
+} link_profile_t;
+
+#define LINK_QOS_BEST_EFFORT 0x01
+#define LINK_QOS_GUARANTEED 0x02
+
+// profile (u8), poll slots granted (u16 LE), reports completed (u16 LE), errors (u16 LE),
+// completion interval min, average, max (u32 LE us), sniff entries (u16 LE), in sniff (u8)
+#define LINK_WINDOW_ENCODED_SIZE 22
+
+typedef struct
+{
+  int64_t last_us; // previous completion, 0 after a reset
+  uint32_t completed;
+  uint32_t intervals;
+  uint64_t interval_sum;
+  uint32_t interval_min;
+  uint32_t interval_max;
+  uint16_t errors;
+  uint16_t sniff_entries;
+  bool sniff;
+} link_window_t;
+
+// NULL for an unknown id
+const link_profile_t* link_profile_get(uint8_t id);
+
+void link_window_reset(link_window_t* window);
+
+// One ESP_HIDD_SEND_REPORT_EVT (ok) or ESP_HIDD_REPORT_ERR_EVT (!ok) for a 0x30 report
+void link_window_done(link_window_t* window, bool ok, int64_t now_us);
+
+// ESP_BT_GAP_MODE_CHG_EVT; sniff is true when the new mode is sniff
+void link_window_mode(link_window_t* window, bool sniff);
+
+// A new connection: intervals across the gap are not counted
+void link_window_restart(link_window_t* window);
+
+// Builds the UART_PKT_LINK payload and starts the next window
+size_t link_window_close(link_window_t* window, uint8_t profile, uint16_t poll_slots, uint8_t* out);
+
+#endif
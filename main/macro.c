@@ -0,0 +1,160 @@
+// Turbo (auto-fire) and timed combo engine
+
+#include "macro.h"
+
+#include <string.h>
+
+void macro_config_default(macro_config_t* config)
+{
+  memset(config, 0, sizeof(macro_config_t));
+  config->version = MACRO_CONFIG_VERSION;
+}
+
+void macro_init(macro_engine_t* engine)
+{
+  memset(engine, 0, sizeof(macro_engine_t));
+  macro_config_default(&engine->config);
+  engine->pending = MACRO_NO_COMBO;
+  engine->combo = MACRO_NO_COMBO;
+}
+
+void macro_trigger(macro_engine_t* engine, uint8_t slot)
+{
+  if(slot != MACRO_STOP && slot >= MACRO_COMBO_SLOTS)
+  {
+    return;
+  }
+  engine->pending = slot;
+}
+
+// Skips zero length steps, returns false when the combo is over
+static bool macro_enter_step(macro_engine_t* engine)
+{
+  const macro_combo_t* combo = &engine->config.combos[engine->combo];
+
+  while(engine->step < combo->step_count)
+  {
+    if(combo->steps[engine->step].reports > 0)
+    {
+      engine->step_left = combo->steps[engine->step].reports;
+      return true;
+    }
+    engine->step++;
+  }
+
+  engine->combo = MACRO_NO_COMBO;
+  return false;
+}
+
+void macro_apply(macro_engine_t* engine, const controller_input_t* live, controller_input_t* out)
+{
+  uint8_t pending = engine->pending;
+
+  if(pending != MACRO_NO_COMBO)
+  {
+    engine->pending = MACRO_NO_COMBO;
+    engine->combo = MACRO_NO_COMBO;
+    if(pending < MACRO_COMBO_SLOTS)
+    {
+      engine->combo = pending;
+      engine->step = 0;
+      macro_enter_step(engine);
+    }
+  }
+
+  // A running combo owns the whole report
+  if(engine->combo != MACRO_NO_COMBO)
+  {
+    *out = engine->config.combos[engine->combo].steps[engine->step].input;
+    if(--engine->step_left == 0)
+    {
+      engine->step++;
+      macro_enter_step(engine);
+    }
+    return;
+  }
+
+  *out = *live;
+
+  for(int i = 0; i < MACRO_TURBO_GROUPS; i++)
+  {
+    const macro_turbo_t* turbo = &engine->config.turbo[i];
+
+    if(turbo->on == 0)
+    {
+      continue;
+    }
+
+    if(!((live->but1 & turbo->mask[0]) || (live->but2 & turbo->mask[1]) || (live->but3 & turbo->mask[2])))
+    {
+      // Released: the next press starts with an "on" report
+      engine->turbo_count[i] = 0;
+      continue;
+    }
+
+    if(engine->turbo_count[i] >= turbo->on)
+    {
+      out->but1 &= ~turbo->mask[0];
+      out->but2 &= ~turbo->mask[1];
+      out->but3 &= ~turbo->mask[2];
+    }
+
+    engine->turbo_count[i]++;
+    if(engine->turbo_count[i] >= turbo->on + turbo->off)
+    {
+      engine->turbo_count[i] = 0;
+    }
+  }
+}
+
+bool macro_set_turbo(macro_config_t* config, const uint8_t* payload, uint8_t length)
+{
+  if(length != 6 || payload[0] >= MACRO_TURBO_GROUPS)
+  {
+    return false;
+  }
+
+  macro_turbo_t* turbo = &config->turbo[payload[0]];
+  turbo->mask[0] = payload[1];
+  turbo->mask[1] = payload[2];
+  turbo->mask[2] = payload[3];
+  turbo->on = payload[4];
+  turbo->off = payload[5];
+
+  return true;
+}
+
+bool macro_set_combo(macro_config_t* config, const uint8_t* payload, uint8_t length)
+{
+  if(length < 2 + MACRO_NAME_LEN || payload[0] >= MACRO_COMBO_SLOTS)
+  {
+    return false;
+  }
+
+  uint8_t step_count = payload[1 + MACRO_NAME_LEN];
+  if(step_count > MACRO_COMBO_STEPS || length != 2 + MACRO_NAME_LEN + step_count * 8)
+  {
+    return false;
+  }
+
+  macro_combo_t* combo = &config->combos[payload[0]];
+  memcpy(combo->name, &payload[1], MACRO_NAME_LEN);
+  combo->name[MACRO_NAME_LEN - 1] = '\0';
+  combo->step_count = step_count;
+
+  const uint8_t* p = &payload[2 + MACRO_NAME_LEN];
+  for(int i = 0; i < step_count; i++, p += 8)
+  {
+    macro_step_t* step = &combo->steps[i];
+    step->input.but1 = p[0];
+    step->input.but2 = p[1];
+    step->input.but3 = p[2];
+    step->input.lx = p[3];
+    step->input.ly = p[4];
+    step->input.rx = p[5];
+    step->input.ry = p[6];
+    step->reports = p[7];
+  }
+
+  return true;
+}
@@ -0,0 +1,79 @@
+// Turbo (auto-fire) and timed combo engine
+//
+// Evaluated once per 0x30 report, so every press and release lands on a
+// report boundary. All durations are counted in reports, not in time.
+
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "input.h"
+
+#define MACRO_CONFIG_VERSION 1
+#define MACRO_TURBO_GROUPS 4
+#define MACRO_COMBO_SLOTS 8
+#define MACRO_COMBO_STEPS 16
+#define MACRO_NAME_LEN 12
+
+#define MACRO_NO_COMBO 0xFF
+#define MACRO_STOP 0xFE
+
+// Buttons in mask toggle while held: pressed for on reports, released for off reports.
+// A group with on == 0 is disabled.
+typedef struct
+{
+  uint8_t mask[3]; // but1, but2, but3
+  uint8_t on;
+  uint8_t off;
+} macro_turbo_t;
+
+typedef struct
+{
+  controller_input_t input;
+  uint8_t reports; // how many reports this step is held, 0 skips the step
+} macro_step_t;
+
+typedef struct
+{
+  char name[MACRO_NAME_LEN];
+  uint8_t step_count;
+  macro_step_t steps[MACRO_COMBO_STEPS];
+} macro_combo_t;
+
+// Persisted as a single NVS blob
+typedef struct
+{
+  uint8_t version;
+  macro_turbo_t turbo[MACRO_TURBO_GROUPS];
+  macro_combo_t combos[MACRO_COMBO_SLOTS];
+} macro_config_t;
+
+typedef struct
+{
+  macro_config_t config;
+
+  uint8_t turbo_count[MACRO_TURBO_GROUPS]; // reports since the group was pressed
+
+  volatile uint8_t pending; // combo slot requested by the UART side
+  uint8_t combo;            // running combo slot or MACRO_NO_COMBO
+  uint8_t step;
+  uint8_t step_left;
+} macro_engine_t;
+
+void macro_config_default(macro_config_t* config);
+
+void macro_init(macro_engine_t* engine);
+
+// Requests a combo to start on the next report. MACRO_STOP stops the running one.
+void macro_trigger(macro_engine_t* engine, uint8_t slot);
+
+// Produces the state for the next report from the live host input
+void macro_apply(macro_engine_t* engine, const controller_input_t* live, controller_input_t* out);
+
+// Parses UART_PKT_TURBO_SET / UART_PKT_COMBO_SET payloads into the config
+bool macro_set_turbo(macro_config_t* config, const uint8_t* payload, uint8_t length);
+bool macro_set_combo(macro_config_t* config, const uint8_t* payload, uint8_t length);
+
+#endif
@@ -1,8 +1,10 @@
 // BlueCubeMod Firmware
 // Created by Nathan Reeves 2019
 
+#include <assert.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "driver/gpio.h"
@@ -15,7 +17,11 @@
 #include "esp_err.h"
 #include "esp_gap_bt_api.h"
 #include "esp_hidd_api.h"
+#include "esp_intr_alloc.h"
 #include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
 #include "esp_system.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
@@ -23,92 +29,109 @@
 #include "freertos/task.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "hal/cpu_hal.h"
 #include "soc/rmt_reg.h"
 
+#include "bench.h"
+#include "device.h"
+#include "imu.h"
+#include "input.h"
+#include "latency.h"
+#include "link_profile.h"
+#include "macro.h"
+#include "pairing.h"
+#include "profile.h"
+#include "recorder.h"
+#include "rumble.h"
+#include "schedule.h"
+#include "settings.h"
+#include "stats.h"
+#include "subcommand.h"
+#include "task_layout.h"
+#include "uart_proto.h"
+
 #define LED_GPIO 12
 #define PIN_SEL (1ULL << LED_GPIO)
 
-#define PRO_CON 0x03
-// #define JOYCON_L 0x01
-// #define JOYCON_R 0x02
+// Input, macro, IMU, pairing, settings and report state shared by uart_task,
+// send_task and the Bluetooth callbacks, guarded by xSemaphore through device_hooks
+static device_t device;
 
-#define CONTROLLER_TYPE PRO_CON
+// Rumble changes seen in the BT callback, forwarded to the host by uart_task
+static QueueHandle_t rumble_queue;
+static rumble_filter_t rumble_state;
 
-typedef struct 
-{
-    // Buttons
-    uint8_t A;
-    uint8_t B;
-    uint8_t X;
-    uint8_t Y;
-
-    // Triggers
-    uint8_t L;
-    uint8_t R;
-    uint8_t ZL;
-    uint8_t ZR;
-
-    // Dpad
-    uint8_t Dpad_Up;
-    uint8_t Dpad_Down;
-    uint8_t Dpad_Left;
-    uint8_t Dpad_Right;
-
-    // Functions
-    uint8_t Plus;
-    uint8_t Minus;
-    uint8_t Capture;
-    uint8_t Home;
-
-    // Sticks
-    uint8_t StickL_X;
-    uint8_t StickL_Y;
-    uint8_t StickL_Click;
-    uint8_t StickR_X;
-    uint8_t StickR_Y;
-    uint8_t StickR_Click;
-
-} ControlInputStatus;
-
-// Dpad input defines
-#define A_DPAD_CENTER 0x08
-#define A_DPAD_U 0x00
-#define A_DPAD_U_R 0x01
-#define A_DPAD_R 0x02
-#define A_DPAD_D_R 0x03
-#define A_DPAD_D 0x04
-#define A_DPAD_D_L 0x05
-#define A_DPAD_L 0x06
-#define A_DPAD_U_L 0x07
-
-// From least to most significant bits:
-static uint8_t but1_send = 0; // (Right) Y, X, B, A, SR, SL, R, ZR
-static uint8_t but2_send = 0; // (Shared) -, +, Rs, Ls, H, Cap, --, Charging Grip
-static uint8_t but3_send = 0; // (Left) D, U, R, L, SR, SL, L, ZL
-
-static uint8_t lx_send = 128;
-static uint8_t ly_send = 128;
-static uint8_t rx_send = 128;
-static uint8_t ry_send = 128;
-
-bool connected = false;
-bool paired = false;
+// device.settings is loaded from NVS before anything else starts; see
+// settings.h for when edits apply. A baud change is reverted at
+// baud_deadline unless the host confirms it.
+static int64_t baud_deadline = 0;
+
+// Reports are paced by a periodic esp_timer instead of vTaskDelay, so the
+// report task sleeps between reports and light sleep can wake up for them.
+// While connected the period is device.settings.report_period_us, with the short
+// dummy report until the console sets the input report mode. With no
+// connection the timer is stopped.
+#define DUMMY_PERIOD_US (100 * portTICK_PERIOD_MS * 1000)
+// device.report_period_us is the period the timer runs at, 0 while stopped.
+static esp_timer_handle_t report_timer;
 
 SemaphoreHandle_t xSemaphore;
 
 TaskHandle_t ButtonsHandle = NULL;
 TaskHandle_t SendingHandle = NULL;
 TaskHandle_t BlinkHandle = NULL;
+TaskHandle_t StatsHandle = NULL;
+
+// Core and priority of each task, chosen with CONFIG_UARTNX_TASKS_*
+static const task_layout_t* task_layout;
+
+#define UART_TASK_STACK 2048
+#define SEND_TASK_STACK 4096
+#define BLINK_TASK_STACK 1024
+#define STATS_TASK_STACK 2048
+
+// With CONFIG_UARTNX_STATIC_ALLOC every task stack and TCB lives in .bss
+#if CONFIG_UARTNX_STATIC_ALLOC
+#define APP_TASK_CREATE(function, name, stack_size, priority, handle, core)               \
+  do                                                                                      \
+  {                                                                                       \
+    static StackType_t function##_stack[stack_size];                                      \
+    static StaticTask_t function##_tcb;                                                   \
+    *(handle) = xTaskCreateStaticPinnedToCore(function, name, stack_size, NULL, priority, \
+                                              function##_stack, &function##_tcb, core);   \
+  } while (0)
+#else
+#define APP_TASK_CREATE(function, name, stack_size, priority, handle, core) \
+  xTaskCreatePinnedToCore(function, name, stack_size, NULL, priority, handle, core)
+#endif
+
+static BaseType_t task_core(const task_slot_t* slot)
+{
+  return slot->core == TASK_LAYOUT_UNPINNED ? tskNO_AFFINITY : slot->core;
+}
+
+// Creates an application task in its task_layout slot
+#define APP_TASK_START(function, name, stack_size, id, handle) \
+  APP_TASK_CREATE(function, name, stack_size, task_layout->tasks[id].priority, handle, task_core(&task_layout->tasks[id]))
 
 static esp_hidd_app_param_t app_param;
 static esp_hidd_qos_param_t both_qos;
 
-// Timer has +1 added to it every send cycle
-// Apparently, it can be used to detect packet loss/excess latency
-static uint8_t timer = 0;
-
-static uint8_t report30[48] = {[0] = 0x00, [1] = 0x8E, [11] = 0x80};
-static uint8_t dummy[11] = {0x00, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80, 0x00, 0x08, 0x80};
+// Report completion timing for UART_PKT_LINK, written from the Bluetooth
+// callbacks and closed by stats_task; both guarded by link_mux
+static portMUX_TYPE link_mux = portMUX_INITIALIZER_UNLOCKED;
+static link_window_t link_window;
+// Poll interval the console granted the current link (ESP_BT_GAP_QOS_CMPL_EVT),
+// 0 until it answers and again once the link drops or the profile changes
+static uint16_t link_poll_slots = 0;
+
+#if CONFIG_UARTNX_RECORDER
+_Static_assert((CONFIG_UARTNX_RECORDER_REPORTS & (CONFIG_UARTNX_RECORDER_REPORTS - 1)) == 0,
+               "recorder capacity must be a power of two");
+// Reports actually sent to the console (device.report30 only, not the pre-connection dummy)
+static recorder_entry_t recorder_storage[CONFIG_UARTNX_RECORDER_REPORTS];
+static recorder_t recorder;
+#endif
 
 #define UART_NUM (UART_NUM_0)
 #define UART_TXD_PIN (UART_PIN_NO_CHANGE) // When UART2, TX GPIO_NUM_19, RX GPIO_NUM_26
@@ -116,421 +139,367 @@ static uint8_t dummy[11] = {0x00, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80, 0x00
 
 uart_config_t uart_config;
 QueueHandle_t uart_queue;
-#define BUF_SIZE (256)
-uint8_t* uart_data;
+// device.settings.uart_buffer bytes are read at a time
+#if CONFIG_UARTNX_STATIC_ALLOC
+static uint8_t uart_data[SETTINGS_UART_BUFFER_MAX];
+#else
+static uint8_t* uart_data;
+#endif
 
 void uart_init()
 {
-  uart_config.baud_rate = 9600;
+#if !CONFIG_UARTNX_STATIC_ALLOC
+  uart_data = malloc(device.settings.uart_buffer);
+  assert(uart_data != NULL);
+#endif
+
+  uart_config.baud_rate = device.settings.baud;
   uart_config.data_bits = UART_DATA_8_BITS;
   uart_config.parity = UART_PARITY_DISABLE;
   uart_config.stop_bits = UART_STOP_BITS_1;
   uart_config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+#if CONFIG_UARTNX_POWER_SAVE
+  // REF_TICK keeps the baud rate right while DFS changes the APB clock
+  uart_config.source_clk = UART_SCLK_REF_TICK;
+#endif
 
   uart_param_config(UART_NUM, &uart_config);
   uart_set_pin(UART_NUM, UART_TXD_PIN, UART_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-  ESP_ERROR_CHECK(uart_driver_install(UART_NUM, BUF_SIZE * 2, BUF_SIZE * 2, 10, &uart_queue, 0));
+#if CONFIG_UART_ISR_IN_IRAM
+  const int intr_flags = ESP_INTR_FLAG_IRAM;
+#else
+  const int intr_flags = 0;
+#endif
+  ESP_ERROR_CHECK(uart_driver_install(UART_NUM, device.settings.uart_buffer * 2, device.settings.uart_buffer * 2, 10, &uart_queue, intr_flags));
+}
 
-  uart_data = (uint8_t*)malloc(BUF_SIZE);
+static void uart_install_task(void* arg)
+{
+  uart_init();
+  xTaskNotifyGive((TaskHandle_t)arg);
+  vTaskDelete(NULL);
 }
 
-static void uart_task()
+// The driver allocates its interrupt on the calling core, so it is
+// installed from the core the task layout gives the UART interrupt
+void uart_init_on_core()
 {
-  ESP_LOGI("uart", "Recieving uart packets on core %d\n", xPortGetCoreID());
+  if (xPortGetCoreID() == task_layout->uart_isr_core)
+  {
+    uart_init();
+    return;
+  }
+  xTaskCreatePinnedToCore(uart_install_task, "uart_install", 2048, xTaskGetCurrentTaskHandle(),
+                          uxTaskPriorityGet(NULL), NULL, task_layout->uart_isr_core);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
 
-  uint8_t recieved_uart_data_count = 0;
-  uint8_t recieved_uart_data[11];
-  memset(recieved_uart_data, 0, 11);
+#define NVS_NAMESPACE "uartnx"
+#define NVS_KEY_MACRO "macro"
+#define NVS_KEY_SETTINGS "settings"
 
-  while (1)
+// Loads the settings blob, keeps defaults when it is missing, old or out of range
+void settings_load()
+{
+  nvs_handle nvs;
+  size_t size = sizeof(settings_t);
+
+  settings_default(&device.settings);
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
   {
-    int len = uart_read_bytes(UART_NUM, uart_data, BUF_SIZE, portTICK_RATE_MS);
+    return;
+  }
+  if (nvs_get_blob(nvs, NVS_KEY_SETTINGS, &device.settings, &size) != ESP_OK ||
+      !settings_upgrade(&device.settings, size) || !settings_valid(&device.settings))
+  {
+    settings_default(&device.settings);
+  }
+  nvs_close(nvs);
+}
 
-    // 受信データがある
-    if (len > 0)
-    {
-      for(int i=0;i<len;i++)
-      {
-        recieved_uart_data[recieved_uart_data_count++] = uart_data[i];
+void settings_save()
+{
+  static const char* TAG = "settings";
+  nvs_handle nvs;
+  esp_err_t err;
 
-        // 1フレーム分11バイト受信した
-        if(recieved_uart_data_count == 11)
-        {
-          recieved_uart_data_count = 0;
-
-          ESP_LOGI(
-            "uart",
-            "Packet data: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x\n",
-            recieved_uart_data[0], recieved_uart_data[1], recieved_uart_data[2], recieved_uart_data[3],
-            recieved_uart_data[4], recieved_uart_data[5], recieved_uart_data[6], recieved_uart_data[7],
-            recieved_uart_data[8], recieved_uart_data[9], recieved_uart_data[10]);
-
-          // 受信したデータの正当性を確認する
-          if((recieved_uart_data[0] != 0xAA) || (recieved_uart_data[1] != 0xAA) ||
-             (recieved_uart_data[2] != 0xAA) || (recieved_uart_data[3] != 0xAA) ||
-             (recieved_uart_data[4] != 0xAA) || (recieved_uart_data[10] != 0x00))
-          {
-            // 受信したデータの形が不正だった
-            uart_flush(UART_NUM);
-            memset(recieved_uart_data, 0, 11);
-          }
-          else // 受信したデータの形が正常だった
-          {
-            // 入力情報をまとめる
-            ControlInputStatus inputStatus;
-
-            inputStatus.ZR = ((recieved_uart_data[5] >> 7) & 1); // ZR
-            inputStatus.ZL = ((recieved_uart_data[5] >> 6) & 1); // ZL
-            inputStatus.R = ((recieved_uart_data[5] >> 5) & 1); // R
-            inputStatus.L = ((recieved_uart_data[5] >> 4) & 1); // L
-            inputStatus.X = ((recieved_uart_data[5] >> 3) & 1); // X
-            inputStatus.A = ((recieved_uart_data[5] >> 2) & 1); // A
-            inputStatus.B = ((recieved_uart_data[5] >> 1) & 1); // B
-            inputStatus.Y = (recieved_uart_data[5] & 1); // Y
-
-            inputStatus.Capture = ((recieved_uart_data[6] >> 5) & 1); // Capture
-            inputStatus.Home = ((recieved_uart_data[6] >> 4) & 1); // Home
-            inputStatus.StickR_Click = ((recieved_uart_data[6] >> 3) & 1); // StickR_Click
-            inputStatus.StickL_Click = ((recieved_uart_data[6] >> 2) & 1); // StickL_Click            
-            inputStatus.Plus = ((recieved_uart_data[6] >> 1) & 1); // Plus
-            inputStatus.Minus = (recieved_uart_data[6] & 1); // Minus
-
-            // Dpad initialize
-            inputStatus.Dpad_Up = 0;
-            inputStatus.Dpad_Down = 0;
-            inputStatus.Dpad_Left = 0;
-            inputStatus.Dpad_Right = 0;
-
-            switch(recieved_uart_data[7])
-            {
-              case A_DPAD_U:
-                inputStatus.Dpad_Up = 1;
-                break;
-              case A_DPAD_R:
-                inputStatus.Dpad_Right = 1;
-                break;
-              case A_DPAD_D:
-                inputStatus.Dpad_Down = 1;
-                break;
-              case A_DPAD_L:
-                inputStatus.Dpad_Left = 1;
-                break;
-              case A_DPAD_U_R:
-                inputStatus.Dpad_Up = 1;
-                inputStatus.Dpad_Right = 1;
-                break;
-              case A_DPAD_U_L:
-                inputStatus.Dpad_Up = 1;
-                inputStatus.Dpad_Left = 1;
-                break;
-              case A_DPAD_D_R:
-                inputStatus.Dpad_Down = 1;
-                inputStatus.Dpad_Right = 1;
-                break;
-              case A_DPAD_D_L:
-                inputStatus.Dpad_Down = 1;
-                inputStatus.Dpad_Left = 1;
-                break;
-              case A_DPAD_CENTER:
-              default:
-                break;
-            }
-
-            // Stick initialize
-            inputStatus.StickL_X = 128;
-            inputStatus.StickL_Y = 128;
-            inputStatus.StickR_X = 128;
-            inputStatus.StickR_Y = 128;
-
-            // StickL_X
-            if(recieved_uart_data[8] & 0x01) // Left
-            {
-              inputStatus.StickL_X = 0;
-            }
-            else if(recieved_uart_data[8]  & 0x02) // Right
-            {
-              inputStatus.StickL_X = 255;
-            }
-
-            // StickL_Y
-            if(recieved_uart_data[8] & 0x04) // Up
-            {
-              inputStatus.StickL_Y = 255;
-            }
-            else if(recieved_uart_data[8] & 0x08) // Down
-            {
-              inputStatus.StickL_Y = 0;
-            }
-
-            // StickR_X
-            if(recieved_uart_data[9] & 0x01) // Left
-            {
-              inputStatus.StickR_X = 0;
-            }
-            else if(recieved_uart_data[9]  & 0x02) // Right
-            {
-              inputStatus.StickR_X = 255;
-            }
-
-            // StickR_Y
-            if(recieved_uart_data[9] & 0x04) // Up
-            {
-              inputStatus.StickR_Y = 255;
-            }
-            else if(recieved_uart_data[9] & 0x08) // Down
-            {
-              inputStatus.StickR_Y = 0;
-            }
-
-            // まとめた入力情報を送信用データにセットする
-            but1_send = (inputStatus.Y) +       // Y
-                        (inputStatus.X << 1) +  // X
-                        (inputStatus.B << 2) +  // B
-                        (inputStatus.A << 3) +  // A
-                        (inputStatus.R << 6) +  // R
-                        (inputStatus.ZR << 7);  // ZR
-
-            but2_send = (inputStatus.Minus) +     // Minus/Select
-                        (inputStatus.Plus << 1) + // Plus/Start
-                        (inputStatus.StickR_Click << 2) + // R Stick Click
-                        (inputStatus.StickL_Click << 3) + // L Stick Click
-                        (inputStatus.Home << 4) +   // Home
-                        (inputStatus.Capture << 5); // Capture      
-
-            but3_send = (inputStatus.Dpad_Down) +       // Dpad_Down
-                        (inputStatus.Dpad_Up << 1) +    // Dpad_Up
-                        (inputStatus.Dpad_Right << 2) + // Dpad_Right
-                        (inputStatus.Dpad_Left << 3) +  // Dpad_Left
-                        (inputStatus.L << 6) + // L
-                        (inputStatus.ZL << 7); // ZL
-
-            lx_send = inputStatus.StickL_X;
-            ly_send = inputStatus.StickL_Y;
-            rx_send = inputStatus.StickR_X;
-            ry_send = inputStatus.StickR_Y;
-          }
-        }
-      }
+  if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs)) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "nvs open failed: %s", esp_err_to_name(err));
+    return;
+  }
 
-      if (but1_send || but2_send || but3_send)
-      {
-        ESP_LOGI("uart", "but1: %d, but2: %d, but3: %d\n", but1_send, but2_send, but3_send);
-      }
+  xSemaphoreTake(xSemaphore, portMAX_DELAY);
+  settings_t copy = device.settings;
+  xSemaphoreGive(xSemaphore);
 
-      if ((lx_send != 128) || (ly_send != 128) ||
-          (rx_send != 128) || (ry_send != 128))
-      {
-        ESP_LOGI("uart", "lx: %d, ly: %d, cx: %d, cy: %d\n", lx_send, ly_send, rx_send, ry_send);
-      }
-    }
+  err = nvs_set_blob(nvs, NVS_KEY_SETTINGS, &copy, sizeof(settings_t));
+  if (err == ESP_OK)
+  {
+    err = nvs_commit(nvs);
   }
-  vTaskDelete(NULL);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "nvs save failed: %s", esp_err_to_name(err));
+  }
+  nvs_close(nvs);
 }
 
-void send_buttons()
+// Loads turbo/combo config stored by UART_PKT_MACRO_SAVE, keeps defaults otherwise
+void macro_load()
 {
+  nvs_handle nvs;
+  macro_config_t* config = &device.macro.config;
+  size_t size = sizeof(macro_config_t);
+
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+  {
+    return;
+  }
+  if (nvs_get_blob(nvs, NVS_KEY_MACRO, config, &size) != ESP_OK ||
+      size != sizeof(macro_config_t) || config->version != MACRO_CONFIG_VERSION)
+  {
+    macro_config_default(config);
+  }
+  nvs_close(nvs);
+}
+
+void macro_save()
+{
+  static const char* TAG = "macro";
+  nvs_handle nvs;
+  esp_err_t err;
+
+  if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs)) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "nvs open failed: %s", esp_err_to_name(err));
+    return;
+  }
+
   xSemaphoreTake(xSemaphore, portMAX_DELAY);
-  report30[0] = timer;
-  dummy[0] = timer;
-  // buttons
-  report30[2] = but1_send;
-  report30[3] = but2_send;
-  report30[4] = but3_send;
-  // encode left stick
-  report30[5] = (lx_send << 4) & 0xF0;
-  report30[6] = (lx_send & 0xF0) >> 4;
-  report30[7] = ly_send;
-  // encode right stick
-  report30[8] = (rx_send << 4) & 0xF0;
-  report30[9] = (rx_send & 0xF0) >> 4;
-  report30[10] = ry_send;
+  err = nvs_set_blob(nvs, NVS_KEY_MACRO, &device.macro.config, sizeof(macro_config_t));
   xSemaphoreGive(xSemaphore);
 
-  if(timer == 255)
+  if (err == ESP_OK)
   {
-    timer = 0;
+    err = nvs_commit(nvs);
   }
-  else
+  if (err != ESP_OK)
   {
-    timer += 1;
+    ESP_LOGE(TAG, "nvs save failed: %s", esp_err_to_name(err));
   }
+  nvs_close(nvs);
+}
 
-  if (paired || connected)
+static void uart_send_packet(uint8_t type, const uint8_t* payload, uint8_t length)
+{
+  uint8_t packet[UART_PROTO_MAX_PACKET];
+  size_t size = uart_proto_encode(type, payload, length, packet);
+  uart_write_bytes(UART_NUM, (const char*)packet, size);
+}
+
+// TX power of the selected link profile; QoS and poll interval are applied by the HID callbacks
+static void link_apply_tx_power(const link_profile_t* profile)
+{
+  esp_err_t err = esp_bredr_tx_power_set((esp_power_level_t)profile->tx_power_min,
+                                         (esp_power_level_t)profile->tx_power_max);
+  if (err != ESP_OK)
   {
-    esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x30, sizeof(report30), report30);
-    vTaskDelay(15);
+    ESP_LOGE("link", "tx power %s failed: %s", profile->name, esp_err_to_name(err));
   }
-  else
+}
+
+static void send_pairing()
+{
+  xSemaphoreTake(xSemaphore, portMAX_DELAY);
+  pairing_state_t state = device.pairing.state;
+  xSemaphoreGive(xSemaphore);
+
+  ESP_LOGI("pairing", "%s", pairing_state_names[state]);
+  device_send_pairing(&device);
+}
+
+static void baud_check()
+{
+  if (device.baud_pending != 0 && esp_timer_get_time() > baud_deadline)
   {
-    esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x30, sizeof(dummy), dummy);
-    vTaskDelay(100);
+    ESP_LOGE("settings", "baud %" PRIu32 " not confirmed, back to %" PRIu32, device.baud_pending, device.settings.baud);
+    uart_set_baudrate(UART_NUM, device.settings.baud);
+    device.baud_pending = 0;
   }
 }
 
-/// Switch Replies
-
-// Reply for REQUEST_DEVICE_INFO
-static uint8_t reply02[] = {
-  0x00, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x82, 0x02, 0x04, 0x00,
-  CONTROLLER_TYPE,
-        0x02, 0xD4, 0xF0, 0x57, 0x6E, 0xF0, 0xD7,
-  0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+/// device_hooks: what device.c needs from the platform
 
-// Reply for SET_SHIPMENT_STATE
-static uint8_t reply08[] = {
-  0x01, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x80, 0x08, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_lock(void* context)
+{
+  xSemaphoreTake(xSemaphore, portMAX_DELAY);
+}
 
-// Reply for SET_INPUT_REPORT_MODE
-static uint8_t reply03[] = {
-  0x04, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x80, 0x03, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_unlock(void* context)
+{
+  xSemaphoreGive(xSemaphore);
+}
 
-// Trigger buttons elapsed time
-static uint8_t reply04[] = {
-  0x0A, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x83, 0x04, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2c, 0x01,
-  0x2c, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_send_packet(void* context, uint8_t type, const uint8_t* payload, uint8_t length)
+{
+  uart_send_packet(type, payload, length);
+}
 
-// Serial number and controller type (although, our code doesn't read (and as
-// such, report) the controller type from here.)
-static uint8_t spi_reply_address_0[] = {
-  0x02, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x00, 0x60,
-  0x00, 0x00, 0x10, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0x00, 0x00, CONTROLLER_TYPE, 0xA0, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0
-};
-// The CONTROLLER_TYPE is technically unused, but it makes me feel better.
-
-// SPI Flash colors
-static uint8_t spi_reply_address_0x50[] = {
-  0x03, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00,
-  0x00, 0x00, 0x90, 0x10, 0x50, 0x60, 0x00, 0x00, 0x0D, // Start of colors
-  0x23, 0x23, 0x23,                                     // Body color
-  0xff, 0xff, 0xff,                                     // Buttons color
-  0x95, 0x15, 0x15, // Left Grip color (Pro Con)
-  0x15, 0x15, 0x95, // Right Grip color (Pro Con)
-  0xff,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_settings_save(void* context)
+{
+  settings_save();
+}
 
-static uint8_t spi_reply_address_0x80[] = {
-  0x0B, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x80, 0x60,
-  0x00, 0x00, 0x18, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_macro_save(void* context)
+{
+  macro_save();
+}
 
-static uint8_t spi_reply_address_0x98[] = {
-  0x0C, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x98, 0x60,
-  0x00, 0x00, 0x12, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+// UART_PKT_BAUD_PENDING is queued at the old rate; switch once it is out
+static void hooks_baud_change(void* context, uint32_t baud)
+{
+  uart_wait_tx_done(UART_NUM, pdMS_TO_TICKS(1000));
+  uart_set_baudrate(UART_NUM, baud);
+  baud_deadline = esp_timer_get_time() + DEVICE_BAUD_CONFIRM_MS * 1000LL;
+}
 
-// User analog stick calib
-static uint8_t spi_reply_address_0x10[] = {
-  0x0D, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x10, 0x80,
-  0x00, 0x00, 0x18, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_send_report(void* context, uint8_t id, const uint8_t* data, size_t size)
+{
+  esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, id, size, (uint8_t*)data);
+}
 
-static uint8_t spi_reply_address_0x3d[] = {
-  0x0E, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x3D, 0x60,
-  0x00, 0x00, 0x19, 0x00, 0x07, 0x70, 0x00, 0x08,
-  0x80, 0x00, 0x07, 0x70, 0x00, 0x08, 0x80, 0x00,
-  0x07, 0x70, 0x00, 0x07, 0x70, 0xFF, 0xFF, 0xFF,
-  0xFF, 0xFF, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00
-};
+static void hooks_setting_changed(void* context, uint8_t id, const settings_t* updated)
+{
+  if (id == SETTING_LOG_LEVEL)
+  {
+    esp_log_level_set("*", (esp_log_level_t)updated->log_level);
+  }
+  if (id == SETTING_LINK_PROFILE)
+  {
+    link_apply_tx_power(link_profile_get(updated->link_profile));
+    portENTER_CRITICAL(&link_mux);
+    link_poll_slots = 0;
+    portEXIT_CRITICAL(&link_mux);
+  }
+}
 
-static uint8_t spi_reply_address_0x20[] = {
-  0x10, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x90, 0x10, 0x20, 0x60,
-  0x00, 0x00, 0x18, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-  0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00
+static const device_hooks_t device_hooks = {
+  .lock = hooks_lock,
+  .unlock = hooks_unlock,
+  .send_packet = hooks_send_packet,
+  .settings_save = hooks_settings_save,
+  .macro_save = hooks_macro_save,
+  .baud_change = hooks_baud_change,
+  .setting_changed = hooks_setting_changed,
+  .send_report = hooks_send_report,
 };
 
-// Reply for changing the status of the IMU IMU (6-Axis sensor)
-static uint8_t reply4001[] = {
-  0x15, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x80, 0x40, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+static void uart_task()
+{
+  ESP_LOGI("uart", "Recieving uart packets on core %d (%s layout)\n", xPortGetCoreID(), task_layout->name);
 
-static uint8_t reply4801[] = {
-  0x1A, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x80, 0x48, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+  static uart_proto_t proto;
+  uart_proto_init(&proto);
+  const size_t read_size = device.settings.uart_buffer;
 
-// Reply for SubCommand.SET_PLAYER_LIGHTS
-static uint8_t reply3001[] = {
-  0x1C, 0x8E, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x80, 0x30, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+  while (1)
+  {
+    baud_check();
 
-static uint8_t reply3333[] = {
-  0x31, 0x8e, 0x00, 0x00, 0x00, 0x00, 0x08, 0x80,
-  0x00, 0x08, 0x80, 0x00, 0xa0, 0x21, 0x01, 0x00,
-  0x00, 0x00, 0x03, 0x00, 0x05, 0x01, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7b,
-  0x00
-};
+    rumble_event_t rumble;
+    while (xQueueReceive(rumble_queue, &rumble, 0) == pdTRUE)
+    {
+      uint8_t payload[RUMBLE_EVENT_SIZE];
+      uart_send_packet(UART_PKT_RUMBLE_EVENT, payload, rumble_event_encode(&rumble, payload));
+    }
 
-// Reply for SubCommand.SET_NFC_IR_MCU_STATE
-static uint8_t reply3401[] = {
-  0x12, 0x8e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x08, 0x80, 0x00, 0x80, 0x22, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+    int len = uart_read_bytes(UART_NUM, uart_data, read_size, portTICK_RATE_MS);
+    if (len == 0)
+    {
+      // A quiet line is a frame boundary, even after data the parser could not place
+      uart_proto_idle(&proto);
+    }
+
+    // 受信データがある
+    for (int i = 0; i < len; i++)
+    {
+      switch (uart_proto_feed(&proto, uart_data[i]))
+      {
+      case UART_PROTO_FRAME:
+      {
+        const uint8_t* frame = proto.frame;
+        ESP_LOGI(
+          "uart",
+          "Packet data: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x\n",
+          frame[0], frame[1], frame[2], frame[3], frame[4], frame[5],
+          frame[6], frame[7], frame[8], frame[9], frame[10]);
+
+        device_uart_frame(&device, frame);
+
+        controller_input_t input;
+        if (input_decode_frame(frame, &input))
+        {
+          if (input.but1 || input.but2 || input.but3)
+          {
+            ESP_LOGI("uart", "but1: %d, but2: %d, but3: %d\n", input.but1, input.but2, input.but3);
+          }
+
+          if ((input.lx != 128) || (input.ly != 128) ||
+              (input.rx != 128) || (input.ry != 128))
+          {
+            ESP_LOGI("uart", "lx: %d, ly: %d, cx: %d, cy: %d\n", input.lx, input.ly, input.rx, input.ry);
+          }
+        }
+        break;
+      }
+      case UART_PROTO_COMMAND:
+        device_uart_command(&device, proto.command);
+        break;
+      case UART_PROTO_PACKET:
+        if (!device_uart_packet(&device, &proto))
+        {
+          ESP_LOGE("uart", "rejected packet type 0x%02x, length %d", proto.type, proto.length);
+        }
+        break;
+      case UART_PROTO_ERROR:
+        // 受信したデータの形が不正だった
+        ESP_LOGI("uart", "dropped malformed data (%" PRIu32 " so far)", proto.errors);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+// Retransmits the last handshake reply or drops a stalled handshake, see device_pairing_check()
+static void pairing_check()
+{
+  pairing_poll_t poll = device_pairing_check(&device, esp_timer_get_time());
+
+  if (poll == PAIRING_POLL_NONE)
+  {
+    return;
+  }
+  xSemaphoreTake(xSemaphore, portMAX_DELAY);
+  const char* reply = device.pairing.last_reply.name;
+  pairing_state_t state = device.pairing.state;
+  xSemaphoreGive(xSemaphore);
+
+  if (poll == PAIRING_POLL_RETRANSMIT)
+  {
+    ESP_LOGI("pairing", "retransmit %s", reply);
+  }
+  else
+  {
+    ESP_LOGE("pairing", "stalled in %s, disconnecting", pairing_state_names[state]);
+    esp_bt_hid_device_disconnect();
+  }
+}
 
+// Genuine Pro Controllers and Joy-Cons share this descriptor
 static uint8_t hid_descriptor[] = {
   0x05, 0x01, 0x09, 0x05, 0xa1, 0x01, 0x06, 0x01,
   0xff, 0x85, 0x21, 0x09, 0x21, 0x75, 0x08, 0x95,
@@ -558,20 +527,260 @@ static uint8_t hid_descriptor[] = {
 
 int hid_descriptor_len = sizeof(hid_descriptor);
 
-// sending bluetooth values every 15ms
+// send_task notification bits
+#define SEND_EVENT_REPORT (1 << 0) // report timer tick
+#define SEND_EVENT_LINK (1 << 1)   // HID channel opened or closed, see device.pairing.state
+
+static void report_timer_cb(void* arg)
+{
+  xTaskNotify(SendingHandle, SEND_EVENT_REPORT, eSetBits);
+}
+
+// Called from the Bluetooth callbacks after device.pairing.state changed
+static void send_task_link_changed()
+{
+  xTaskNotify(SendingHandle, SEND_EVENT_LINK, eSetBits);
+}
+
+// Created once at boot. Sends a report every device.settings.report_period_us
+// while the HID channel is open and sleeps with the timer stopped otherwise.
 void send_task(void* pvParameters)
 {
   const char* TAG = "send_task";
   ESP_LOGI(TAG, "Sending hid reports on core %d\n", xPortGetCoreID());
+  bool active = false;
 
   while(1)
   {
-    send_buttons();
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+
+    if (events & SEND_EVENT_LINK)
+    {
+      xSemaphoreTake(xSemaphore, portMAX_DELAY);
+      bool up = device.pairing.state != PAIRING_DISCOVERABLE;
+      xSemaphoreGive(xSemaphore);
+
+      if (!up)
+      {
+        // Nothing is sent into a closed link
+        esp_timer_stop(report_timer);
+        device.report_period_us = 0;
+        active = false;
+        continue;
+      }
+      // A new connection gets its first report right away
+      active = true;
+      events |= SEND_EVENT_REPORT;
+    }
+
+    if (!active || !(events & SEND_EVENT_REPORT))
+    {
+      continue;
+    }
+
+    uint32_t period = device_send_report(&device, DUMMY_PERIOD_US);
+    stats_report_sent(device.report_period_us);
+    pairing_check();
+
+    if (period != device.report_period_us)
+    {
+      esp_timer_stop(report_timer);
+      esp_timer_start_periodic(report_timer, period);
+      device.report_period_us = period;
+    }
+  }
+
+  vTaskDelete(NULL);
+}
+
+// Closes a stats window every CONFIG_UARTNX_STATS_INTERVAL_MS and sends it when asked to
+void stats_task(void* pvParameters)
+{
+  static uint8_t payload[UART_PROTO_MAX_PAYLOAD];
+
+  while(1)
+  {
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_UARTNX_STATS_INTERVAL_MS));
+
+    size_t size = stats_cpu_payload(payload);
+    uint8_t link[LINK_WINDOW_ENCODED_SIZE];
+    portENTER_CRITICAL(&link_mux);
+    link_window_close(&link_window, device.settings.link_profile, link_poll_slots, link);
+    portEXIT_CRITICAL(&link_mux);
+
+    if (device.stats_streaming || device.stats_requested)
+    {
+      device.stats_requested = false;
+      uart_send_packet(UART_PKT_STATS_CPU, payload, size);
+      uart_send_packet(UART_PKT_STATS_MEM, payload, stats_mem_payload(payload));
+      uart_send_packet(UART_PKT_LINK, link, sizeof(link));
+    }
+  }
+
+  vTaskDelete(NULL);
+}
+
+#if CONFIG_UARTNX_BENCH
+static uint32_t bench_cycles(void)
+{
+  return cpu_hal_get_cycle_count();
+}
+
+// Times the per-frame, per-report and per-subcommand paths with the cycle counter
+static void run_bench()
+{
+  static const char* TAG = "bench";
+  static uint8_t stream[4096];
+  bench_result_t results[BENCH_COUNT];
+
+  esp_log_level_set(TAG, ESP_LOG_INFO);
+  size_t size = bench_synth_stream(stream, sizeof(stream), 1);
+  bench_run(bench_cycles, stream, size, CONFIG_UARTNX_BENCH_ROUNDS, results);
+
+  for (int i = 0; i < BENCH_COUNT; i++)
+  {
+    uint32_t cycles = results[i].items ? (uint32_t)(results[i].ticks / results[i].items) : 0;
+    ESP_LOGI(TAG, "%-10s %8" PRIu32 " items %6" PRIu32 " cycles/item %6" PRIu32 " ns/item",
+      bench_path_names[i], results[i].items, cycles, cycles * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
   }
+}
+#endif
+
+#if CONFIG_UARTNX_LATENCY_TEST
+#define LATENCY_PROBE_DELAY_US 5000
+#define LATENCY_TIMEOUT_MS 100
+#define LATENCY_LOAD_READS 8 // flash reads between one-tick pauses
+
+static uint32_t latency_samples[CONFIG_UARTNX_LATENCY_SAMPLES];
+static volatile bool latency_load_running;
+
+static void latency_timer_cb(void* arg)
+{
+  xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+// Same path as report_timer_cb -> send_task. One one-shot timer per sample,
+// measured from when it was due: a stall of the esp_timer task or of this one
+// lands in the sample it delays instead of being folded into a later tick.
+static void latency_report_probe(void* arg)
+{
+  esp_timer_handle_t timer;
+  const esp_timer_create_args_t timer_args = {
+    .callback = latency_timer_cb,
+    .arg = xTaskGetCurrentTaskHandle(),
+    .name = "latency",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer));
+
+  for (int i = 0; i < CONFIG_UARTNX_LATENCY_SAMPLES; i++)
+  {
+    // Taken before arming, so the sample errs on the long side
+    int64_t due = esp_timer_get_time() + LATENCY_PROBE_DELAY_US;
+    esp_timer_start_once(timer, LATENCY_PROBE_DELAY_US);
+    bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LATENCY_TIMEOUT_MS)) != 0;
+    int64_t late = esp_timer_get_time() - due;
+    if (!woken)
+    {
+      // A callback still pending must not wake the next sample
+      esp_timer_stop(timer);
+      ulTaskNotifyTake(pdTRUE, 0);
+    }
+    latency_samples[i] = woken ? (uint32_t)(late > 0 ? late : 0) : LATENCY_LOST;
+  }
+
+  esp_timer_delete(timer);
+  xTaskNotifyGive((TaskHandle_t)arg);
+  vTaskDelete(NULL);
+}
+
+// Same path as a host byte reaching uart_task, with TX looped back to RX
+static void latency_uart_probe(void* arg)
+{
+  const uint8_t probe = 0x00; // not a frame, command or packet start for either side
+  uint8_t echo;
+
+  uart_set_loop_back(UART_NUM, true);
+  uart_flush_input(UART_NUM);
+  for (int i = 0; i < CONFIG_UARTNX_LATENCY_SAMPLES; i++)
+  {
+    int64_t start = esp_timer_get_time();
+    uart_write_bytes(UART_NUM, (const char*)&probe, 1);
+    bool echoed = uart_read_bytes(UART_NUM, &echo, 1, pdMS_TO_TICKS(LATENCY_TIMEOUT_MS)) == 1;
+    latency_samples[i] = echoed ? (uint32_t)(esp_timer_get_time() - start) : LATENCY_LOST;
+  }
+  uart_set_loop_back(UART_NUM, false);
+  uart_flush_input(UART_NUM);
+
+  xTaskNotifyGive((TaskHandle_t)arg);
+  vTaskDelete(NULL);
+}
+
+// Reads flash with the cache disabled, the way NVS commits and OTA do
+static void latency_load_task(void* arg)
+{
+  static uint8_t buffer[4096];
+  const esp_partition_t* nvs = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
 
+  while (latency_load_running && nvs != NULL)
+  {
+    for (int i = 0; i < LATENCY_LOAD_READS; i++)
+    {
+      esp_partition_read(nvs, 0, buffer, sizeof(buffer));
+    }
+    // keeps the idle task, and with it the task watchdog, fed
+    vTaskDelay(1);
+  }
+  xTaskNotifyGive((TaskHandle_t)arg);
   vTaskDelete(NULL);
 }
 
+static void latency_measure(const char* probe_name, TaskFunction_t probe, task_id_t slot, bool load)
+{
+  static const char* TAG = "latency";
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  const task_slot_t* task = &task_layout->tasks[slot];
+
+  latency_load_running = load;
+  if (load)
+  {
+    // on the core that is not the probe's, so only the cache stall shows
+    BaseType_t core = task->core == 0 ? 1 : 0;
+    xTaskCreatePinnedToCore(latency_load_task, "latency_load", 2048, self, 1, NULL, core);
+  }
+  xTaskCreatePinnedToCore(probe, "latency", 2048, self, task->priority, NULL, task_core(task));
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  if (load)
+  {
+    latency_load_running = false;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+
+  latency_summary_t summary;
+  latency_summarize(latency_samples, CONFIG_UARTNX_LATENCY_SAMPLES, &summary);
+  ESP_LOGI(TAG, "%-6s %-5s %4" PRIu32 " samples %3" PRIu32 " lost min %5" PRIu32 " p50 %5" PRIu32 " p99 %5" PRIu32
+    " max %5" PRIu32 " avg %5" PRIu32 " us", probe_name, load ? "flash" : "idle", summary.count, summary.lost,
+    summary.min_us, summary.p50_us, summary.p99_us, summary.max_us, summary.avg_us);
+}
+
+// Wake-up latency of the report and UART paths in the current task layout
+static void run_latency_test()
+{
+#if CONFIG_UART_ISR_IN_IRAM
+  const char* isr = "in IRAM";
+#else
+  const char* isr = "in flash";
+#endif
+  esp_log_level_set("latency", ESP_LOG_INFO);
+  ESP_LOGI("latency", "%s layout, UART ISR %s, %" PRIu32 " baud", task_layout->name, isr, device.settings.baud);
+
+  latency_measure("report", latency_report_probe, TASK_SEND, false);
+  latency_measure("report", latency_report_probe, TASK_SEND, true);
+  latency_measure("uart", latency_uart_probe, TASK_UART, false);
+  latency_measure("uart", latency_uart_probe, TASK_UART, true);
+}
+#endif
+
 // LED blink
 void startBlink()
 {
@@ -671,6 +880,25 @@ static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *pa
       ESP_LOGE(TAG, "authentication failed, status:%d", param->auth_cmpl.stat);
     }
     break;
+  case ESP_BT_GAP_MODE_CHG_EVT:
+    ESP_LOGI(TAG, "ESP_BT_GAP_MODE_CHG_EVT mode:%d", param->mode_chg.mode);
+    portENTER_CRITICAL(&link_mux);
+    link_window_mode(&link_window, param->mode_chg.mode == ESP_BT_PM_MD_SNIFF);
+    portEXIT_CRITICAL(&link_mux);
+    break;
+  case ESP_BT_GAP_QOS_CMPL_EVT:
+    if (param->qos_cmpl.stat == ESP_BT_STATUS_SUCCESS)
+    {
+      ESP_LOGI(TAG, "poll interval %" PRIu32 " slots", param->qos_cmpl.t_poll);
+      portENTER_CRITICAL(&link_mux);
+      link_poll_slots = (uint16_t)param->qos_cmpl.t_poll;
+      portEXIT_CRITICAL(&link_mux);
+    }
+    else
+    {
+      ESP_LOGE(TAG, "qos failed, status:%d", param->qos_cmpl.stat);
+    }
+    break;
   default:
     break;
   }
@@ -737,16 +965,21 @@ void esp_bt_hidd_cb(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
         esp_bt_gap_set_scan_mode(ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
 
         xSemaphoreTake(xSemaphore, portMAX_DELAY);
-        connected = true;
+        pairing_connected(&device.pairing, esp_timer_get_time());
         xSemaphoreGive(xSemaphore);
-
-        //restart send_task
-        if(SendingHandle != NULL)
+        send_task_link_changed();
+        send_pairing();
+
+        portENTER_CRITICAL(&link_mux);
+        link_window_restart(&link_window);
+        link_poll_slots = 0;
+        portEXIT_CRITICAL(&link_mux);
+        const link_profile_t* profile = link_profile_get(device.settings.link_profile);
+        if (profile->poll_slots != 0)
         {
-          vTaskDelete(SendingHandle);
-          SendingHandle = NULL;
+          // the console is master and may grant a different interval (ESP_BT_GAP_QOS_CMPL_EVT)
+          esp_bt_gap_set_qos(param->open.bd_addr, profile->poll_slots);
         }
-        xTaskCreatePinnedToCore(send_task, "send_task", 4096, NULL, 2, &SendingHandle, 0);
       }
       else
       {
@@ -773,8 +1006,16 @@ void esp_bt_hidd_cb(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
         esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
 
         xSemaphoreTake(xSemaphore, portMAX_DELAY);
-        connected = false;
+        bool changed = pairing_disconnected(&device.pairing, esp_timer_get_time());
         xSemaphoreGive(xSemaphore);
+        portENTER_CRITICAL(&link_mux);
+        link_poll_slots = 0;
+        portEXIT_CRITICAL(&link_mux);
+        if (changed)
+        {
+          send_task_link_changed();
+          send_pairing();
+        }
       }
       else
       {
@@ -789,9 +1030,18 @@ void esp_bt_hidd_cb(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
   case ESP_HIDD_SEND_REPORT_EVT:
     ESP_LOGI(TAG, "ESP_HIDD_SEND_REPORT_EVT id:0x%02x, type:%d", param->send_report.report_id,
       param->send_report.report_type);
+    if (param->send_report.report_id == 0x30)
+    {
+      portENTER_CRITICAL(&link_mux);
+      link_window_done(&link_window, param->send_report.status == ESP_HIDD_SUCCESS, esp_timer_get_time());
+      portEXIT_CRITICAL(&link_mux);
+    }
     break;
   case ESP_HIDD_REPORT_ERR_EVT:
     ESP_LOGI(TAG, "ESP_HIDD_REPORT_ERR_EVT");
+    portENTER_CRITICAL(&link_mux);
+    link_window_done(&link_window, false, esp_timer_get_time());
+    portEXIT_CRITICAL(&link_mux);
     break;
   case ESP_HIDD_GET_REPORT_EVT:
     ESP_LOGI(TAG, "ESP_HIDD_GET_REPORT_EVT id:0x%02x, type:%d, size:%d", param->get_report.report_id,
@@ -814,89 +1064,30 @@ void esp_bt_hidd_cb(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
   case ESP_HIDD_INTR_DATA_EVT:
     ESP_LOGI(TAG, "ESP_HIDD_INTR_DATA_EVT id:0x%02x", param->intr_data.report_id);
     esp_log_buffer_hex(TAG, param->intr_data.data, param->intr_data.len);
-    if (param->intr_data.data[9] == 2)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply02), reply02);
-      ESP_LOGI(TAG, "reply02");
-    }
-    if (param->intr_data.data[9] == 8)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply08), reply08);
-      ESP_LOGI(TAG, "reply08");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 0 && param->intr_data.data[11] == 96)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0), spi_reply_address_0);
-      ESP_LOGI(TAG, "replyspi0");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 80 && param->intr_data.data[11] == 96) {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x50), spi_reply_address_0x50);
-      ESP_LOGI(TAG, "replyspi50");
-    }
-    if (param->intr_data.data[9] == 3)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply03), reply03);
-      ESP_LOGI(TAG, "reply03");
-    }
-    if (param->intr_data.data[9] == 4)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply04), reply04);
-      ESP_LOGI(TAG, "reply04");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 128 && param->intr_data.data[11] == 96)
+    // Both 0x01 (rumble + subcommand) and 0x10 (rumble only) carry rumble in bytes 1-8
+    if ((param->intr_data.report_id == 0x01 || param->intr_data.report_id == 0x10) &&
+        param->intr_data.len >= 1 + RUMBLE_DATA_SIZE)
     {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x80), spi_reply_address_0x80);
-      ESP_LOGI(TAG, "replyspi80");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 152 && param->intr_data.data[11] == 96)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x98), spi_reply_address_0x98);
-      ESP_LOGI(TAG, "replyspi98");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 16 && param->intr_data.data[11] == 128)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x10), spi_reply_address_0x10);
-      ESP_LOGI(TAG, "replyspi10");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 61 && param->intr_data.data[11] == 96)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x3d), spi_reply_address_0x3d);
-      ESP_LOGI(TAG, "reply3d");
-    }
-    if (param->intr_data.data[9] == 16 && param->intr_data.data[10] == 32 && param->intr_data.data[11] == 96)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(spi_reply_address_0x20), spi_reply_address_0x20);
-      ESP_LOGI(TAG, "replyspi20");
-    }
-    if (param->intr_data.data[9] == 64)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply4001), reply4001);
-      ESP_LOGI(TAG, "reply4001");
-    }
-    if (param->intr_data.data[9] == 72)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply4801), reply4801);
-      ESP_LOGI(TAG, "reply4801");
-    }
-    if (param->intr_data.data[9] == 34)
-    {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply3401), reply3401);
-      ESP_LOGI(TAG, "reply3401");
+      rumble_event_t rumble;
+      if (rumble_filter(&rumble_state, &param->intr_data.data[1], &rumble))
+      {
+        rumble.time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        if (xQueueSend(rumble_queue, &rumble, 0) != pdTRUE)
+        {
+          stats_rumble_dropped();
+        }
+      }
     }
-    if (param->intr_data.data[9] == 48)
+    subcommand_reply_t reply;
+    device_output_t output = device_output_report(&device, param->intr_data.data, param->intr_data.len,
+                                                  esp_timer_get_time(), &reply);
+    if (output != DEVICE_OUTPUT_NONE)
     {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply3001), reply3001);
-      ESP_LOGI(TAG, "reply3001");
-      // if (CONTROLLER_TYPE == JOYCON_L)
-      // {
-      //   paired = true;
-      // }
+      ESP_LOGI(TAG, "%s", reply.name);
     }
-    if (param->intr_data.data[9] == 33 && param->intr_data.data[10] == 33)
+    if (output == DEVICE_OUTPUT_PAIRING)
     {
-      esp_bt_hid_device_send_report(ESP_HIDD_REPORT_TYPE_INTRDATA, 0x21, sizeof(reply3333), reply3333);
-      ESP_LOGI(TAG, "reply3333");
-      paired = true;
+      send_pairing();
     }
     break;
   case ESP_HIDD_VC_UNPLUG_EVT:
@@ -927,14 +1118,86 @@ void esp_bt_hidd_cb(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
 
 void app_main()
 {
-  esp_log_level_set("*", ESP_LOG_ERROR);
+  esp_err_t ret;
+
+  // Settings decide the UART and log setup, so NVS comes up first
+  ret = nvs_flash_init();
+  if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+  {
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    ret = nvs_flash_init();
+  }
+  ESP_ERROR_CHECK( ret );
+  settings_load();
+
+  esp_log_level_set("*", (esp_log_level_t)device.settings.log_level);
   // esp_log_level_set("*", ESP_LOG_WARN);
   // esp_log_level_set("*", ESP_LOG_INFO);
 
   // esp_log_level_set("uart", ESP_LOG_INFO);
 
-  uart_init();
-  xTaskCreatePinnedToCore(uart_task, "uart_task", 2048, NULL, 1, &ButtonsHandle, 1);
+#if CONFIG_UARTNX_POWER_SAVE
+  // Tickless idle drops into light sleep whenever no task is ready;
+  // the report timer and UART RX wake the chip back up
+  esp_pm_config_esp32_t pm_config = {
+    .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+    .min_freq_mhz = 40,
+    .light_sleep_enable = true,
+  };
+  ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif
+
+#if CONFIG_UARTNX_STATIC_ALLOC
+  static StaticSemaphore_t semaphore_buffer;
+  static StaticQueue_t rumble_queue_buffer;
+  static uint8_t rumble_queue_storage[16 * sizeof(rumble_event_t)];
+  xSemaphore = xSemaphoreCreateMutexStatic(&semaphore_buffer);
+  rumble_queue = xQueueCreateStatic(16, sizeof(rumble_event_t), rumble_queue_storage, &rumble_queue_buffer);
+#else
+  xSemaphore = xSemaphoreCreateMutex();
+  rumble_queue = xQueueCreate(16, sizeof(rumble_event_t));
+#endif
+  static const pairing_config_t pairing_config = {
+    .retransmit_us = CONFIG_UARTNX_PAIRING_RETRANSMIT_MS * 1000LL,
+    .retries = CONFIG_UARTNX_PAIRING_RETRIES,
+    .timeout_us = CONFIG_UARTNX_PAIRING_TIMEOUT_MS * 1000LL,
+  };
+#if CONFIG_UARTNX_RECORDER
+  recorder_init(&recorder, recorder_storage, CONFIG_UARTNX_RECORDER_REPORTS);
+  device_init(&device, &device_hooks, NULL, &pairing_config, &recorder);
+#else
+  device_init(&device, &device_hooks, NULL, &pairing_config, NULL);
+#endif
+  macro_load();
+  stats_init();
+  task_layout = task_layout_get(CONFIG_UARTNX_TASK_LAYOUT);
+  assert(task_layout != NULL);
+#if CONFIG_UARTNX_BENCH
+  run_bench();
+#endif
+
+  const esp_timer_create_args_t report_timer_args = {
+    .callback = report_timer_cb,
+    .name = "report",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&report_timer_args, &report_timer));
+  // Lives for the whole uptime; link changes only pause and resume it
+  APP_TASK_START(send_task, "send_task", SEND_TASK_STACK, TASK_SEND, &SendingHandle);
+
+  uart_init_on_core();
+#if CONFIG_UARTNX_LATENCY_TEST
+  // Before uart_task starts, so the probe owns the UART
+  run_latency_test();
+#endif
+#if CONFIG_UARTNX_POWER_SAVE
+  // The bytes that wake the chip are lost. A legacy frame that loses part of
+  // its 0xAA header is dropped and the parser picks up at the next frame;
+  // packets and commands have no header to check, so hosts send a few 0x00
+  // bytes first after a quiet line (see README)
+  uart_set_wakeup_threshold(UART_NUM, 3);
+  esp_sleep_enable_uart_wakeup(UART_NUM);
+#endif
+  APP_TASK_START(uart_task, "uart_task", UART_TASK_STACK, TASK_UART, &ButtonsHandle);
 
   // flash LED
   vTaskDelay(100);
@@ -949,11 +1212,8 @@ void app_main()
   gpio_set_level(LED_GPIO, 0);
 
   const char* TAG = "app_main";
-  esp_err_t ret;
   static esp_bt_cod_t dclass;
 
-  xSemaphore = xSemaphoreCreateMutex();
-
   gpio_config_t io_conf;
   io_conf.intr_type = GPIO_INTR_DISABLE;
   io_conf.mode = GPIO_MODE_OUTPUT;
@@ -969,20 +1229,20 @@ void app_main()
   app_param.subclass = 0x8;
   app_param.desc_list = hid_descriptor;
   app_param.desc_list_len = hid_descriptor_len;
+  // Both HID channels get the QoS of the link profile selected at boot
+  const link_profile_t* link = link_profile_get(device.settings.link_profile);
   memset(&both_qos, 0, sizeof(esp_hidd_qos_param_t));
+  both_qos.service_type = link->service_type;
+  both_qos.token_rate = 0xFFFFFFFF;
+  both_qos.token_bucket_size = 0xFFFFFFFF;
+  both_qos.peak_bandwidth = 0xFFFFFFFF;
+  both_qos.access_latency = link->access_latency_us;
+  both_qos.delay_variation = 0xFFFFFFFF;
 
   dclass.minor = 2;
   dclass.major = 5;
   dclass.service = 1;
 
-	ret = nvs_flash_init();
-  if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-  {
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    ret = nvs_flash_init();
-  }
-  ESP_ERROR_CHECK( ret );
-
 	ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
 
 	esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
@@ -997,6 +1257,7 @@ void app_main()
     ESP_LOGE(TAG, "enable controller failed: %s\n",  esp_err_to_name(ret));
     return;
   }
+  link_apply_tx_power(link);
 
   if ((ret = esp_bluedroid_init()) != ESP_OK)
   {
@@ -1017,7 +1278,7 @@ void app_main()
   }
 
   ESP_LOGI(TAG, "setting device name");
-  esp_bt_dev_set_device_name("Pro Controller");
+  esp_bt_dev_set_device_name(device.settings.device_name);
 
   ESP_LOGI(TAG, "setting hid device class");
   esp_bt_gap_set_cod(dclass, ESP_BT_SET_COD_ALL);
@@ -1031,5 +1292,12 @@ void app_main()
   // esp_hid_device_connect
 
   // start blinking
-  xTaskCreate(startBlink, "blink_task", 1024, NULL, 2, &BlinkHandle);
+  APP_TASK_START(startBlink, "blink_task", BLINK_TASK_STACK, TASK_BLINK, &BlinkHandle);
+  APP_TASK_START(stats_task, "stats_task", STATS_TASK_STACK, TASK_STATS, &StatsHandle);
+
+  stats_watch_task("uart", &ButtonsHandle, UART_TASK_STACK);
+  stats_watch_task("send", &SendingHandle, SEND_TASK_STACK);
+  stats_watch_task("blink", &BlinkHandle, BLINK_TASK_STACK);
+  stats_watch_task("stats", &StatsHandle, STATS_TASK_STACK);
+  stats_boot_done();
 }
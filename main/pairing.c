@@ -0,0 +1,176 @@
+// Pairing handshake state machine
+
+#include "pairing.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+
+#define SPI_ALL ((1u << SUBCOMMAND_SPI_BLOCKS) - 1)
+
+const char* const pairing_state_names[PAIRING_STATE_COUNT] = {
+  "discoverable", "connected", "info", "spi", "input_mode", "paired",
+};
+
+static void reset(pairing_t* pairing)
+{
+  pairing->state = PAIRING_DISCOVERABLE;
+  pairing->spi_read = 0;
+  pairing->last_reply.body = NULL;
+  pairing->reply_retries = 0;
+  for (int i = 0; i < PAIRING_STATE_COUNT; i++)
+  {
+    pairing->reached_ms[i] = PAIRING_NOT_REACHED;
+  }
+}
+
+void pairing_init(pairing_t* pairing, const pairing_config_t* config)
+{
+  memset(pairing, 0, sizeof(pairing_t));
+  pairing->config = *config;
+  reset(pairing);
+}
+
+// Records when a milestone first happened; the state only moves forward
+static bool reach(pairing_t* pairing, pairing_state_t milestone, int64_t now_us)
+{
+  if (pairing->reached_ms[milestone] == PAIRING_NOT_REACHED)
+  {
+    pairing->reached_ms[milestone] = (uint32_t)((now_us - pairing->connected_us) / 1000);
+  }
+  if (milestone <= pairing->state)
+  {
+    return false;
+  }
+  pairing->state = milestone;
+  pairing->progress_us = now_us;
+  return true;
+}
+
+bool pairing_connected(pairing_t* pairing, int64_t now_us)
+{
+  reset(pairing);
+  pairing->connected_us = now_us;
+  pairing->first_report = false;
+  pairing->connections++;
+  return reach(pairing, PAIRING_CONNECTED, now_us);
+}
+
+bool pairing_disconnected(pairing_t* pairing, int64_t now_us)
+{
+  if (pairing->state == PAIRING_DISCOVERABLE)
+  {
+    return false;
+  }
+  reset(pairing);
+  pairing->dropped_us = now_us;
+  pairing->drops++;
+  return true;
+}
+
+void pairing_report_sent(pairing_t* pairing, int64_t now_us)
+{
+  if (pairing->state == PAIRING_DISCOVERABLE || pairing->first_report)
+  {
+    return;
+  }
+  pairing->first_report = true;
+  pairing->latency_us = (uint32_t)(now_us - pairing->connected_us);
+  if (pairing->latency_us > pairing->latency_max_us)
+  {
+    pairing->latency_max_us = pairing->latency_us;
+  }
+  if (pairing->dropped_us != 0)
+  {
+    pairing->outage_ms = (uint32_t)((now_us - pairing->dropped_us) / 1000);
+  }
+}
+
+bool pairing_replied(pairing_t* pairing, uint8_t id, const subcommand_reply_t* reply, int64_t now_us)
+{
+  bool changed = false;
+
+  if (pairing->state == PAIRING_DISCOVERABLE)
+  {
+    return false;
+  }
+
+  if (id == 0x02)
+  {
+    changed |= reach(pairing, PAIRING_INFO, now_us);
+  }
+  if (reply->spi_block >= 0)
+  {
+    pairing->spi_read |= 1u << reply->spi_block;
+    if (pairing->spi_read == SPI_ALL)
+    {
+      changed |= reach(pairing, PAIRING_SPI, now_us);
+    }
+  }
+  if (id == 0x03)
+  {
+    changed |= reach(pairing, PAIRING_INPUT_MODE, now_us);
+  }
+  if (reply->action == SUBCOMMAND_ACTION_PAIRED)
+  {
+    changed |= reach(pairing, PAIRING_PAIRED, now_us);
+  }
+
+  // Every new request proves the previous reply arrived, and that the
+  // console is still busy with the handshake even if nothing moved forward
+  pairing->last_reply = *reply;
+  pairing->reply_us = now_us;
+  pairing->reply_retries = 0;
+  pairing->progress_us = now_us;
+  return changed;
+}
+
+pairing_poll_t pairing_poll(pairing_t* pairing, int64_t now_us)
+{
+  const pairing_config_t* config = &pairing->config;
+
+  // From INPUT_MODE on there is neither a timeout nor a retransmit: reports
+  // already flow, a console reconnecting to a known controller may never
+  // send 0x21 0x21, and a console that missed a reply asks again itself,
+  // so the last reply would only be repeated after it was taken
+  if (pairing->state == PAIRING_DISCOVERABLE || pairing->state >= PAIRING_INPUT_MODE)
+  {
+    return PAIRING_POLL_NONE;
+  }
+
+  if (now_us - pairing->progress_us > config->timeout_us)
+  {
+    pairing->timeouts++;
+    return PAIRING_POLL_TIMEOUT;
+  }
+
+  if (pairing->last_reply.body != NULL && pairing->reply_retries < config->retries &&
+      now_us - pairing->reply_us > config->retransmit_us)
+  {
+    pairing->reply_retries++;
+    pairing->reply_us = now_us;
+    pairing->retransmits++;
+    return PAIRING_POLL_RETRANSMIT;
+  }
+  return PAIRING_POLL_NONE;
+}
+
+size_t pairing_encode(const pairing_t* pairing, uint8_t* out)
+{
+  size_t size = 0;
+
+  out[size++] = pairing->state;
+  for (int i = PAIRING_CONNECTED; i < PAIRING_STATE_COUNT; i++)
+  {
+    le_put_u32(&out[size], pairing->reached_ms[i]);
+    size += 4;
+  }
+  le_put_u16(&out[size], pairing->retransmits);
+  le_put_u16(&out[size + 2], pairing->timeouts);
+  le_put_u16(&out[size + 4], pairing->connections);
+  le_put_u16(&out[size + 6], pairing->drops);
+  le_put_u32(&out[size + 8], pairing->latency_us);
+  le_put_u32(&out[size + 12], pairing->latency_max_us);
+  le_put_u32(&out[size + 16], pairing->outage_ms);
+  return size + 20;
+}
@@ -0,0 +1,110 @@
+// Pairing handshake state machine
+//
+// Follows the console through the handshake it runs after the HID channel
+// opens: device info (0x02), SPI flash reads (0x10), input report mode
+// (0x03) and finally 0x21 0x21 (or the player lights, see profile.h).
+// The console does not ask in this order (0x03 comes before most SPI
+// reads), so the state is the furthest milestone reached and each
+// milestone keeps the time it actually happened.
+//
+// Until the input mode is set, the last reply is sent again when the
+// console stays quiet, and a console that goes silent in a handshake state
+// for too long gets the link dropped so it starts over. The time each
+// milestone was reached is kept for UART_PKT_PAIRING, together with how
+// long each connection took to carry its first report.
+
+#ifndef PAIRING_H
+#define PAIRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "subcommand.h"
+
+typedef enum
+{
+  PAIRING_DISCOVERABLE = 0, // no HID channel
+  PAIRING_CONNECTED,        // channel open, waiting for the device info request
+  PAIRING_INFO,             // device info sent
+  PAIRING_SPI,              // every SPI block the console needs has been read
+  PAIRING_INPUT_MODE,       // input report mode set, full reports flow from here
+  PAIRING_PAIRED,
+  PAIRING_STATE_COUNT,
+} pairing_state_t;
+
+typedef enum
+{
+  PAIRING_POLL_NONE = 0,
+  PAIRING_POLL_RETRANSMIT, // send last_reply again
+  PAIRING_POLL_TIMEOUT,    // disconnect, the console retries from scratch
+} pairing_poll_t;
+
+#define PAIRING_NOT_REACHED 0xFFFFFFFF
+// state (u8), reached ms (u32 LE) for CONNECTED..PAIRED, retransmits (u16 LE), timeouts (u16 LE),
+// connections (u16 LE), drops (u16 LE), first report latency last and max (u32 LE us),
+// last outage (u32 LE ms, from a drop to the first report after reconnecting)
+#define PAIRING_ENCODED_SIZE (1 + 4 * (PAIRING_STATE_COUNT - 1) + 2 + 2 + 2 + 2 + 4 + 4 + 4)
+
+typedef struct
+{
+  int64_t retransmit_us; // quiet time before the last reply is sent again
+  uint8_t retries;       // per reply
+  int64_t timeout_us;    // silence allowed in CONNECTED, INFO and SPI
+} pairing_config_t;
+
+typedef struct
+{
+  pairing_config_t config;
+  pairing_state_t state;
+
+  int64_t connected_us;
+  int64_t progress_us;   // last state change or subcommand
+  uint32_t reached_ms[PAIRING_STATE_COUNT]; // since connected, PAIRING_NOT_REACHED otherwise
+  uint32_t spi_read;     // bit per SUBCOMMAND_SPI_BLOCKS entry
+
+  subcommand_reply_t last_reply;
+  int64_t reply_us;
+  uint8_t reply_retries;
+
+  int64_t dropped_us;    // last drop, 0 before the first one
+  bool first_report;     // the current connection has carried a report
+
+  // since boot
+  uint16_t retransmits;
+  uint16_t timeouts;
+  uint16_t connections;
+  uint16_t drops;
+  uint32_t latency_us; // channel open to first report, last connection
+  uint32_t latency_max_us;
+  uint32_t outage_ms;  // drop to first report, last reconnection
+} pairing_t;
+
+void pairing_init(pairing_t* pairing, const pairing_config_t* config);
+
+// HID channel opened / closed. Return true when the state changed.
+bool pairing_connected(pairing_t* pairing, int64_t now_us);
+bool pairing_disconnected(pairing_t* pairing, int64_t now_us);
+
+// A report was handed to the stack; the first one per connection sets the latencies
+void pairing_report_sent(pairing_t* pairing, int64_t now_us);
+
+// Records a reply that was just sent for subcommand id. Returns true when the state changed.
+bool pairing_replied(pairing_t* pairing, uint8_t id, const subcommand_reply_t* reply, int64_t now_us);
+
+// Called once per report; tells the caller to retransmit or give up.
+// Both only happen before PAIRING_INPUT_MODE.
+pairing_poll_t pairing_poll(pairing_t* pairing, int64_t now_us);
+
+// Full 0x30 reports from here on; before that only the short report
+static inline bool pairing_live(const pairing_t* pairing)
+{
+  return pairing->state >= PAIRING_INPUT_MODE;
+}
+
+// Payload of UART_PKT_PAIRING. Returns PAIRING_ENCODED_SIZE.
+size_t pairing_encode(const pairing_t* pairing, uint8_t* out);
+
+extern const char* const pairing_state_names[PAIRING_STATE_COUNT];
+
+#endif
@@ -0,0 +1,97 @@
+// Compile-time controller profile (Pro Controller, Joy-Con L, Joy-Con R)
+//
+// Selected with CONFIG_CONTROLLER_PROFILE_* (menuconfig, or
+// sdkconfig.defaults.joycon_l / sdkconfig.defaults.joycon_r). Everything
+// that differs between controllers resolves to constants here, so the
+// per-report path has no profile branches.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#include "input.h"
+
+#define PRO_CON 0x03
+#define JOYCON_L 0x01
+#define JOYCON_R 0x02
+
+// Neutral stick bytes as reported by a connected stick, and by a missing one
+#define PROFILE_STICK_NEUTRAL 0x00, 0x08, 0x80
+#define PROFILE_STICK_ABSENT 0x00, 0x00, 0x00
+
+#if defined(CONFIG_CONTROLLER_PROFILE_JOYCON_L)
+
+#define CONTROLLER_TYPE JOYCON_L
+#define PROFILE_DEVICE_NAME "Joy-Con (L)"
+// Buttons physically present, in but1/but2/but3 bit layout
+#define PROFILE_BUT1_MASK 0x00 // (none on the right side)
+#define PROFILE_BUT2_MASK 0x29 // -, Ls, Capture
+#define PROFILE_BUT3_MASK 0xFF // D, U, R, L, SR, SL, L, ZL
+#define PROFILE_HAS_LSTICK 1
+#define PROFILE_HAS_RSTICK 0
+// SPI 0x6050: body, buttons, left grip, right grip
+#define PROFILE_COLORS 0x0A, 0xB9, 0xE6, 0x00, 0x1E, 0x1E, 0x0A, 0xB9, 0xE6, 0x0A, 0xB9, 0xE6
+// Joy-Con (L) is treated as paired once the player lights are set
+#define PROFILE_PAIRED_ON_PLAYER_LIGHTS 1
+
+#elif defined(CONFIG_CONTROLLER_PROFILE_JOYCON_R)
+
+#define CONTROLLER_TYPE JOYCON_R
+#define PROFILE_DEVICE_NAME "Joy-Con (R)"
+#define PROFILE_BUT1_MASK 0xFF // Y, X, B, A, SR, SL, R, ZR
+#define PROFILE_BUT2_MASK 0x16 // +, Rs, Home
+#define PROFILE_BUT3_MASK 0x00 // (none on the left side)
+#define PROFILE_HAS_LSTICK 0
+#define PROFILE_HAS_RSTICK 1
+#define PROFILE_COLORS 0xFF, 0x3C, 0x28, 0x1E, 0x0A, 0x0A, 0xFF, 0x3C, 0x28, 0xFF, 0x3C, 0x28
+#define PROFILE_PAIRED_ON_PLAYER_LIGHTS 0
+
+#else // CONFIG_CONTROLLER_PROFILE_PRO_CON
+
+#define CONTROLLER_TYPE PRO_CON
+#define PROFILE_DEVICE_NAME "Pro Controller"
+#define PROFILE_BUT1_MASK 0xCF // Y, X, B, A, R, ZR
+#define PROFILE_BUT2_MASK 0x3F // -, +, Rs, Ls, H, Cap
+#define PROFILE_BUT3_MASK 0xCF // D, U, R, L, L, ZL
+#define PROFILE_HAS_LSTICK 1
+#define PROFILE_HAS_RSTICK 1
+#define PROFILE_COLORS 0x23, 0x23, 0x23, 0xFF, 0xFF, 0xFF, 0x95, 0x15, 0x15, 0x15, 0x15, 0x95
+#define PROFILE_PAIRED_ON_PLAYER_LIGHTS 0
+
+#endif
+
+#if PROFILE_HAS_LSTICK
+#define PROFILE_LSTICK_IDLE PROFILE_STICK_NEUTRAL
+#else
+#define PROFILE_LSTICK_IDLE PROFILE_STICK_ABSENT
+#endif
+
+#if PROFILE_HAS_RSTICK
+#define PROFILE_RSTICK_IDLE PROFILE_STICK_NEUTRAL
+#else
+#define PROFILE_RSTICK_IDLE PROFILE_STICK_ABSENT
+#endif
+
+// Writes bytes 2-10 of a 0x30 report with only the controls this profile has
+static inline void profile_encode_report(uint8_t* report, const controller_input_t* input)
+{
+  input_encode_report(report, input);
+
+  report[2] &= PROFILE_BUT1_MASK;
+  report[3] &= PROFILE_BUT2_MASK;
+  report[4] &= PROFILE_BUT3_MASK;
+
+#if !PROFILE_HAS_LSTICK
+  report[5] = report[6] = report[7] = 0;
+#endif
+#if !PROFILE_HAS_RSTICK
+  report[8] = report[9] = report[10] = 0;
+#endif
+}
+
+#endif
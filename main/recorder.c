@@ -0,0 +1,179 @@
+// Input recorder: the exact 0x30 reports sent to the console
+
+#include "recorder.h"
+
+#include "little_endian.h"
+
+void recorder_init(recorder_t* recorder, recorder_entry_t* storage, uint32_t capacity)
+{
+  recorder->entries = storage;
+  recorder->capacity = capacity;
+  recorder->head = 0;
+  recorder->active = false;
+}
+
+void recorder_start(recorder_t* recorder)
+{
+  recorder->head = 0;
+  recorder->active = true;
+}
+
+void recorder_stop(recorder_t* recorder)
+{
+  recorder->active = false;
+}
+
+uint32_t recorder_count(const recorder_t* recorder)
+{
+  return recorder->head < recorder->capacity ? recorder->head : recorder->capacity;
+}
+
+uint32_t recorder_overwritten(const recorder_t* recorder)
+{
+  return recorder->head - recorder_count(recorder);
+}
+
+uint32_t recorder_first(const recorder_t* recorder)
+{
+  if (recorder->head == 0)
+  {
+    return 0;
+  }
+  return recorder->entries[recorder_overwritten(recorder) & (recorder->capacity - 1)].report;
+}
+
+void recorder_dump_begin(const recorder_t* recorder, recorder_cursor_t* cursor)
+{
+  memset(cursor, 0, sizeof(recorder_cursor_t));
+  cursor->index = recorder_overwritten(recorder);
+  cursor->end = recorder->head;
+}
+
+static size_t encode(const recorder_cursor_t* cursor, const recorder_entry_t* entry, bool first, uint8_t* out)
+{
+  size_t n = 0;
+  uint32_t gap = entry->report - cursor->report - 1;
+
+  if (first || gap >= 0xFF)
+  {
+    out[n++] = 0xFF;
+    le_put_u32(&out[n], entry->report);
+    n += 4;
+  }
+  else
+  {
+    out[n++] = (uint8_t)gap;
+  }
+
+  uint8_t* groups = &out[n++];
+  *groups = 0;
+  for (int g = 0; g < RECORDER_GROUPS; g++)
+  {
+    const uint8_t* now = &entry->data[g * 8];
+    const uint8_t* before = &cursor->data[g * 8];
+    uint8_t mask = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+      if (now[i] != before[i])
+      {
+        mask |= 1 << i;
+      }
+    }
+    if (mask == 0)
+    {
+      continue;
+    }
+
+    *groups |= 1 << g;
+    out[n++] = mask;
+    for (int i = 0; i < 8; i++)
+    {
+      if (mask & (1 << i))
+      {
+        out[n++] = now[i];
+      }
+    }
+  }
+
+  return n;
+}
+
+size_t recorder_dump_next(const recorder_t* recorder, recorder_cursor_t* cursor, uint8_t* out, size_t size)
+{
+  size_t n = 0;
+
+  while (cursor->index != cursor->end && n + RECORDER_MAX_RECORD <= size)
+  {
+    const recorder_entry_t* entry = &recorder->entries[cursor->index & (recorder->capacity - 1)];
+    bool first = (cursor->index == recorder_overwritten(recorder));
+
+    n += encode(cursor, entry, first, &out[n]);
+    cursor->report = entry->report;
+    memcpy(cursor->data, entry->data, RECORDER_REPORT_SIZE);
+    cursor->index++;
+  }
+
+  return n;
+}
+
+void recorder_decode_begin(recorder_cursor_t* cursor)
+{
+  memset(cursor, 0, sizeof(recorder_cursor_t));
+}
+
+bool recorder_decode(recorder_cursor_t* cursor, const uint8_t* in, size_t size,
+                     void (*fn)(void* ctx, uint32_t report, const uint8_t* data), void* ctx)
+{
+  const uint8_t* end = in + size;
+
+  while (in < end)
+  {
+    if (*in == 0xFF)
+    {
+      if (end - in < 6)
+      {
+        return false;
+      }
+      cursor->report = le_get_u32(&in[1]);
+      in += 5;
+    }
+    else
+    {
+      cursor->report += *in++ + 1;
+    }
+
+    if (in == end)
+    {
+      return false;
+    }
+    uint8_t groups = *in++;
+    for (int g = 0; g < RECORDER_GROUPS; g++)
+    {
+      if (!(groups & (1 << g)))
+      {
+        continue;
+      }
+      if (in == end)
+      {
+        return false;
+      }
+      uint8_t mask = *in++;
+      for (int i = 0; i < 8; i++)
+      {
+        if (mask & (1 << i))
+        {
+          if (in == end)
+          {
+            return false;
+          }
+          cursor->data[g * 8 + i] = *in++;
+        }
+      }
+    }
+
+    fn(ctx, cursor->report, cursor->data);
+  }
+
+  return true;
+}
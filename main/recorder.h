@@ -0,0 +1,87 @@
+// Input recorder: the exact 0x30 reports sent to the console
+//
+// Recording copies each report into a fixed RAM ring (constant time, no
+// branches besides the on/off check), the oldest reports are overwritten.
+// The dump encodes the ring as a compact delta stream:
+//
+//   per report: gap (u8: report number - previous - 1, 0xFF = u32 LE absolute number follows)
+//               group mask (u8: bit g set when any of bytes 8g..8g+7 changed)
+//               per set group: byte mask (u8), then the changed bytes
+//
+// Each record is compared with the previous one (all zeros before the first).
+// recorder_dump_next() never splits a record, so every chunk decodes on its own
+// given the previous chunk's state.
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RECORDER_REPORT_SIZE 48
+#define RECORDER_GROUPS (RECORDER_REPORT_SIZE / 8)
+// gap + absolute number + group mask + byte masks + bytes
+#define RECORDER_MAX_RECORD (1 + 4 + 1 + RECORDER_GROUPS + RECORDER_REPORT_SIZE)
+
+typedef struct
+{
+  uint32_t report; // device report number; data[0] is its timer byte
+  uint8_t data[RECORDER_REPORT_SIZE];
+} recorder_entry_t;
+
+typedef struct
+{
+  recorder_entry_t* entries;
+  uint32_t capacity; // power of two
+  uint32_t head;     // total reports recorded since start
+  volatile bool active;
+} recorder_t;
+
+// Encoder/decoder state: the previous record
+typedef struct
+{
+  uint32_t index; // next entry to encode (encoder only)
+  uint32_t end;
+  uint32_t report;
+  uint8_t data[RECORDER_REPORT_SIZE];
+} recorder_cursor_t;
+
+void recorder_init(recorder_t* recorder, recorder_entry_t* storage, uint32_t capacity);
+
+// Clears the ring and starts recording
+void recorder_start(recorder_t* recorder);
+void recorder_stop(recorder_t* recorder);
+
+// Called once per report sent
+static inline void recorder_record(recorder_t* recorder, uint32_t report, const uint8_t* data)
+{
+  if (recorder->active)
+  {
+    recorder_entry_t* entry = &recorder->entries[recorder->head & (recorder->capacity - 1)];
+    entry->report = report;
+    memcpy(entry->data, data, RECORDER_REPORT_SIZE);
+    recorder->head++;
+  }
+}
+
+// Reports available in the ring, and how many were overwritten
+uint32_t recorder_count(const recorder_t* recorder);
+uint32_t recorder_overwritten(const recorder_t* recorder);
+// Report number of the oldest report in the ring (0 when empty)
+uint32_t recorder_first(const recorder_t* recorder);
+
+// Starts encoding the ring, oldest report first (recording must be stopped)
+void recorder_dump_begin(const recorder_t* recorder, recorder_cursor_t* cursor);
+
+// Encodes as many whole reports as fit into out. Returns 0 when done.
+size_t recorder_dump_next(const recorder_t* recorder, recorder_cursor_t* cursor, uint8_t* out, size_t size);
+
+void recorder_decode_begin(recorder_cursor_t* cursor);
+
+// Decodes one chunk and calls fn for every report. Returns false on malformed input.
+bool recorder_decode(recorder_cursor_t* cursor, const uint8_t* in, size_t size,
+                     void (*fn)(void* ctx, uint32_t report, const uint8_t* data), void* ctx);
+
+#endif
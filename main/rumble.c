@@ -0,0 +1,58 @@
+// HD rumble decoding for output reports 0x01 and 0x10
+
+#include "rumble.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+
+void rumble_decode_side(const uint8_t* data, rumble_side_t* side)
+{
+  // byte0-1: HF frequency (bits 2-8 of a 9-bit field) and HF amplitude (byte1 bits 1-7)
+  side->hf_freq = (uint8_t)(((((data[1] & 0x01) << 8) | data[0]) >> 2) + 0x60);
+  side->hf_amp = data[1] >> 1;
+
+  // byte2-3: LF frequency (byte2 bits 0-6) and LF amplitude (byte2 bit 7 + byte3 - 0x40)
+  side->lf_freq = (data[2] & 0x7F) + 0x40;
+  side->lf_amp = (data[3] >= 0x40) ? (uint8_t)((((data[3] - 0x40) << 1) | (data[2] >> 7)) & 0x7F) : 0;
+}
+
+bool rumble_filter(rumble_filter_t* filter, const uint8_t* data, rumble_event_t* event)
+{
+  rumble_side_t left;
+  rumble_side_t right;
+
+  rumble_decode_side(&data[0], &left);
+  rumble_decode_side(&data[4], &right);
+
+  if(filter->valid &&
+     memcmp(&left, &filter->left, sizeof(rumble_side_t)) == 0 &&
+     memcmp(&right, &filter->right, sizeof(rumble_side_t)) == 0)
+  {
+    filter->duplicates++;
+    return false;
+  }
+
+  filter->left = left;
+  filter->right = right;
+  filter->valid = true;
+
+  event->left = left;
+  event->right = right;
+  return true;
+}
+
+size_t rumble_event_encode(const rumble_event_t* event, uint8_t* payload)
+{
+  le_put_u32(&payload[0], event->time_ms);
+  payload[4] = event->left.hf_freq;
+  payload[5] = event->left.hf_amp;
+  payload[6] = event->left.lf_freq;
+  payload[7] = event->left.lf_amp;
+  payload[8] = event->right.hf_freq;
+  payload[9] = event->right.hf_amp;
+  payload[10] = event->right.lf_freq;
+  payload[11] = event->right.lf_amp;
+
+  return RUMBLE_EVENT_SIZE;
+}
@@ -0,0 +1,53 @@
+// HD rumble decoding for output reports 0x01 and 0x10
+//
+// Bytes 1-8 of every output report are two 4-byte rumble blocks (left,
+// right). Each block packs a high and a low band, each with a frequency
+// and an amplitude code. The neutral block is 00 01 40 40 (320Hz/160Hz,
+// amplitude 0).
+
+#ifndef RUMBLE_H
+#define RUMBLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RUMBLE_DATA_SIZE 8
+#define RUMBLE_EVENT_SIZE 12
+
+// Frequency codes are the encoded value f where Hz = 10 * 2^(f / 32).
+// Amplitude codes are the 7-bit table index, 0 is silent.
+typedef struct
+{
+  uint8_t hf_freq;
+  uint8_t hf_amp;
+  uint8_t lf_freq;
+  uint8_t lf_amp;
+} rumble_side_t;
+
+typedef struct
+{
+  uint32_t time_ms;
+  rumble_side_t left;
+  rumble_side_t right;
+} rumble_event_t;
+
+typedef struct
+{
+  rumble_side_t left;
+  rumble_side_t right;
+  bool valid;
+  uint32_t duplicates;
+} rumble_filter_t;
+
+void rumble_decode_side(const uint8_t* data, rumble_side_t* side);
+
+// Decodes the 8 rumble bytes. Returns false when they match the previous
+// packet, so repeated identical packets produce a single event.
+bool rumble_filter(rumble_filter_t* filter, const uint8_t* data, rumble_event_t* event);
+
+// Serializes an event as the UART_PKT_RUMBLE_EVENT payload:
+// time_ms (u32 LE), left hf_freq, hf_amp, lf_freq, lf_amp, right (same)
+size_t rumble_event_encode(const rumble_event_t* event, uint8_t* payload);
+
+#endif
@@ -0,0 +1,78 @@
+// Inputs scheduled for a given report
+
+#include "schedule.h"
+
+#include <string.h>
+
+#include "little_endian.h"
+
+void schedule_init(schedule_t* schedule)
+{
+  memset(schedule, 0, sizeof(schedule_t));
+}
+
+uint16_t schedule_free(const schedule_t* schedule)
+{
+  return SCHEDULE_SIZE - (uint16_t)(schedule->head - schedule->tail);
+}
+
+void schedule_decode_input(const uint8_t* data, controller_input_t* input)
+{
+  input->but1 = data[0];
+  input->but2 = data[1];
+  input->but3 = data[2];
+  input->lx = data[3];
+  input->ly = data[4];
+  input->rx = data[5];
+  input->ry = data[6];
+}
+
+bool schedule_push_packet(schedule_t* schedule, const uint8_t* payload, uint8_t length)
+{
+  if(length == 0 || length % SCHEDULE_ENTRY_SIZE != 0)
+  {
+    return false;
+  }
+
+  for(const uint8_t* p = payload; p < payload + length; p += SCHEDULE_ENTRY_SIZE)
+  {
+    if(schedule_free(schedule) == 0)
+    {
+      schedule->overflows++;
+      continue;
+    }
+
+    schedule_entry_t* entry = &schedule->entries[schedule->head % SCHEDULE_SIZE];
+    entry->report = le_get_u32(p);
+    schedule_decode_input(&p[4], &entry->input);
+    schedule->head++;
+  }
+
+  return true;
+}
+
+bool schedule_apply(schedule_t* schedule, uint32_t report, controller_input_t* input)
+{
+  bool changed = false;
+
+  while(schedule->head != schedule->tail)
+  {
+    const schedule_entry_t* entry = &schedule->entries[schedule->tail % SCHEDULE_SIZE];
+
+    // wrap-safe "entry->report > report"
+    if((int32_t)(entry->report - report) > 0)
+    {
+      break;
+    }
+    if(entry->report != report)
+    {
+      schedule->late++;
+    }
+
+    *input = entry->input;
+    schedule->tail++;
+    changed = true;
+  }
+
+  return changed;
+}
@@ -0,0 +1,48 @@
+// Inputs scheduled for a given report
+//
+// The device counts every 0x30 report it sends (the low byte is the
+// report timer). The host can queue input states tagged with the report
+// number they must appear in; send_buttons() applies them on that report.
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "input.h"
+
+#define SCHEDULE_SIZE 64 // must be a power of two
+#define SCHEDULE_ENTRY_SIZE 11 // report (u32 LE), but1, but2, but3, lx, ly, rx, ry
+
+typedef struct
+{
+  uint32_t report;
+  controller_input_t input;
+} schedule_entry_t;
+
+typedef struct
+{
+  schedule_entry_t entries[SCHEDULE_SIZE];
+  uint16_t head;
+  uint16_t tail;
+
+  uint32_t late;      // entries applied after their report had already been sent
+  uint32_t overflows; // entries dropped because the queue was full
+} schedule_t;
+
+void schedule_init(schedule_t* schedule);
+
+uint16_t schedule_free(const schedule_t* schedule);
+
+// Queues a UART_PKT_SCHEDULE payload (one or more entries, in report order)
+bool schedule_push_packet(schedule_t* schedule, const uint8_t* payload, uint8_t length);
+
+// Applies every entry due at or before report to *input.
+// Returns true if *input changed.
+bool schedule_apply(schedule_t* schedule, uint32_t report, controller_input_t* input);
+
+// Decodes the 7 state bytes shared by UART_PKT_INPUT_STATE and schedule entries
+void schedule_decode_input(const uint8_t* data, controller_input_t* input);
+
+#endif
@@ -0,0 +1,147 @@
+// Runtime settings: NVS blob loaded once at boot into a RAM struct
+
+#include "settings.h"
+
+#include <string.h>
+
+#include "link_profile.h"
+#include "little_endian.h"
+#include "profile.h"
+
+// 15 FreeRTOS ticks at the 100 Hz tick rate
+#define SETTINGS_DEFAULT_PERIOD_US 150000
+
+// menuconfig Link profile; host builds take the balanced one
+#ifndef CONFIG_UARTNX_LINK_PROFILE
+#define CONFIG_UARTNX_LINK_PROFILE LINK_PROFILE_BALANCED
+#endif
+
+_Static_assert(offsetof(settings_t, link_profile) == SETTINGS_V1_SIZE, "version 1 fields must not move");
+
+static const uint8_t default_colors[SETTINGS_COLORS_LEN] = { PROFILE_COLORS };
+
+void settings_default(settings_t* settings)
+{
+  memset(settings, 0, sizeof(settings_t));
+  settings->version = SETTINGS_VERSION;
+  settings->log_level = 1; // ESP_LOG_ERROR
+  settings->uart_buffer = 256;
+  settings->baud = 9600;
+  settings->report_period_us = SETTINGS_DEFAULT_PERIOD_US;
+  memcpy(settings->colors, default_colors, SETTINGS_COLORS_LEN);
+  strncpy(settings->device_name, PROFILE_DEVICE_NAME, SETTINGS_NAME_LEN - 1);
+  settings->link_profile = CONFIG_UARTNX_LINK_PROFILE;
+}
+
+bool settings_valid(const settings_t* settings)
+{
+  size_t name_len = strnlen(settings->device_name, SETTINGS_NAME_LEN);
+
+  return settings->version == SETTINGS_VERSION &&
+         settings->log_level <= SETTINGS_LOG_LEVEL_MAX &&
+         settings->uart_buffer >= SETTINGS_UART_BUFFER_MIN &&
+         settings->uart_buffer <= SETTINGS_UART_BUFFER_MAX &&
+         settings->baud >= SETTINGS_BAUD_MIN && settings->baud <= SETTINGS_BAUD_MAX &&
+         settings->report_period_us >= SETTINGS_PERIOD_MIN_US &&
+         settings->report_period_us <= SETTINGS_PERIOD_MAX_US &&
+         name_len > 0 && name_len < SETTINGS_NAME_LEN &&
+         settings->link_profile < LINK_PROFILE_COUNT;
+}
+
+bool settings_upgrade(settings_t* settings, size_t size)
+{
+  if (settings->version == 1 && size == SETTINGS_V1_SIZE)
+  {
+    settings->version = SETTINGS_VERSION;
+    return true;
+  }
+  return size == sizeof(settings_t);
+}
+
+bool settings_set(settings_t* settings, const uint8_t* payload, uint8_t length)
+{
+  if (length < 2)
+  {
+    return false;
+  }
+
+  settings_t updated = *settings;
+  const uint8_t* value = &payload[1];
+  uint8_t size = length - 1;
+
+  switch (payload[0])
+  {
+  case SETTING_BAUD:
+    if (size != 4)
+    {
+      return false;
+    }
+    updated.baud = le_get_u32(value);
+    break;
+  case SETTING_UART_BUFFER:
+    if (size != 2)
+    {
+      return false;
+    }
+    updated.uart_buffer = le_get_u16(value);
+    break;
+  case SETTING_REPORT_PERIOD:
+    if (size != 4)
+    {
+      return false;
+    }
+    updated.report_period_us = le_get_u32(value);
+    break;
+  case SETTING_COLORS:
+    if (size != SETTINGS_COLORS_LEN)
+    {
+      return false;
+    }
+    memcpy(updated.colors, value, SETTINGS_COLORS_LEN);
+    break;
+  case SETTING_DEVICE_NAME:
+    if (size >= SETTINGS_NAME_LEN || memchr(value, 0, size) != NULL)
+    {
+      return false;
+    }
+    memset(updated.device_name, 0, SETTINGS_NAME_LEN);
+    memcpy(updated.device_name, value, size);
+    break;
+  case SETTING_LOG_LEVEL:
+    if (size != 1)
+    {
+      return false;
+    }
+    updated.log_level = value[0];
+    break;
+  case SETTING_LINK_PROFILE:
+    if (size != 1)
+    {
+      return false;
+    }
+    updated.link_profile = value[0];
+    break;
+  default:
+    return false;
+  }
+
+  if (!settings_valid(&updated))
+  {
+    return false;
+  }
+  *settings = updated;
+  return true;
+}
+
+size_t settings_encode(const settings_t* settings, uint8_t* out)
+{
+  out[0] = settings->version;
+  out[1] = settings->log_level;
+  le_put_u16(&out[2], settings->uart_buffer);
+  le_put_u32(&out[4], settings->baud);
+  le_put_u32(&out[8], settings->report_period_us);
+  memcpy(&out[12], settings->colors, SETTINGS_COLORS_LEN);
+  memcpy(&out[24], settings->device_name, SETTINGS_NAME_LEN);
+  out[56] = settings->link_profile;
+  return SETTINGS_ENCODED_SIZE;
+}
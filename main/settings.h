@@ -0,0 +1,87 @@
+// Runtime settings: NVS blob loaded once at boot into a RAM struct
+//
+// Hot paths read the fields directly. Edited over UART with
+// UART_PKT_SETTING_SET (id, value); when each setting takes effect:
+//
+//   report period, log level   immediately
+//   colors                     next pairing (the console reads SPI 0x6050 then)
+//   baud                       immediately, reverted unless confirmed (UART_CMD_BAUD_CONFIRM)
+//   link profile               TX power immediately, poll interval next connection, QoS next boot
+//   UART buffer, device name   next boot
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#define SETTINGS_VERSION 2
+#define SETTINGS_NAME_LEN 32 // including the terminating 0
+#define SETTINGS_COLORS_LEN 12
+#define SETTINGS_ENCODED_SIZE 57
+
+#define SETTINGS_BAUD_MIN 9600
+#if CONFIG_UARTNX_POWER_SAVE
+// The UART runs from REF_TICK (1 MHz) so DFS cannot change the rate, and its
+// divider only has 1/16 steps: 460800 and 921600 would come out 2% fast
+#define SETTINGS_BAUD_MAX 250000
+#else
+#define SETTINGS_BAUD_MAX 921600
+#endif
+#define SETTINGS_UART_BUFFER_MIN 256 // the driver needs more than the 128-byte FIFO
+#define SETTINGS_UART_BUFFER_MAX 4096
+#define SETTINGS_PERIOD_MIN_US 5000
+#define SETTINGS_PERIOD_MAX_US 1000000
+#define SETTINGS_LOG_LEVEL_MAX 5 // ESP_LOG_VERBOSE
+#define SETTINGS_V1_SIZE 56      // blob size written by version 1
+
+typedef enum
+{
+  SETTING_BAUD = 1,      // u32 LE
+  SETTING_UART_BUFFER,   // u16 LE, UART driver buffers and read chunk
+  SETTING_REPORT_PERIOD, // u32 LE, us between 0x30 reports once connected
+  SETTING_COLORS,        // 12 bytes: body, buttons, left grip, right grip
+  SETTING_DEVICE_NAME,   // 1-31 characters
+  SETTING_LOG_LEVEL,     // u8, esp_log_level_t applied to "*"
+  SETTING_LINK_PROFILE,  // u8, link_profile_id_t
+} setting_id_t;
+
+// Stored as is in NVS, so only append fields and bump SETTINGS_VERSION
+typedef struct
+{
+  uint8_t version;
+  uint8_t log_level;
+  uint16_t uart_buffer;
+  uint32_t baud;
+  uint32_t report_period_us;
+  uint8_t colors[SETTINGS_COLORS_LEN];
+  char device_name[SETTINGS_NAME_LEN];
+  // version 2
+  uint8_t link_profile;
+} settings_t;
+
+// Compile-time defaults (the values main.c used to hard-code)
+void settings_default(settings_t* settings);
+
+// True when every field is in range, e.g. for a blob read back from NVS
+bool settings_valid(const settings_t* settings);
+
+// Accepts a blob of size bytes read over settings_default() values. Blobs
+// from an older version keep the defaults of the fields added since.
+// Returns false when the blob has to be discarded.
+bool settings_upgrade(settings_t* settings, size_t size);
+
+// Applies one UART_PKT_SETTING_SET payload. Returns false and leaves
+// *settings untouched when the id is unknown or the value out of range.
+bool settings_set(settings_t* settings, const uint8_t* payload, uint8_t length);
+
+// Payload of UART_PKT_SETTINGS: version, log level, uart buffer (u16),
+// baud (u32), report period (u32), colors[12], device name[32], link profile
+size_t settings_encode(const settings_t* settings, uint8_t* out);
+
+#endif
@@ -0,0 +1,197 @@
+// Runtime statistics sent to the host over the stats channel
+
+#include "stats.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "little_endian.h"
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Report interval tracking, reset every window
+static int64_t last_report_us = 0;
+static uint16_t report_count = 0;
+static int32_t deviation_min = 0;
+static int32_t deviation_max = 0;
+
+static uint32_t rumble_dropped = 0;
+
+static int64_t window_start_us = 0;
+
+typedef struct
+{
+  const char* name;
+  TaskHandle_t* handle;
+  uint32_t stack_size;
+} watched_task_t;
+
+static watched_task_t watched[STATS_MAX_WATCHED];
+static int watched_count = 0;
+static uint32_t heap_after_boot = 0;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+typedef struct
+{
+  TaskHandle_t handle;
+  uint32_t runtime;
+} task_runtime_t;
+
+static TaskStatus_t task_status[STATS_MAX_TASKS];
+static task_runtime_t previous[STATS_MAX_TASKS];
+static int previous_count = 0;
+static uint32_t previous_total = 0;
+
+static uint32_t previous_runtime(TaskHandle_t handle)
+{
+  for (int i = 0; i < previous_count; i++)
+  {
+    if (previous[i].handle == handle)
+    {
+      return previous[i].runtime;
+    }
+  }
+  return 0;
+}
+#endif
+
+void stats_init(void)
+{
+  window_start_us = esp_timer_get_time();
+}
+
+void stats_report_sent(uint32_t period_us)
+{
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&stats_mux);
+  if (last_report_us != 0 && period_us != 0)
+  {
+    int32_t deviation = (int32_t)(now - last_report_us) - (int32_t)period_us;
+    if (report_count == 0 || deviation < deviation_min)
+    {
+      deviation_min = deviation;
+    }
+    if (report_count == 0 || deviation > deviation_max)
+    {
+      deviation_max = deviation;
+    }
+    report_count++;
+  }
+  last_report_us = now;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void stats_rumble_dropped(void)
+{
+  portENTER_CRITICAL(&stats_mux);
+  rumble_dropped++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+size_t stats_cpu_payload(uint8_t* payload)
+{
+  int64_t now = esp_timer_get_time();
+  uint16_t core_load[portNUM_PROCESSORS] = {0};
+  size_t size = 0;
+
+  le_put_u16(&payload[0], (uint16_t)((now - window_start_us) / 1000));
+  window_start_us = now;
+
+  portENTER_CRITICAL(&stats_mux);
+  le_put_u16(&payload[2 + portNUM_PROCESSORS * 2], report_count);
+  le_put_u32(&payload[4 + portNUM_PROCESSORS * 2], (uint32_t)deviation_min);
+  le_put_u32(&payload[8 + portNUM_PROCESSORS * 2], (uint32_t)deviation_max);
+  le_put_u32(&payload[12 + portNUM_PROCESSORS * 2], rumble_dropped);
+  report_count = 0;
+  portEXIT_CRITICAL(&stats_mux);
+  size = 16 + portNUM_PROCESSORS * 2;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+  uint32_t total = 0;
+  int count = uxTaskGetSystemState(task_status, STATS_MAX_TASKS, &total);
+  // Task loads are in permille of one core over the window
+  uint32_t window = total - previous_total;
+
+  for (int i = 0; i < count && window > 0; i++)
+  {
+    TaskStatus_t* task = &task_status[i];
+    uint32_t busy = task->ulRunTimeCounter - previous_runtime(task->xHandle);
+    uint16_t load = (uint16_t)((uint64_t)busy * 1000 / window);
+    BaseType_t core = xTaskGetAffinity(task->xHandle);
+
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+    {
+      if (task->xHandle == xTaskGetIdleTaskHandleForCPU(cpu))
+      {
+        core_load[cpu] = (load > 1000) ? 0 : 1000 - load;
+      }
+    }
+
+    uint8_t* entry = &payload[size];
+    memset(entry, 0, STATS_TASK_NAME_LEN);
+    strncpy((char*)entry, task->pcTaskName, STATS_TASK_NAME_LEN);
+    entry[STATS_TASK_NAME_LEN] = (core == tskNO_AFFINITY) ? 0xFF : (uint8_t)core;
+    le_put_u16(&entry[STATS_TASK_NAME_LEN + 1], load);
+    size += STATS_TASK_NAME_LEN + 3;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    previous[i].handle = task_status[i].xHandle;
+    previous[i].runtime = task_status[i].ulRunTimeCounter;
+  }
+  previous_count = count;
+  previous_total = total;
+#endif
+
+  for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+  {
+    le_put_u16(&payload[2 + cpu * 2], core_load[cpu]);
+  }
+
+  return size;
+}
+
+void stats_watch_task(const char* name, TaskHandle_t* handle, uint32_t stack_size)
+{
+  if (watched_count < STATS_MAX_WATCHED)
+  {
+    watched[watched_count].name = name;
+    watched[watched_count].handle = handle;
+    watched[watched_count].stack_size = stack_size;
+    watched_count++;
+  }
+}
+
+void stats_boot_done(void)
+{
+  heap_after_boot = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+size_t stats_mem_payload(uint8_t* payload)
+{
+  size_t size = 16;
+
+  le_put_u32(&payload[0], heap_caps_get_free_size(MALLOC_CAP_8BIT));
+  le_put_u32(&payload[4], heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+  le_put_u32(&payload[8], heap_after_boot);
+  le_put_u32(&payload[12], heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  for (int i = 0; i < watched_count; i++)
+  {
+    TaskHandle_t handle = *watched[i].handle;
+    uint8_t* entry = &payload[size];
+
+    memset(entry, 0, STATS_TASK_NAME_LEN);
+    strncpy((char*)entry, watched[i].name, STATS_TASK_NAME_LEN);
+    le_put_u16(&entry[STATS_TASK_NAME_LEN], (uint16_t)watched[i].stack_size);
+    // High-water mark is in bytes on ESP-IDF (StackType_t is uint8_t)
+    le_put_u16(&entry[STATS_TASK_NAME_LEN + 2], (handle != NULL) ? (uint16_t)uxTaskGetStackHighWaterMark(handle) : 0);
+    size += STATS_TASK_NAME_LEN + 4;
+  }
+
+  return size;
+}
@@ -0,0 +1,49 @@
+// Runtime statistics sent to the host over the stats channel
+//
+// The stats task closes a window every CONFIG_UARTNX_STATS_INTERVAL_MS and,
+// when requested, sends it as UART_PKT_STATS_CPU:
+//   window_ms (u16), core0 and core1 load (u16 permille),
+//   report count (u16), report interval deviation min and max (i32 us),
+//   rumble events dropped since boot (u32),
+//   then per task: name[8], core (u8, 0xFF unpinned), load (u16 permille)
+// and UART_PKT_STATS_MEM:
+//   heap free, heap minimum free, heap free after boot, largest free block (u32),
+//   then per application task: name[8], stack size (u16), stack never used (u16)
+// All integers are little endian.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define STATS_TASK_NAME_LEN 8
+#define STATS_MAX_TASKS 20
+#define STATS_MAX_WATCHED 8
+
+void stats_init(void);
+
+// Called by the report task right after each report is handed to the stack.
+// period_us is 0 for the first report after the report timer was stopped.
+void stats_report_sent(uint32_t period_us);
+
+// Counts a rumble event that did not fit the queue to the UART task
+void stats_rumble_dropped(void);
+
+// Closes the current window and builds the UART_PKT_STATS_CPU payload
+size_t stats_cpu_payload(uint8_t* payload);
+
+// Adds an application task to the stack high-water report. The handle is
+// read through the pointer each time, so tasks may be recreated.
+void stats_watch_task(const char* name, TaskHandle_t* handle, uint32_t stack_size);
+
+// Records the heap level once every boot-time allocation is done
+void stats_boot_done(void);
+
+// Builds the UART_PKT_STATS_MEM payload
+size_t stats_mem_payload(uint8_t* payload);
+
+#endif
@@ -0,0 +1,250 @@
+// Subcommand replies (0x21 reports answering 0x01 output reports)
+
+#include "subcommand.h"
+
+#include <string.h>
+
+#include "profile.h"
+
+// Reply for REQUEST_DEVICE_INFO
+static const uint8_t reply02[] = {
+  0x82, 0x02, 0x04, 0x00, CONTROLLER_TYPE, 0x02, 0xD4, 0xF0,
+  0x57, 0x6E, 0xF0, 0xD7, 0x01, 0x02, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Reply for SET_SHIPMENT_STATE
+static const uint8_t reply08[] = {
+  0x80, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Reply for SET_INPUT_REPORT_MODE
+static const uint8_t reply03[] = {
+  0x80, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Trigger buttons elapsed time
+static const uint8_t reply04[] = {
+  0x83, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x2c, 0x01, 0x2c, 0x01, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Serial number and controller type (although, our code doesn't read (and as
+// such, report) the controller type from here.)
+static const uint8_t spi_reply_address_0[] = {
+  0x90, 0x10, 0x00, 0x60, 0x00, 0x00, 0x10, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+  0x00, CONTROLLER_TYPE, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x0
+};
+// The CONTROLLER_TYPE is technically unused, but it makes me feel better.
+
+// SPI Flash colors, replaced by subcommand_set_colors()
+static uint8_t spi_reply_address_0x50[] = {
+  0x90, 0x10, 0x50, 0x60, 0x00, 0x00, 0x0D, // Start of colors
+  PROFILE_COLORS,                           // Body, Buttons, Left Grip, Right Grip color
+  0xff,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t spi_reply_address_0x80[] = {
+  0x90, 0x10, 0x80, 0x60, 0x00, 0x00, 0x18, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t spi_reply_address_0x98[] = {
+  0x90, 0x10, 0x98, 0x60, 0x00, 0x00, 0x12, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// User analog stick calib
+static const uint8_t spi_reply_address_0x10[] = {
+  0x90, 0x10, 0x10, 0x80, 0x00, 0x00, 0x18, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t spi_reply_address_0x3d[] = {
+  0x90, 0x10, 0x3D, 0x60, 0x00, 0x00, 0x19, 0x00,
+  0x07, 0x70, 0x00, 0x08, 0x80, 0x00, 0x07, 0x70,
+  0x00, 0x08, 0x80, 0x00, 0x07, 0x70, 0x00, 0x07,
+  0x70, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xff, 0xff,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t spi_reply_address_0x20[] = {
+  0x90, 0x10, 0x20, 0x60, 0x00, 0x00, 0x18, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Reply for changing the status of the IMU IMU (6-Axis sensor)
+static const uint8_t reply4001[] = {
+  0x80, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t reply4801[] = {
+  0x80, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Reply for SubCommand.SET_PLAYER_LIGHTS
+static const uint8_t reply3001[] = {
+  0x80, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t reply3333[] = {
+  0xa0, 0x21, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00,
+  0x05, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x7b, 0x00
+};
+
+// Reply for SubCommand.SET_NFC_IR_MCU_STATE
+static const uint8_t reply3401[] = {
+  0x80, 0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+// Start of PROFILE_COLORS in spi_reply_address_0x50
+#define SPI_COLORS_OFFSET 7
+
+// SPI flash reads (subcommand 0x10), keyed by the address bytes data[10], data[11]
+typedef struct
+{
+  uint8_t low;
+  uint8_t high;
+  const char* name;
+  const uint8_t* body;
+  uint8_t size;
+} spi_reply_t;
+
+#define SPI_REPLY(low, high, name, table) { low, high, name, table, sizeof(table) }
+
+static const spi_reply_t spi_replies[] = {
+  SPI_REPLY(0x00, 0x60, "replyspi0", spi_reply_address_0),
+  SPI_REPLY(0x50, 0x60, "replyspi50", spi_reply_address_0x50),
+  SPI_REPLY(0x80, 0x60, "replyspi80", spi_reply_address_0x80),
+  SPI_REPLY(0x98, 0x60, "replyspi98", spi_reply_address_0x98),
+  SPI_REPLY(0x10, 0x80, "replyspi10", spi_reply_address_0x10),
+  SPI_REPLY(0x3D, 0x60, "reply3d", spi_reply_address_0x3d),
+  SPI_REPLY(0x20, 0x60, "replyspi20", spi_reply_address_0x20),
+};
+
+_Static_assert(sizeof(spi_replies) / sizeof(spi_replies[0]) == SUBCOMMAND_SPI_BLOCKS,
+               "SUBCOMMAND_SPI_BLOCKS must match spi_replies");
+
+static bool set_reply(subcommand_reply_t* reply, const char* name, const uint8_t* body, uint8_t size,
+                      subcommand_action_t action)
+{
+  reply->name = name;
+  reply->body = body;
+  reply->size = size;
+  reply->action = action;
+  reply->spi_block = -1;
+  return true;
+}
+
+#define REPLY(name, action) set_reply(reply, #name, name, sizeof(name), action)
+
+bool subcommand_lookup(const uint8_t* data, size_t length, subcommand_reply_t* reply)
+{
+  if (length < SUBCOMMAND_MIN_LENGTH)
+  {
+    return false;
+  }
+
+  switch (data[9])
+  {
+  case 0x02:
+    return REPLY(reply02, SUBCOMMAND_ACTION_NONE);
+  case 0x03:
+    return REPLY(reply03, SUBCOMMAND_ACTION_NONE);
+  case 0x04:
+    return REPLY(reply04, SUBCOMMAND_ACTION_NONE);
+  case 0x08:
+    return REPLY(reply08, SUBCOMMAND_ACTION_NONE);
+  case 0x10:
+    for (size_t i = 0; i < sizeof(spi_replies) / sizeof(spi_replies[0]); i++)
+    {
+      const spi_reply_t* spi = &spi_replies[i];
+      if (data[10] == spi->low && data[11] == spi->high)
+      {
+        set_reply(reply, spi->name, spi->body, spi->size, SUBCOMMAND_ACTION_NONE);
+        reply->spi_block = (int8_t)i;
+        return true;
+      }
+    }
+    return false;
+  case 0x21:
+    if (data[10] != 0x21)
+    {
+      return false;
+    }
+    return REPLY(reply3333, SUBCOMMAND_ACTION_PAIRED);
+  case 0x22:
+    return REPLY(reply3401, SUBCOMMAND_ACTION_NONE);
+  case 0x30:
+    return REPLY(reply3001, PROFILE_PAIRED_ON_PLAYER_LIGHTS ? SUBCOMMAND_ACTION_PAIRED : SUBCOMMAND_ACTION_NONE);
+  case 0x40:
+    // 0x40 0x01 enables the 6-axis sensor, 0x40 0x00 disables it
+    return REPLY(reply4001, data[10] == 1 ? SUBCOMMAND_ACTION_IMU_ON : SUBCOMMAND_ACTION_IMU_OFF);
+  case 0x48:
+    return REPLY(reply4801, SUBCOMMAND_ACTION_NONE);
+  default:
+    return false;
+  }
+}
+
+void subcommand_set_colors(const uint8_t* colors)
+{
+  memcpy(&spi_reply_address_0x50[SPI_COLORS_OFFSET], colors, SUBCOMMAND_COLORS_LEN);
+}
+
+size_t subcommand_build_reply(const uint8_t* report, const subcommand_reply_t* reply, uint8_t* out)
+{
+  memcpy(out, report, SUBCOMMAND_HEADER_SIZE - 1);
+  out[SUBCOMMAND_HEADER_SIZE - 1] = 0x00;
+  memcpy(&out[SUBCOMMAND_HEADER_SIZE], reply->body, reply->size);
+  return SUBCOMMAND_HEADER_SIZE + reply->size;
+}
@@ -0,0 +1,53 @@
+// Subcommand replies (0x21 reports answering 0x01 output reports)
+//
+// Every reply starts with the same 12-byte input header as the 0x30 report
+// (timer, connection info, buttons, sticks, vibrator). The tables in
+// subcommand.c hold only the bytes after it; subcommand_build_reply()
+// prepends the header.
+
+#ifndef SUBCOMMAND_H
+#define SUBCOMMAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUBCOMMAND_HEADER_SIZE 12
+#define SUBCOMMAND_REPLY_MAX 49
+// data[9] subcommand id, data[10..11] first argument bytes
+#define SUBCOMMAND_MIN_LENGTH 12
+#define SUBCOMMAND_COLORS_LEN 12
+// SPI flash blocks answered for subcommand 0x10, all read during pairing
+#define SUBCOMMAND_SPI_BLOCKS 7
+
+// Side effects the caller applies after sending the reply
+typedef enum
+{
+  SUBCOMMAND_ACTION_NONE = 0,
+  SUBCOMMAND_ACTION_IMU_ON,
+  SUBCOMMAND_ACTION_IMU_OFF,
+  SUBCOMMAND_ACTION_PAIRED,
+} subcommand_action_t;
+
+typedef struct
+{
+  const char* name; // for logging
+  const uint8_t* body;
+  uint8_t size;
+  subcommand_action_t action;
+  int8_t spi_block; // 0..SUBCOMMAND_SPI_BLOCKS-1 for SPI reads, -1 otherwise
+} subcommand_reply_t;
+
+// Looks up the reply for an output report payload (intr_data.data).
+// Returns false for unknown subcommands and payloads shorter than SUBCOMMAND_MIN_LENGTH.
+bool subcommand_lookup(const uint8_t* data, size_t length, subcommand_reply_t* reply);
+
+// Replaces the body, buttons, left grip and right grip colors returned for SPI 0x6050.
+// Not synchronized with subcommand_build_reply(); callers hold the same lock for both.
+void subcommand_set_colors(const uint8_t* colors);
+
+// Writes header (first 11 bytes of report, then 0x00) and body into out.
+// Returns the reply size.
+size_t subcommand_build_reply(const uint8_t* report, const subcommand_reply_t* reply, uint8_t* out);
+
+#endif
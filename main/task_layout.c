@@ -0,0 +1,33 @@
+// Application task placement: core and priority of every task
+
+#include "task_layout.h"
+
+#include <stddef.h>
+
+static const task_layout_t layouts[TASK_LAYOUT_COUNT] = {
+  [TASK_LAYOUT_SHARED] = {
+    .name = "shared",
+    .tasks = {
+      [TASK_UART] = {.core = 1, .priority = 1},
+      [TASK_SEND] = {.core = 0, .priority = 2},
+      [TASK_STATS] = {.core = TASK_LAYOUT_UNPINNED, .priority = 1},
+      [TASK_BLINK] = {.core = TASK_LAYOUT_UNPINNED, .priority = 2},
+    },
+    .uart_isr_core = 0, // app_main
+  },
+  [TASK_LAYOUT_REALTIME] = {
+    .name = "realtime",
+    .tasks = {
+      [TASK_UART] = {.core = 1, .priority = 9},
+      [TASK_SEND] = {.core = 0, .priority = 10}, // same core as the Bluetooth host it hands reports to
+      [TASK_STATS] = {.core = 0, .priority = 0},
+      [TASK_BLINK] = {.core = 0, .priority = 0},
+    },
+    .uart_isr_core = 1,
+  },
+};
+
+const task_layout_t* task_layout_get(uint8_t id)
+{
+  return id < TASK_LAYOUT_COUNT ? &layouts[id] : NULL;
+}
@@ -0,0 +1,56 @@
+// Application task placement: core and priority of every task
+//
+// Selected at build time with CONFIG_UARTNX_TASKS_*. The layout also names
+// the core the UART driver is installed from, since the driver allocates
+// its interrupt on the installing core.
+//
+//   shared    the original layout: uart_task on core 1, send_task on core 0
+//             next to the Bluetooth host, the rest unpinned; UART interrupt
+//             on core 0
+//   realtime  core 1 is left to UART reception (interrupt and uart_task),
+//             send_task has the highest application priority and the
+//             diagnostics tasks run at idle priority on core 0. Meant to be
+//             built with the UART ISR and the frame decode in IRAM.
+//
+// Every priority stays below the Bluetooth stack and esp_timer tasks.
+
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include <stdint.h>
+
+#define TASK_LAYOUT_UNPINNED -1
+
+typedef enum
+{
+  TASK_LAYOUT_SHARED = 0,
+  TASK_LAYOUT_REALTIME,
+  TASK_LAYOUT_COUNT,
+} task_layout_id_t;
+
+typedef enum
+{
+  TASK_UART = 0, // uart_task: reception and frame decode
+  TASK_SEND,     // send_task: one report per timer tick
+  TASK_STATS,
+  TASK_BLINK,
+  TASK_COUNT,
+} task_id_t;
+
+typedef struct
+{
+  int8_t core; // TASK_LAYOUT_UNPINNED for either core
+  uint8_t priority;
+} task_slot_t;
+
+typedef struct
+{
+  const char* name;
+  task_slot_t tasks[TASK_COUNT];
+  uint8_t uart_isr_core;
+} task_layout_t;
+
+// NULL for an unknown id
+const task_layout_t* task_layout_get(uint8_t id);
+
+#endif
@@ -0,0 +1,211 @@
+// UART stream decoder/encoder
+
+#include "uart_proto.h"
+
+#include <string.h>
+
+enum
+{
+  STATE_IDLE = 0,
+  STATE_FRAME,
+  STATE_TYPE,
+  STATE_LENGTH,
+  STATE_PAYLOAD,
+  STATE_CHECKSUM,
+};
+
+#define FRAME_SYNC_BYTES 5
+
+enum
+{
+  FRAME_NONE = 0, // no frame started
+  FRAME_PARTIAL,  // frame[] holds the start of a frame
+  FRAME_DONE,     // frame[] holds a whole frame
+  FRAME_BROKEN,   // the frame broke off, frame[] was rescanned
+};
+
+void uart_proto_init(uart_proto_t* proto)
+{
+  memset(proto, 0, sizeof(uart_proto_t));
+}
+
+void uart_proto_idle(uart_proto_t* proto)
+{
+  if(proto->state != STATE_IDLE)
+  {
+    proto->errors++;
+    proto->state = STATE_IDLE;
+  }
+  proto->frame_count = 0;
+  proto->synced = true;
+}
+
+// Sync bytes 0-4, buttons and sticks 5-9, 0x00 at 10
+static inline bool frame_byte_ok(uint8_t index, uint8_t byte)
+{
+  if(index < FRAME_SYNC_BYTES)
+  {
+    return byte == UART_PROTO_FRAME_SYNC;
+  }
+  return index != INPUT_FRAME_SIZE - 1 || byte == 0x00;
+}
+
+static bool frame_prefix_ok(const uint8_t* bytes, uint8_t count)
+{
+  for(uint8_t i = 0; i < count; i++)
+  {
+    if(!frame_byte_ok(i, bytes[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends a byte to frame[]. When it does not fit, the frame restarts at
+// the first later 0xAA whose bytes still fit.
+static uint8_t frame_feed(uart_proto_t* proto, uint8_t byte)
+{
+  uint8_t count = proto->frame_count;
+
+  proto->frame[count++] = byte;
+  if(frame_byte_ok(count - 1, byte))
+  {
+    if(count == INPUT_FRAME_SIZE)
+    {
+      proto->frame_count = 0;
+      return FRAME_DONE;
+    }
+    proto->frame_count = count;
+    return FRAME_PARTIAL;
+  }
+
+  uint8_t start = 1;
+  while(start < count && !frame_prefix_ok(&proto->frame[start], count - start))
+  {
+    start++;
+  }
+  proto->frame_count = count - start;
+  memmove(proto->frame, &proto->frame[start], proto->frame_count);
+  return count > 1 ? FRAME_BROKEN : FRAME_NONE;
+}
+
+// A byte outside any frame or packet
+static uart_proto_event_t feed_idle(uart_proto_t* proto, uint8_t byte)
+{
+  if(byte == UART_PROTO_FRAME_SYNC)
+  {
+    frame_feed(proto, byte);
+    proto->state = STATE_FRAME;
+  }
+  else if(byte == UART_PROTO_PACKET_SYNC)
+  {
+    proto->state = STATE_TYPE;
+  }
+  else if((byte & 0x80) && proto->synced)
+  {
+    proto->command = byte;
+    return UART_PROTO_COMMAND;
+  }
+  // Anything else between frames is line noise and is skipped
+  return UART_PROTO_NONE;
+}
+
+uart_proto_event_t uart_proto_feed(uart_proto_t* proto, uint8_t byte)
+{
+  // Out of step, the packet may have been opened by a button byte
+  if(!proto->synced && proto->state >= STATE_TYPE && frame_feed(proto, byte) == FRAME_DONE)
+  {
+    proto->state = STATE_IDLE;
+    proto->synced = true;
+    return UART_PROTO_FRAME;
+  }
+
+  switch(proto->state)
+  {
+    case STATE_IDLE:
+      return feed_idle(proto, byte);
+
+    case STATE_FRAME:
+      switch(frame_feed(proto, byte))
+      {
+        case FRAME_DONE:
+          proto->state = STATE_IDLE;
+          proto->synced = true;
+          return UART_PROTO_FRAME;
+        case FRAME_BROKEN:
+          proto->errors++;
+          proto->synced = false;
+          if(proto->frame_count == 0)
+          {
+            // Not part of any frame, so it may start a packet
+            proto->state = STATE_IDLE;
+            feed_idle(proto, byte);
+          }
+          return UART_PROTO_ERROR;
+        default:
+          break;
+      }
+      break;
+
+    case STATE_TYPE:
+      proto->type = byte;
+      proto->checksum = byte;
+      proto->state = STATE_LENGTH;
+      break;
+
+    case STATE_LENGTH:
+      proto->length = byte;
+      proto->checksum ^= byte;
+      proto->count = 0;
+      proto->state = (byte == 0) ? STATE_CHECKSUM : STATE_PAYLOAD;
+      break;
+
+    case STATE_PAYLOAD:
+      proto->payload[proto->count++] = byte;
+      proto->checksum ^= byte;
+      if(proto->count == proto->length)
+      {
+        proto->state = STATE_CHECKSUM;
+      }
+      break;
+
+    case STATE_CHECKSUM:
+      // Out of step, a whole frame header under the packet means its 0x55 was a button byte
+      if(byte != proto->checksum || (!proto->synced && proto->frame_count >= FRAME_SYNC_BYTES))
+      {
+        proto->errors++;
+        proto->synced = false;
+        // a frame start found under the packet carries on
+        proto->state = proto->frame_count > 0 ? STATE_FRAME : STATE_IDLE;
+        return UART_PROTO_ERROR;
+      }
+      proto->state = STATE_IDLE;
+      proto->synced = true;
+      proto->frame_count = 0;
+      return UART_PROTO_PACKET;
+
+    default:
+      proto->state = STATE_IDLE;
+      break;
+  }
+
+  return UART_PROTO_NONE;
+}
+
+size_t uart_proto_encode(uint8_t type, const uint8_t* payload, uint8_t length, uint8_t* out)
+{
+  uint8_t checksum = type ^ length;
+
+  out[0] = UART_PROTO_PACKET_SYNC;
+  out[1] = type;
+  out[2] = length;
+  for(int i = 0; i < length; i++)
+  {
+    out[3 + i] = payload[i];
+    checksum ^= payload[i];
+  }
+  out[3 + length] = checksum;
+
+  return length + 4;
+}
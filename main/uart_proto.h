@@ -0,0 +1,111 @@
+// UART stream decoder/encoder
+//
+// The host sends three kinds of data on the same stream:
+//  - legacy 11-byte frames starting with 0xAA (see README)
+//  - single command bytes (0x80-0xFF except the 0xAA frame sync)
+//  - packets: 0x55, type, length, payload[length], checksum
+//    where checksum is the XOR of type, length and every payload byte.
+// The device answers on the same stream with packets of the same shape.
+//
+// Frame headers are checked byte by byte. A frame that breaks off (bytes
+// lost at UART wake-up, a host started mid-frame) is rescanned from its next
+// 0xAA, and until a valid frame or packet completes the stream counts as out
+// of step: command bytes are dropped, since button bytes of the broken frame
+// can look like commands, and frames are looked for inside any packet a
+// stray 0x55 opened. A new decoder starts out of step as well, since the
+// device may boot in the middle of a frame; a quiet line (uart_proto_idle())
+// puts it back in step.
+
+#ifndef UART_PROTO_H
+#define UART_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input.h"
+
+#define UART_PROTO_FRAME_SYNC 0xAA
+#define UART_PROTO_PACKET_SYNC 0x55
+#define UART_PROTO_MAX_PAYLOAD 255
+// sync + type + length + payload + checksum
+#define UART_PROTO_MAX_PACKET (UART_PROTO_MAX_PAYLOAD + 4)
+
+// Single byte commands
+#define UART_CMD_COMBO_BASE 0xC0 // 0xC0-0xC7 start combo slot 0-7
+#define UART_CMD_COMBO_STOP 0xC8
+#define UART_CMD_IMU_BASE 0xD0 // 0xD0 host stream, 0xD1 rest, 0xD2 tilt L, 0xD3 tilt R, 0xD4 shake
+#define UART_CMD_IMU_LAST 0xD4
+#define UART_CMD_STATS_ONCE 0xE0 // send the next stats window
+#define UART_CMD_STATS_STREAM_ON 0xE1 // send every stats window
+#define UART_CMD_STATS_STREAM_OFF 0xE2
+#define UART_CMD_CLOCK 0xE3 // answer with UART_PKT_CLOCK
+#define UART_CMD_RECORD_START 0xE4 // clear the recorder and record every report sent
+#define UART_CMD_RECORD_STOP 0xE5
+#define UART_CMD_RECORD_DUMP 0xE6 // stop, then send UART_PKT_RECORD_INFO, _DATA..., _END
+#define UART_CMD_SETTINGS_GET 0xE7 // answer with UART_PKT_SETTINGS
+#define UART_CMD_SETTINGS_SAVE 0xE8 // store the RAM settings to NVS
+#define UART_CMD_BAUD_CONFIRM 0xE9 // keep the baud announced by UART_PKT_BAUD_PENDING
+#define UART_CMD_PAIRING 0xEA // answer with UART_PKT_PAIRING
+
+// Packet types, host to device
+#define UART_PKT_TURBO_SET 0x01  // group, mask0, mask1, mask2, on, off
+#define UART_PKT_COMBO_SET 0x02  // slot, name[12], step_count, steps[] (but1, but2, but3, lx, ly, rx, ry, reports)
+#define UART_PKT_MACRO_SAVE 0x03 // (none) store turbo/combo config to NVS
+#define UART_PKT_IMU_SAMPLES 0x04 // seq (u16 LE), samples[] (accel xyz, gyro xyz as int16 LE)
+#define UART_PKT_INPUT_STATE 0x05 // but1, but2, but3, lx, ly, rx, ry (full analog sticks)
+#define UART_PKT_SCHEDULE 0x06 // entries[] of report (u32 LE) + the 7 UART_PKT_INPUT_STATE bytes
+#define UART_PKT_SETTING_SET 0x07 // setting id, value (see settings.h)
+
+// Packet types, device to host
+#define UART_PKT_RUMBLE_EVENT 0x81 // time_ms (u32 LE), left and right hf_freq, hf_amp, lf_freq, lf_amp
+#define UART_PKT_STATS_CPU 0x82 // see stats.h
+#define UART_PKT_STATS_MEM 0x83 // see stats.h
+#define UART_PKT_CLOCK 0x84 // next report number (u32 LE), report period us (u32 LE), free schedule slots (u16 LE)
+#define UART_PKT_RECORD_INFO 0x85 // first report, reports, overwritten, report period us (u32 LE each)
+#define UART_PKT_RECORD_DATA 0x86 // seq (u16 LE), recorder delta stream (see recorder.h)
+#define UART_PKT_RECORD_END 0x87 // chunks (u16 LE), stream bytes (u32 LE)
+#define UART_PKT_SETTINGS 0x88 // settings_encode() payload, sent after every accepted change
+#define UART_PKT_BAUD_PENDING 0x89 // new baud (u32 LE), confirm timeout ms (u16 LE); sent at the old rate
+#define UART_PKT_PAIRING 0x8A // pairing_encode() payload, also sent on every pairing state change
+#define UART_PKT_LINK 0x8B // link_window_close() payload, sent with the stats packets
+
+typedef enum
+{
+  UART_PROTO_NONE = 0,  // byte consumed, nothing complete yet
+  UART_PROTO_FRAME,     // a valid legacy frame is in frame[]
+  UART_PROTO_COMMAND,   // a single byte command is in command
+  UART_PROTO_PACKET,    // a packet is in type/length/payload[]
+  UART_PROTO_ERROR,     // a malformed frame or packet was dropped, the stream is out of step
+} uart_proto_event_t;
+
+typedef struct
+{
+  uint8_t state;
+  uint16_t count;
+  uint8_t checksum;
+  bool synced; // false from a dropped frame or packet until the next valid one or a quiet line
+
+  uint8_t frame[INPUT_FRAME_SIZE];
+  uint8_t frame_count; // bytes of frame[] that match the frame layout so far
+  uint8_t command;
+  uint8_t type;
+  uint8_t length;
+  uint8_t payload[UART_PROTO_MAX_PAYLOAD];
+
+  uint32_t errors;
+} uart_proto_t;
+
+void uart_proto_init(uart_proto_t* proto);
+
+// Call when nothing arrived for a while: drops an unfinished frame or packet
+// and accepts commands again
+void uart_proto_idle(uart_proto_t* proto);
+
+// Feeds one received byte, returns what (if anything) became complete
+uart_proto_event_t uart_proto_feed(uart_proto_t* proto, uint8_t byte);
+
+// Builds a packet into out (at least length + 4 bytes), returns its size
+size_t uart_proto_encode(uint8_t type, const uint8_t* payload, uint8_t length, uint8_t* out);
+
+#endif